@@ -6,9 +6,18 @@
  **********************************************************************/
 
 #include <QApplication>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "src/qt/main_widget.hpp"
+#include "src/core/images/image.hpp"
+#include "src/core/images/cache.hpp"
+#include "src/core/images/pyramid.hpp"
+#include "src/core/geometry/grid.hpp"
 
 /*! \mainpage Developper guide
  *
@@ -28,7 +37,58 @@
  *
  */
 
+//! @brief Run a command line tool instead of the application when the first argument asks for one.
+//! --bench-decoding nbSlices file... : decoding throughput of a TIFF image, see TIFFReader::benchmarkDecoding().
+//! --bench-cache-layouts [size [interpolation]] : sampling throughput of a size^3 volume for each brick size, see benchmarkCacheLayouts().
+//! --convert-bvol file... output.bvol : convert an image to the bricked volume format, see BrickVolume::write().
+//! --write-levels nbLevels file... : write the levels downsampled by 2, 4, ... next to the image, see Pyramid::writeLevels().
+//! The images opened later with a subsample factor then read these levels instead of the full resolution image.
+//! The image is streamed from the files by both conversions, it is never loaded in memory as a whole.
+//! @return The exit code of the tool, -1 if no tool was asked.
+int runCommand(int argc, char* argv[]) {
+	if(argc < 2)
+		return -1;
+	if(std::strcmp(argv[1], "--bench-decoding") == 0) {
+		if(argc < 4) {
+			std::cerr << "ERROR: usage [" << argv[0] << " --bench-decoding nbSlices file...]" << std::endl;
+			return 1;
+		}
+		TIFFReader reader(std::vector<std::string>(argv + 3, argv + argc));
+		reader.benchmarkDecoding(std::atoi(argv[2]));
+		return 0;
+	}
+	if(std::strcmp(argv[1], "--bench-cache-layouts") == 0) {
+		const int size = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 512;
+		const Interpolation::Method interpolationMethod = (argc > 3) ? Interpolation::fromString(argv[3]) : Interpolation::Method::Linear;
+		benchmarkCacheLayouts(glm::ivec3(size, size, size), {0, 8, 16, 32}, interpolationMethod);
+		return 0;
+	}
+	if(std::strcmp(argv[1], "--convert-bvol") == 0) {
+		if(argc < 4) {
+			std::cerr << "ERROR: usage [" << argv[0] << " --convert-bvol file... output.bvol]" << std::endl;
+			return 1;
+		}
+		ImageReader image(std::vector<std::string>(argv + 2, argv + argc - 1));
+		return BrickVolume::write(image, argv[argc - 1]) ? 0 : 1;
+	}
+	if(std::strcmp(argv[1], "--write-levels") == 0) {
+		if(argc < 4 || std::atoi(argv[2]) < 1) {
+			std::cerr << "ERROR: usage [" << argv[0] << " --write-levels nbLevels file...]" << std::endl;
+			return 1;
+		}
+		// The levels are filtered as the Sampler would, so they are used in place of its own downsampling
+		const std::vector<std::string> filenames(argv + 3, argv + argc);
+		ImageReader image(filenames);
+		return Pyramid::writeLevels(image, filenames[0], std::atoi(argv[2]), DOWNSAMPLING_FILTER) ? 0 : 1;
+	}
+	return -1;
+}
+
 int main(int argc, char* argv[]) {
+	const int exitCode = runCommand(argc, argv);
+	if(exitCode >= 0)
+		return exitCode;
+
 	QSurfaceFormat fmt;
 	fmt.setOption(QSurfaceFormat::DebugContext);	// adds GL_KHR_debug extension to the OpenGL context creation
 	//fmt.setSamples(4); // enables multi-sampling
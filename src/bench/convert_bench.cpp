@@ -0,0 +1,148 @@
+/**********************************************************************
+ * FILE : convert_bench.cpp
+ * DESC : Correctness and throughput of the row conversion kernels of
+ *        Convert, for each type an image can be stored with.
+ *        Returns a non zero code if a kernel differs from the scalar
+ *        conversion, so it can be run by ctest.
+ **********************************************************************/
+
+#include "../core/images/convert.hpp"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+    //! @brief Random values of in_t. The floating values stay inside the range of out_t, as converting them outside of it is undefined.
+    template<typename in_t, typename out_t>
+    std::vector<in_t> randomValues(std::size_t nbValues, std::mt19937& rng) {
+        std::vector<in_t> values(nbValues);
+        if constexpr (std::is_floating_point<in_t>::value) {
+            const double max = std::is_floating_point<out_t>::value ? 1e6 : static_cast<double>(std::numeric_limits<out_t>::max());
+            std::uniform_real_distribution<double> distribution(0., max);
+            for(in_t& value : values)
+                value = static_cast<in_t>(distribution(rng));
+        } else {
+            // Any bit pattern is a valid integer, including the extreme values
+            std::uniform_int_distribution<int> distribution(0, 255);
+            for(in_t& value : values) {
+                unsigned char bytes[sizeof(in_t)];
+                for(unsigned char& byte : bytes)
+                    byte = static_cast<unsigned char>(distribution(rng));
+                std::memcpy(&value, bytes, sizeof(in_t));
+            }
+        }
+        return values;
+    }
+
+    //! @brief Scalar conversion, one value at a time, used as the reference of Convert::convertRow().
+    template<typename in_t, typename out_t>
+    std::vector<out_t> convertReference(const std::vector<in_t>& in, int begin, int end, int stride, int duplicate) {
+        std::vector<out_t> out;
+        for(int i = begin; i < end; i += stride)
+            for(int d = 0; d < duplicate; ++d)
+                out.push_back(Convert::convertValue<in_t, out_t>(in[i]));
+        return out;
+    }
+
+    template<typename in_t, typename out_t>
+    bool checkKernel(Image::ImageDataType imgDataType, const std::string& name, std::mt19937& rng) {
+        const Convert::RowKernel<out_t> kernel = Convert::getRowKernel<out_t>(imgDataType);
+        if(kernel == nullptr) {
+            std::cerr << "ERROR: no kernel for [" << name << "]" << std::endl;
+            return false;
+        }
+
+        bool isValid = true;
+        const int rowSize = 1021;
+        const std::vector<in_t> row = randomValues<in_t, out_t>(rowSize, rng);
+        for(int begin : {0, 1, 7})
+            for(int end : {rowSize, rowSize - 3, begin})
+                for(int stride : {1, 2, 3, 8})
+                    for(int duplicate : {1, 2, 3, 4}) {
+                        const std::vector<out_t> expected = convertReference<in_t, out_t>(row, begin, end, stride, duplicate);
+                        std::vector<out_t> out(expected.size() + 1, out_t(42));
+                        const std::size_t nbWritten = kernel(row.data(), out.data(), begin, end, stride, duplicate);
+                        // The value after the row must not be written
+                        if(nbWritten != expected.size() || !std::equal(expected.begin(), expected.end(), out.begin()) || out.back() != out_t(42)) {
+                            std::cerr << "ERROR: [" << name << "] differs from the scalar conversion with begin [" << begin << "] end [" << end << "] stride [" << stride << "] duplicate [" << duplicate << "]" << std::endl;
+                            isValid = false;
+                        }
+                    }
+
+        // Throughput of whole rows, as they are read from the files, against the scalar conversion
+        const std::size_t nbValues = 1 << 20;
+        const int nbRepetitions = 10;
+        const std::vector<in_t> in = randomValues<in_t, out_t>(nbValues, rng);
+        std::vector<out_t> out(nbValues);
+        auto measure = [&](auto&& convert) {
+            convert();
+            const auto start = std::chrono::steady_clock::now();
+            for(int i = 0; i < nbRepetitions; ++i)
+                convert();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            return static_cast<double>(nbValues) * nbRepetitions / elapsed.count() / 1e6;
+        };
+        const double kernelSpeed = measure([&]() { kernel(in.data(), out.data(), 0, nbValues, 1, 1); });
+        const double scalarSpeed = measure([&]() {
+            // The volatile reads prevent the compiler from vectorizing the reference
+            const volatile in_t * scalarIn = in.data();
+            for(std::size_t i = 0; i < nbValues; ++i)
+                out[i] = Convert::convertValue<in_t, out_t>(scalarIn[i]);
+        });
+        // Keeps the results of the conversions alive
+        const volatile out_t result = out[nbValues / 2];
+        (void)result;
+        std::cout << std::left << std::setw(24) << name << (isValid ? "OK    " : "FAILED") << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(8) << kernelSpeed << " Mvalues/s (scalar " << std::setw(6) << scalarSpeed << ")" << std::endl;
+        return isValid;
+    }
+
+    template<typename out_t>
+    bool checkKernels(const std::string& outName, std::mt19937& rng) {
+        using Type = Image::ImageDataType;
+        bool isValid = true;
+        isValid &= checkKernel<uint8_t, out_t>(Type::Unsigned | Type::Bit_8, "uint8 -> " + outName, rng);
+        isValid &= checkKernel<uint16_t, out_t>(Type::Unsigned | Type::Bit_16, "uint16 -> " + outName, rng);
+        isValid &= checkKernel<uint32_t, out_t>(Type::Unsigned | Type::Bit_32, "uint32 -> " + outName, rng);
+        isValid &= checkKernel<uint64_t, out_t>(Type::Unsigned | Type::Bit_64, "uint64 -> " + outName, rng);
+        isValid &= checkKernel<int8_t, out_t>(Type::Signed | Type::Bit_8, "int8 -> " + outName, rng);
+        isValid &= checkKernel<int16_t, out_t>(Type::Signed | Type::Bit_16, "int16 -> " + outName, rng);
+        isValid &= checkKernel<int32_t, out_t>(Type::Signed | Type::Bit_32, "int32 -> " + outName, rng);
+        isValid &= checkKernel<int64_t, out_t>(Type::Signed | Type::Bit_64, "int64 -> " + outName, rng);
+        isValid &= checkKernel<float, out_t>(Type::Floating | Type::Bit_32, "float -> " + outName, rng);
+        isValid &= checkKernel<double, out_t>(Type::Floating | Type::Bit_64, "double -> " + outName, rng);
+        return isValid;
+    }
+
+    //! @brief The signed values are shifted so that their minimum becomes 0.
+    bool checkSignedShift() {
+        bool isValid = true;
+        isValid &= Convert::convertValue<int8_t, uint8_t>(-128) == 0;
+        isValid &= Convert::convertValue<int8_t, uint8_t>(0) == 128;
+        isValid &= Convert::convertValue<int8_t, uint8_t>(127) == 255;
+        isValid &= Convert::convertValue<int16_t, uint16_t>(-32768) == 0;
+        isValid &= Convert::convertValue<int16_t, uint16_t>(-1) == 32767;
+        isValid &= Convert::convertValue<int16_t, uint16_t>(32767) == 65535;
+        isValid &= Convert::convertValue<int16_t, float>(0) == 32768.f;
+        if(!isValid)
+            std::cerr << "ERROR: the signed values are not shifted to the unsigned range" << std::endl;
+        return isValid;
+    }
+}
+
+int main() {
+    std::mt19937 rng(1);
+    bool isValid = checkSignedShift();
+    // The types used by the caches, see Cache::create()
+    isValid &= checkKernels<uint8_t>("uint8", rng);
+    isValid &= checkKernels<uint16_t>("uint16", rng);
+    isValid &= checkKernels<float>("float", rng);
+    std::cout << (isValid ? "All the kernels match the scalar conversion" : "Some kernels differ from the scalar conversion") << std::endl;
+    return isValid ? 0 : 1;
+}
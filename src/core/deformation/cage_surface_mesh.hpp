@@ -223,9 +223,9 @@ struct CageGreenLRI : CageGreen {
         B[2] = this->originalVertices[ch.pointsIdx[2]] - this->originalVertices[ch.pointsIdx[0]];
 
         std::vector<glm::vec3> Bp (3, glm::vec3(0.,0.,0.));
-        Bp[0] = *ch.points[3] - *ch.points[0];
-        Bp[1] = *ch.points[1] - *ch.points[0];
-        Bp[2] = *ch.points[2] - *ch.points[0];
+        Bp[0] = ch.points[3] - ch.points[0];
+        Bp[1] = ch.points[1] - ch.points[0];
+        Bp[2] = ch.points[2] - ch.points[0];
 
         std::vector<glm::vec3> invB(3, glm::vec3(0.,0.,0.));
 
@@ -249,9 +249,9 @@ struct CageGreenLRI : CageGreen {
     }
 
     void computeBasisTransforms() {
-        for(int tet = 0; tet < this->getMeshToDeform()->mesh.size(); ++tet) {
+        for(int tet = 0; tet < this->getMeshToDeform()->getNbTetrahedra(); ++tet) {
             std::vector<glm::vec3> basis_tr(3, glm::vec3(0.,0.,0.));
-            this->computeBasisTransform(this->getMeshToDeform()->mesh[tet], basis_tr);
+            this->computeBasisTransform(this->getMeshToDeform()->getTetra(tet), basis_tr);
             this->tetInfos[tet].basis_def = basis_tr;
         }
     }
@@ -290,11 +290,11 @@ struct CageGreenLRI : CageGreen {
             return;
         } else {
             this->tetInfos.clear();
-            this->tetInfos.resize(this->getMeshToDeform()->mesh.size(), CellInfo());
-            for(int i = 0; i < this->getMeshToDeform()->mesh.size(); ++i) {
+            this->tetInfos.resize(this->getMeshToDeform()->getNbTetrahedra(), CellInfo());
+            for(int i = 0; i < this->getMeshToDeform()->getNbTetrahedra(); ++i) {
                 this->tetInfos[i].cage_inlier = true;
                 for(int v = 0; v < 4; ++v) {
-                    if(this->outlier_vertices[this->getMeshToDeform()->mesh[i].pointsIdx[v]]) {
+                    if(this->outlier_vertices[this->getMeshToDeform()->getTetra(i).pointsIdx[v]]) {
                         this->tetInfos[i].cage_inlier = false;
                         break;
                     }
@@ -305,27 +305,27 @@ struct CageGreenLRI : CageGreen {
 
         /** TetMeshCreator initializeLRISolver  **/
         this->tetrahedra.clear();
-        this->tetrahedra.reserve(this->getMeshToDeform()->mesh.size());
+        this->tetrahedra.reserve(this->getMeshToDeform()->getNbTetrahedra());
         this->handle_tetrahedra.clear();
         this->unknown_tetrahedra.clear();
         this->orig_tetrahedra_index.clear();
 
-        for(int tet = 0; tet < this->getMeshToDeform()->mesh.size(); ++tet) {
+        for(int tet = 0; tet < this->getMeshToDeform()->getNbTetrahedra(); ++tet) {
             unsigned int index = tetrahedra.size();
             if(this->tetInfos[tet].cage_inlier) {
                 for(int i = 0; i < 4; ++i) {
-                    const int curNeighTet = this->getMeshToDeform()->mesh[tet].neighbors[i];
+                    const int curNeighTet = this->getMeshToDeform()->getTetra(tet).neighbors[i];
                     // Handle tetrahedra = tetra au bord mais avec tous les vertex dans la cage
                     if(curNeighTet != -1 && !this->tetInfos[curNeighTet].cage_inlier) {
                         this->handle_tetrahedra.push_back(index);
-                        this->tetrahedra.push_back(this->getMeshToDeform()->mesh[tet]);
+                        this->tetrahedra.push_back(this->getMeshToDeform()->getTetra(tet));
                         this->orig_tetrahedra_index.push_back(tet);
                         break;
                     }
                 }
             } else {
                 // unknown tetrahedra = tetra avec un vertex hors de la cage
-                this->tetrahedra.push_back(this->getMeshToDeform()->mesh[tet]);
+                this->tetrahedra.push_back(this->getMeshToDeform()->getTetra(tet));
                 this->unknown_tetrahedra.push_back(index);
                 this->orig_tetrahedra_index.push_back(tet);
             }
@@ -500,7 +500,7 @@ struct CageGreenLRI : CageGreen {
 
             for( int v = 0 ; v < 4 ; v ++ ){
                 const int& vh = ch.pointsIdx[v];
-                const glm::vec3& point = *ch.points[v];
+                const glm::vec3& point = this->getMeshToDeform()->getVertice(vh);
                 if( verts_mapping_from_mesh_to_solver[vh] == -1 )
                 {
                     verts_mapping_from_mesh_to_solver[vh] = verts_mapping_from_solver_to_mesh.size();
@@ -734,18 +734,16 @@ void DrawableGrid::sendTetmeshToGPU(const InfoToSend infoToSend) {
     //TetMesh& newMesh = *this->grids[gridIdx]->grid->tetmesh;
     TetMesh& newMesh = *this->grid;
 
-    if(contain(infoToSend, InfoToSend::NORMALS)) {
-        newMesh.computeNormals();
-    }
-    __GetTexSize(newMesh.mesh.size() * 4 * 3, &vertWidth, &vertHeight);
-    __GetTexSize(newMesh.mesh.size() * 4, &normWidth, &normHeight);
-    __GetTexSize(newMesh.mesh.size() * 4 * 3, &coorWidth, &coorHeight);
-    __GetTexSize(newMesh.mesh.size() * 4, &neighbWidth, &neighbHeight);
+    // The normals are updated by the TetMesh each time its points move
+    __GetTexSize(newMesh.getNbTetrahedra() * 4 * 3, &vertWidth, &vertHeight);
+    __GetTexSize(newMesh.getNbTetrahedra() * 4, &normWidth, &normHeight);
+    __GetTexSize(newMesh.getNbTetrahedra() * 4 * 3, &coorWidth, &coorHeight);
+    __GetTexSize(newMesh.getNbTetrahedra() * 4, &neighbWidth, &neighbHeight);
 
     DrawableGrid& grid = *this;
 
-    //this->grids[gridIdx]->volumetricMesh.tetrahedraCount = newMesh.mesh.size();
-    grid.tetrahedraCount = newMesh.mesh.size();
+    //this->grids[gridIdx]->volumetricMesh.tetrahedraCount = newMesh.getNbTetrahedra();
+    grid.tetrahedraCount = newMesh.getNbTetrahedra();
 
     GLfloat* rawVertices  = new GLfloat[vertWidth * vertHeight * 3];
     GLfloat* rawNormals	  = new GLfloat[normWidth * normHeight * 4];
@@ -755,9 +753,10 @@ void DrawableGrid::sendTetmeshToGPU(const InfoToSend infoToSend) {
     int iNeigh = 0;
     int iPt = 0;
     int iNormal = 0;
-    for (int idx = 0; idx < newMesh.mesh.size(); idx++) {
+    for (int idx = 0; idx < newMesh.getNbTetrahedra(); idx++) {
         int tetIdx = idx;
-        const Tetrahedron& tet = newMesh.mesh[tetIdx];
+        const Tetrahedron tet = newMesh.getTetra(tetIdx);
+        const glm::vec4 * normals = newMesh.getNormals(tetIdx);
         for(int faceIdx = 0; faceIdx < 4; ++faceIdx) {
 
             if(contain(infoToSend, InfoToSend::NEIGHBORS)) {
@@ -767,7 +766,7 @@ void DrawableGrid::sendTetmeshToGPU(const InfoToSend infoToSend) {
 
             if(contain(infoToSend, InfoToSend::NORMALS)) {
                 for (int i = 0; i < 4; ++i) {
-                    rawNormals[iNormal++] = tet.normals[faceIdx][i];
+                    rawNormals[iNormal++] = normals[faceIdx][i];
                     //rawNormals[iNormal++] = glm::normalize((newMesh.getModelMatrix() * tet.normals[faceIdx]))[i];
                     //rawNormals[iNormal++] = glm::vec4(1., 0., 0., 1.)[i];
                 }
@@ -1,10 +1,13 @@
 #include "grid.hpp"
+#include "tet_rasterizer.hpp"
 #include "glm/ext/quaternion_geometric.hpp"
 #include <chrono>
 #include <algorithm>
 #include <cmath>
+#include <numeric>
 #include <type_traits>
 #include <vector>
+#include <omp.h>
 
 #define USE_CACHE true
 
@@ -20,6 +23,14 @@ Image::ImageDataType Sampler::getInternalDataType() const {
     return this->image->getInternalDataType();
 }
 
+Image::ImageDataType Sampler::getStorageType() const {
+    return Cache::getStorageType(this->getInternalDataType());
+}
+
+int Sampler::getNbChannels() const {
+    return this->image->getNbChannels();
+}
+
 Grid::Grid(const std::vector<std::string>& filename, int subsample, const glm::vec3& sizeVoxel, const glm::vec3& nbCubeGridTransferMesh): sampler(Sampler(filename, subsample, sizeVoxel)), DrawableGrid(this) {
     this->buildTetmesh(nbCubeGridTransferMesh);
     this->history = new History(this->vertices, this->coordinate_system);
@@ -41,6 +52,7 @@ void Grid::buildTetmesh(const glm::vec3& nbCube) {
     this->buildGrid(nbCube, sizeCube, glm::vec3(0., 0., 0.));
     // Here this initial mesh is built directly using the sampler dimension because we want it to match the sampler
     this->initialMesh.buildGrid(nbCube, this->sampler.getDimension() / nbCube, glm::vec3(0., 0., 0.));
+    this->computeAffineMaps(this->initialMesh);
 }
 
 uint16_t Grid::getValueFromPoint(const glm::vec3& p, Interpolation::Method interpolationMethod) const {
@@ -91,6 +103,7 @@ glm::vec3 Grid::getVoxelSize() const {
 void Grid::loadMESH(std::string const &filename) {
     TetMesh::loadMESH(filename);
     this->initialMesh.loadMESH(filename);
+    this->computeAffineMaps(this->initialMesh);
     this->texCoord.clear();
     for(int i = 0; i < this->vertices.size(); ++i) {
         this->texCoord.push_back((this->vertices[i]/this->sampler.resolutionRatio)/this->sampler.getDimension());
@@ -141,48 +154,61 @@ void Grid::sampleSliceGridValues(const glm::vec3& slice, const std::pair<glm::ve
     result.clear();
     result.resize(imgSize[0] * imgSize[1], 0);
 
-    #pragma omp parallel for schedule(dynamic)
-    for(int tetIdx = 0; tetIdx < this->mesh.size(); ++tetIdx) {
-        const Tetrahedron& tet = this->mesh[tetIdx];
-        glm::vec3 bbMin = tet.getBBMin();
-        fromWorldToImage(bbMin);
-        bbMin.x = std::ceil(bbMin.x) - 1;
-        bbMin.y = std::ceil(bbMin.y) - 1;
-        bbMin.z = std::ceil(bbMin.z) - 1;
-        glm::vec3 bbMax = tet.getBBMax();
-        fromWorldToImage(bbMax);
-        bbMax.x = std::floor(bbMax.x) + 1;
-        bbMax.y = std::floor(bbMax.y) + 1;
-        bbMax.z = std::floor(bbMax.z) + 1;
-        if(slice.y == -1 && slice.z == -1) {
-            bbMin.z = slice.x;
-            bbMax.z = slice.x+1;
-        }
-        if(slice.x == -1 && slice.y == -1) {
-            bbMin.z = slice.z;
-            bbMax.z = slice.z+1;
+    // Pixels of the slice, each one belongs to a single tetrahedron, see TetRasterizer
+    glm::ivec3 latticeMin(0, 0, 0);
+    glm::ivec3 latticeMax(imgSize[0], imgSize[1], imgSize[2]);
+    if(slice.y == -1 && slice.z == -1) {
+        latticeMin.z = slice.x;
+        latticeMax.z = slice.x+1;
+    }
+    if(slice.x == -1 && slice.y == -1) {
+        latticeMin.z = slice.z;
+        latticeMax.z = slice.z+1;
+    }
+    if(slice.x == -1 && slice.z == -1) {
+        latticeMin.z = slice.y;
+        latticeMax.z = slice.y+1;
+    }
+
+    // The pixels of a tetrahedron are gathered then sampled in a single batch
+    std::vector<glm::vec3> coords;
+    std::vector<int> indices;
+    std::vector<uint16_t> values;
+    std::vector<float> scratch;
+    const Occupancy * occupancy = this->sampler.getOccupancy();
+    #pragma omp parallel for schedule(dynamic) private(coords, indices, values, scratch)
+    for(int tetIdx = 0; tetIdx < this->getNbTetrahedra(); ++tetIdx) {
+        coords.clear();
+        indices.clear();
+        // The pixels of a tetrahedron whose initial position only covers empty bricks stay 0, with a margin for the interpolation taps
+        if(occupancy) {
+            const Tetrahedron initialTet = this->initialMesh.getTetra(tetIdx);
+            if(occupancy->isEmpty(initialTet.getBBMin() - glm::vec3(2., 2., 2.), initialTet.getBBMax() + glm::vec3(2., 2., 2.)))
+                continue;
         }
-        if(slice.x == -1 && slice.z == -1) {
-            bbMin.z = slice.y;
-            bbMax.z = slice.y+1;
+        // The pixel (i, j) is sampled at its center, which is shifted by half a pixel in the lattice of the rasterizer
+        const Tetrahedron tet = this->getTetra(tetIdx);
+        glm::vec3 points[4];
+        for(int i = 0; i < 4; ++i) {
+            points[i] = tet.points[i];
+            fromWorldToImage(points[i]);
+            points[i] -= glm::vec3(.5, .5, .5);
         }
-        for(int k = bbMin.z; k < int(bbMax.z); ++k) {
-            for(int j = bbMin.y; j < int(bbMax.y); ++j) {
-                for(int i = bbMin.x; i < int(bbMax.x); ++i) {
-                    int insertIdx = i + j*imgSize[0];
-
-                    glm::vec3 p(i, j, k);
-                    p += glm::vec3(.5, .5, .5);
-                    fromImageToWorld(p);
-
-                    if(isInScene(p) && tet.isInTetrahedron(p)) {
-                        if(this->getCoordInInitial(this->initialMesh, p, p, tetIdx)) {
-                            result[insertIdx] = this->sampler.getValue(p, interpolationMethod);
-                        }
-                    }
+        TetRasterizer(points, tet.pointsIdx).rasterize(latticeMin, latticeMax, [&](int j, int k, int first, int last) {
+            for(int i = first; i <= last; ++i) {
+                glm::vec3 p(i, j, k);
+                p += glm::vec3(.5, .5, .5);
+                fromImageToWorld(p);
+                if(isInScene(p) && this->getCoordInInitial(this->initialMesh, p, p, tetIdx)) {
+                    coords.push_back(p);
+                    indices.push_back(i + j*imgSize[0]);
                 }
             }
-        }
+        });
+        values.resize(coords.size());
+        this->sampler.getValues(coords.data(), coords.size(), values.data(), scratch, interpolationMethod);
+        for(std::size_t i = 0; i < indices.size(); ++i)
+            result[indices[i]] = values[i];
     }
 
     auto end = std::chrono::steady_clock::now();
@@ -192,7 +218,7 @@ void Grid::sampleSliceGridValues(const glm::vec3& slice, const std::pair<glm::ve
 
 /**************************/
 
-Sampler::Sampler(const std::vector<std::string>& filename, int subsample, const glm::vec3& voxelSize): image(new ImageReader(filename)) {
+Sampler::Sampler(const std::vector<std::string>& filename, int subsample, const glm::vec3& voxelSize, int nbThreads, bool progressive): sliceCache(nullptr), image(new ImageReader(filename)), filenames(filename), nbThreads(nbThreads), downsamplingFilter(DOWNSAMPLING_FILTER), isCacheFilled(false), isCacheSparse(false) {
     glm::vec3 samplerResolution = this->image->imgResolution / static_cast<float>(subsample);
     this->resolutionRatio = this->image->imgResolution / samplerResolution;
     // If we naïvely divide the image dimensions for lowered its resolution we have problem is the case of a dimension is 1
@@ -210,12 +236,61 @@ Sampler::Sampler(const std::vector<std::string>& filename, int subsample, const
     this->bbMin = glm::vec3(0., 0., 0.);
     this->bbMax = samplerResolution;
 
+    // The statistics of a previous opening avoid to read the whole image when the cache doesn't need to be filled
+    const Statistics * cachedStatistics = this->image->metadata.findStatistics(this->resolutionRatio, static_cast<int>(this->downsamplingFilter));
+
     // Cache management
     this->useCache = USE_CACHE;
     if(this->useCache) {
-        this->cache = new Cache(this->getDimension());
-        this->fillCache();
+        // When the whole image is mapped in memory with the right type the cache directly use it
+        uint16_t * volume = (this->resolutionRatio == glm::vec3(1., 1., 1.)) ? this->image->getVolumeView() : nullptr;
+        if(this->image->imageFormat == ImageFormat::BRICK_VOLUME) {
+            // The bricks are paged in on demand, the image is never fully loaded in memory
+            this->cache = new PagedCache(this->image->brickVolumeReader, this->resolutionRatio);
+            this->statistics = cachedStatistics ? *cachedStatistics : this->cache->computeStatistics();
+        } else if(volume) {
+            std::cout << "Use the memory mapped image as cache" << std::endl;
+            this->cache = new TypedCache<uint16_t>(this->getDimension(), volume);
+            this->isCacheFilled = true;
+            this->statistics = cachedStatistics ? *cachedStatistics : this->cache->computeStatistics();
+        } else {
+            // The storage type is chosen once here, the values are then never converted to another type
+            this->cache = Cache::create(this->getDimension(), this->getInternalDataType(), this->getNbChannels(), CACHE_BRICK_SIZE);
+            const int previewStride = static_cast<int>(std::ceil(this->getDimension()[2] / static_cast<float>(PREVIEW_NB_SLICES)));
+            if(progressive && previewStride > 1) {
+                // The statistics of the preview are only used until the full resolution values are loaded
+                this->fillCachePreview(previewStride, this->statistics);
+                if(cachedStatistics)
+                    this->statistics = *cachedStatistics;
+                this->startLoading();
+            } else {
+                this->fillCache(this->statistics);
+            }
+            this->isCacheFilled = true;
+            // A progressive loading compresses the cache once it is over, see updateLoading()
+            if(!this->loadingTask)
+                this->compressCache();
+        }
+    } else {
+        // The slices are read on demand, only the most recently used ones are kept in memory
+        this->sliceCache = new SliceCache<std::vector<uint16_t>>();
+        if(cachedStatistics) {
+            this->statistics = *cachedStatistics;
+        } else if(this->getStorageType() == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+            this->readStatistics<float>();
+        } else {
+            this->readStatistics<uint16_t>();
+        }
     }
+    // The floating point values are displayed through their value range
+    this->updateValueMapping();
+    if(!cachedStatistics && !this->loadingTask) {
+        this->image->metadata.setStatistics(this->resolutionRatio, static_cast<int>(this->downsamplingFilter), this->statistics);
+        this->image->saveMetadata();
+    }
+    // 0 is the background of the images so it is excluded from the displayed range
+    this->image->minValue = this->statistics.getMinNonZeroValue();
+    this->image->maxValue = this->statistics.getMaxValue();
 
     bool useOriginalVoxelSize = true;
     if(voxelSize != glm::vec3(0., 0., 0.)) {
@@ -233,6 +308,8 @@ Sampler::Sampler(const std::vector<std::string>& filename, int subsample, const
         std::cout << " (original)" << std::endl; 
     else
         std::cout << " (manual)" << std::endl; 
+    std::cout << "Values: [" << this->statistics.minValue << ", " << this->statistics.maxValue << "] mean: " << this->statistics.getMean();
+    std::cout << " percentiles 1%/50%/99%: " << this->statistics.getPercentile(1.f) << "/" << this->statistics.getPercentile(50.f) << "/" << this->statistics.getPercentile(99.f) << std::endl;
 }
 
 glm::vec3 Sampler::getVoxelSize() const {
@@ -243,8 +320,54 @@ glm::vec3 Sampler::getDimension() const {
    return this->bbMax - this->bbMin;
 }
 
+namespace {
+    template<typename voxel_t, typename out_t>
+    void getCacheSlice(const Cache * cache, bool isSparse, int sliceIdx, std::vector<out_t>& result, int nbChannel) {
+        if(isSparse) {
+            static_cast<const SparseCache<voxel_t>*>(cache)->getSlice(sliceIdx, result, nbChannel);
+        } else {
+            static_cast<const TypedCache<voxel_t>*>(cache)->getSlice(sliceIdx, result, nbChannel);
+        }
+    }
+}
+
 // This function do not use Grid::getValue as we do not want to open, copy and cast a whole image slice per value
-void Sampler::getGridSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel) const {
+template<typename voxel_t>
+void Sampler::getGridSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx) const {
+    if(this->isCacheFilled) {
+        const Image::ImageDataType storageType = this->cache->getStorageType();
+        if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+            getCacheSlice<uint8_t>(this->cache, this->isCacheSparse, sliceIdx, result, nbChannel);
+        } else if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+            if constexpr (std::is_same<voxel_t, float>::value) {
+                getCacheSlice<float>(this->cache, this->isCacheSparse, sliceIdx, result, nbChannel);
+            } else {
+                std::vector<float> values;
+                getCacheSlice<float>(this->cache, this->isCacheSparse, sliceIdx, values, nbChannel);
+                this->valueMapping.apply(values, result);
+            }
+        } else {
+            getCacheSlice<uint16_t>(this->cache, this->isCacheSparse, sliceIdx, result, nbChannel);
+        }
+    } else if constexpr (std::is_same<voxel_t, uint16_t>::value) {
+        if(nbChannel == 1 && this->sliceCache) {
+            const auto slice = this->getCachedSlice(sliceIdx);
+            result.insert(result.end(), slice->begin(), slice->end());
+        } else {
+            this->readMappedSlice(sliceIdx, result, nbChannel, threadIdx);
+        }
+    } else {
+        this->readMappedSlice(sliceIdx, result, nbChannel, threadIdx);
+    }
+}
+
+template void Sampler::getGridSlice<uint8_t>(int, std::vector<uint8_t>&, int, int) const;
+template void Sampler::getGridSlice<uint16_t>(int, std::vector<uint16_t>&, int, int) const;
+template void Sampler::getGridSlice<float>(int, std::vector<float>&, int, int) const;
+
+// Strided read of the image, the skipped voxels are not filtered
+template<typename voxel_t>
+void Sampler::readGridSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx) const {
     if(!this->image) {
         std::cerr << "[4001] ERROR: Try to [getGridSlice()] on a grid without attached image" << std::endl;
     }
@@ -272,30 +395,377 @@ void Sampler::getGridSlice(int sliceIdx, std::vector<std::uint16_t>& result, int
             throw std::runtime_error("Error in getGridSlice: bboxes not aligned with resolution ratio !");
     }
 
-    this->image->getSlice(sliceIdx, result, nbChannel, XYoffsets, bboxes);
+    this->image->getSlice(sliceIdx, result, nbChannel, XYoffsets, bboxes, threadIdx);
 }
 
-void Sampler::fillCache() {
+template<typename voxel_t>
+void Sampler::readMappedSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx) const {
+    if constexpr (!std::is_same<voxel_t, float>::value) {
+        if(this->getStorageType() == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+            std::vector<float> values;
+            this->readGridSlice(sliceIdx, values, nbChannel, threadIdx);
+            this->valueMapping.apply(values, result);
+            return;
+        }
+    }
+    this->readGridSlice(sliceIdx, result, nbChannel, threadIdx);
+}
+
+bool Sampler::updateValueMapping() {
+    if(this->getStorageType() != (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32))
+        return false;
+    const ValueMapping mapping = ValueMapping::fromRange(this->statistics.minValue, this->statistics.maxValue);
+    // The statistics read from the metadata cache are already binned with it
+    if(!(this->statistics.mapping == mapping)) {
+        if(this->useCache)
+            this->statistics = this->cache->computeStatistics(mapping);
+        else
+            this->readStatistics<float>(mapping);
+    }
+    const bool isChanged = !(this->valueMapping == mapping);
+    this->valueMapping = mapping;
+    return isChanged;
+}
+
+void Sampler::fillCache(Statistics& statistics) {
     if(!this->image) {
         std::cerr << "[4001] ERROR: Try to [fillCache()] on a grid without attached image" << std::endl;
     }
-    std::vector<uint16_t> slice;
-    std::cout << "Filling the cache" << std::endl;
-    for(int z = 0; z < this->getDimension()[2]; ++z) {
-        slice.clear();
-        this->getGridSlice(z, slice, 1);
-        this->cache->storeImage(z, slice);
+    const Image::ImageDataType storageType = this->cache->getStorageType();
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+        this->fillCache(static_cast<TypedCache<uint8_t>*>(this->cache), statistics);
+    } else if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+        this->fillCache(static_cast<TypedCache<float>*>(this->cache), statistics);
+    } else {
+        this->fillCache(static_cast<TypedCache<uint16_t>*>(this->cache), statistics);
+    }
+}
+
+template<typename voxel_t>
+void Sampler::fillCache(TypedCache<voxel_t> * cache, Statistics& statistics) {
+    if(this->resolutionRatio != glm::vec3(1., 1., 1.)) {
+        this->fillCacheDownsampled(cache, statistics);
+        return;
+    }
+    const int nbSlices = this->getDimension()[2];
+    int nbThreads = (this->nbThreads > 0) ? this->nbThreads : omp_get_max_threads();
+    nbThreads = std::max(1, std::min(nbThreads, nbSlices));
+    std::cout << "Filling the cache using [" << nbThreads << "] threads" << std::endl;
+
+    // Each thread reads its own range of slices with its own file handle
+    // and accumulates the statistics of its slices, they are merged at the end
+    this->image->setNbThreads(nbThreads);
+    statistics = Statistics();
+    #pragma omp parallel num_threads(nbThreads)
+    {
+        const int threadIdx = omp_get_thread_num();
+        std::vector<voxel_t> slice;
+        slice.reserve(this->getDimension()[0] * this->getDimension()[1] * this->getNbChannels());
+        Statistics localStatistics;
+        #pragma omp for schedule(static)
+        for(int z = 0; z < nbSlices; ++z) {
+            if(this->isLoadingCancelled())
+                continue;
+            slice.clear();
+            this->readGridSlice(z, slice, this->getNbChannels(), threadIdx);
+            localStatistics.add(slice);
+            this->storeSlice(cache, z, slice);
+        }
+        #pragma omp critical
+        statistics.merge(localStatistics);
+    }
+    // Release the extra file handles
+    this->image->setNbThreads(1);
+}
+
+template<typename voxel_t>
+void Sampler::fillCacheDownsampled(TypedCache<voxel_t> * cache, Statistics& statistics) {
+    const glm::ivec3 dimension = this->getDimension();
+    glm::ivec3 factor = this->resolutionRatio;
+
+    // A level already downsampled on disk avoids to read the full resolution image
+    int levelFactor = 1;
+    ImageReader * level = Pyramid::openLevel(this->filenames[0], this->image->imgResolution, factor, levelFactor);
+    ImageReader * source = this->image;
+    // The levels are written with a single channel
+    if(level && level->getNbChannels() != this->getNbChannels()) {
+        delete level;
+        level = nullptr;
+    }
+    if(level) {
+        source = level;
+        factor /= levelFactor;
+    }
+    std::cout << "Downsample the image by " << factor << " using the [" << Pyramid::toString(this->downsamplingFilter) << "] filter" << std::endl;
+
+    // The downsampled image can be one voxel larger than the sampler as the sampler resolution is rounded down twice
+    const int nbChannels = this->getNbChannels();
+    std::vector<voxel_t> croppedSlice;
+    statistics = Statistics();
+    Pyramid::Downsampler<voxel_t> downsampler(source->imgResolution, factor, this->downsamplingFilter, [&](int sliceIdx, const std::vector<voxel_t>& slice) {
+        if(sliceIdx >= dimension.z)
+            return;
+        const glm::ivec3& resolution = downsampler.resolution;
+        if(resolution.x == dimension.x && resolution.y == dimension.y) {
+            statistics.add(slice);
+            this->storeSlice(cache, sliceIdx, slice);
+        } else {
+            croppedSlice.clear();
+            for(int j = 0; j < dimension.y; ++j)
+                croppedSlice.insert(croppedSlice.end(), slice.begin() + static_cast<std::size_t>(j) * resolution.x * nbChannels, slice.begin() + (static_cast<std::size_t>(j) * resolution.x + dimension.x) * nbChannels);
+            statistics.add(croppedSlice);
+            this->storeSlice(cache, sliceIdx, croppedSlice);
+        }
+    }, nbChannels);
+    Pyramid::streamImage(*source, downsampler, (this->nbThreads > 0) ? this->nbThreads : omp_get_max_threads(), [this]() { return this->isLoadingCancelled(); });
+    delete level;
+}
+
+void Sampler::fillCachePreview(int stride, Statistics& statistics) {
+    const Image::ImageDataType storageType = this->cache->getStorageType();
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+        this->fillCachePreview(static_cast<TypedCache<uint8_t>*>(this->cache), stride, statistics);
+    } else if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+        this->fillCachePreview(static_cast<TypedCache<float>*>(this->cache), stride, statistics);
+    } else {
+        this->fillCachePreview(static_cast<TypedCache<uint16_t>*>(this->cache), stride, statistics);
+    }
+}
+
+template<typename voxel_t>
+void Sampler::fillCachePreview(TypedCache<voxel_t> * cache, int stride, Statistics& statistics) {
+    const glm::ivec3 dimension = this->getDimension();
+    const int nbChannels = this->getNbChannels();
+    const int nbPreviewSlices = (dimension.z + stride - 1) / stride;
+    const int previewWidth = (dimension.x + stride - 1) / stride;
+    int nbThreads = (this->nbThreads > 0) ? this->nbThreads : omp_get_max_threads();
+    nbThreads = std::max(1, std::min(nbThreads, nbPreviewSlices));
+    std::cout << "Load a preview of the image using one voxel every [" << stride << "] voxels" << std::endl;
+
+    std::pair<glm::vec3, glm::vec3> bboxes{this->bbMin, this->bbMax};
+    this->fromSamplerToImage(bboxes.first);
+    this->fromSamplerToImage(bboxes.second);
+    const std::pair<int, int> offsets{static_cast<int>(this->resolutionRatio[0]) * stride, static_cast<int>(this->resolutionRatio[1]) * stride};
+
+    this->image->setNbThreads(nbThreads);
+    statistics = Statistics();
+    #pragma omp parallel num_threads(nbThreads)
+    {
+        const int threadIdx = omp_get_thread_num();
+        std::vector<voxel_t> previewSlice;
+        std::vector<voxel_t> slice(static_cast<std::size_t>(dimension.x) * dimension.y * nbChannels);
+        Statistics localStatistics;
+        #pragma omp for schedule(static)
+        for(int k = 0; k < nbPreviewSlices; ++k) {
+            previewSlice.clear();
+            this->image->getSlice(k * stride * static_cast<int>(this->resolutionRatio[2]), previewSlice, nbChannels, offsets, bboxes, threadIdx);
+            localStatistics.add(previewSlice);
+            // Nearest neighbor upsampling
+            for(int y = 0; y < dimension.y; ++y) {
+                const voxel_t * previewRow = previewSlice.data() + static_cast<std::size_t>(y / stride) * previewWidth * nbChannels;
+                voxel_t * row = slice.data() + static_cast<std::size_t>(y) * dimension.x * nbChannels;
+                for(int x = 0; x < dimension.x; ++x)
+                    std::copy(previewRow + (x / stride) * nbChannels, previewRow + (x / stride + 1) * nbChannels, row + x * nbChannels);
+            }
+            for(int z = k * stride; z < std::min((k + 1) * stride, dimension.z); ++z)
+                cache->storeImage(z, slice);
+        }
+        #pragma omp critical
+        statistics.merge(localStatistics);
+    }
+    this->image->setNbThreads(1);
+}
+
+void Sampler::compressCache() {
+    if(!SPARSE_CACHE || !this->isCacheFilled || this->isCacheSparse)
+        return;
+    Cache * compressedCache = ::compressCache(this->cache, SPARSE_CACHE_BRICK_SIZE, SPARSE_CACHE_MIN_SAVING);
+    this->isCacheSparse = (compressedCache != this->cache);
+    this->cache = compressedCache;
+}
+
+const Occupancy * Sampler::getOccupancy() const {
+    if(!this->isCacheSparse)
+        return nullptr;
+    const Image::ImageDataType storageType = this->cache->getStorageType();
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8))
+        return &static_cast<const SparseCache<uint8_t>*>(this->cache)->occupancy;
+    if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32))
+        return &static_cast<const SparseCache<float>*>(this->cache)->occupancy;
+    return &static_cast<const SparseCache<uint16_t>*>(this->cache)->occupancy;
+}
+
+void Sampler::startLoading() {
+    this->loadingTask = std::make_shared<Image::ThreadedTask>(this->getDimension()[2]);
+    this->loadingTask->setState(Image::TaskState::Running);
+    this->loadingThread = std::thread([this]() {
+        Statistics statistics;
+        this->fillCache(statistics);
+        {
+            std::lock_guard<std::mutex> lock(this->loadingMutex);
+            this->loadedStatistics = statistics;
+        }
+        // The task ignores the calls which can't lock it in time, and it may have been cancelled meanwhile
+        while(this->loadingTask->getState() < Image::TaskState::End_Success)
+            this->loadingTask->end(true);
+    });
+}
+
+bool Sampler::isLoading() const {
+    return this->loadingTask != nullptr;
+}
+
+bool Sampler::isLoadingCancelled() const {
+    return this->loadingTask && this->loadingTask->getState() == Image::TaskState::End_Failure;
+}
+
+template<typename voxel_t>
+void Sampler::storeSlice(TypedCache<voxel_t> * cache, int sliceIdx, const std::vector<voxel_t>& slice) {
+    if(!this->loadingTask) {
+        cache->storeImage(sliceIdx, slice);
+        return;
+    }
+    // The cache is sampled meanwhile by the thread using the sampler, which stores the slice in updateLoading()
+    const unsigned char * values = reinterpret_cast<const unsigned char*>(slice.data());
+    std::vector<unsigned char> pendingSlice(values, values + slice.size() * sizeof(voxel_t));
+    std::lock_guard<std::mutex> lock(this->loadingMutex);
+    this->pendingSlices.emplace_back(sliceIdx, std::move(pendingSlice));
+    this->loadingTask->advance();
+}
+
+void Sampler::storePendingSlices() {
+    std::vector<std::pair<int, std::vector<unsigned char>>> slices;
+    {
+        std::lock_guard<std::mutex> lock(this->loadingMutex);
+        slices.swap(this->pendingSlices);
+    }
+    const Image::ImageDataType storageType = this->cache->getStorageType();
+    for(const std::pair<int, std::vector<unsigned char>>& slice : slices) {
+        if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8))
+            static_cast<TypedCache<uint8_t>*>(this->cache)->storeImage(slice.first, reinterpret_cast<const uint8_t*>(slice.second.data()));
+        else if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32))
+            static_cast<TypedCache<float>*>(this->cache)->storeImage(slice.first, reinterpret_cast<const float*>(slice.second.data()));
+        else
+            static_cast<TypedCache<uint16_t>*>(this->cache)->storeImage(slice.first, reinterpret_cast<const uint16_t*>(slice.second.data()));
+        this->loadedSlices.push_back(slice.first);
     }
 }
 
+bool Sampler::updateLoading(std::vector<int>& loadedSlices) {
+    loadedSlices.clear();
+    if(!this->loadingTask)
+        return false;
+    // Once the task is complete the thread is over, waitLoading() then stores all the remaining slices
+    const bool isComplete = this->loadingTask->getState() >= Image::TaskState::End_Success;
+    if(isComplete)
+        this->waitLoading();
+    else
+        this->storePendingSlices();
+    loadedSlices.swap(this->loadedSlices);
+    if(!isComplete)
+        return false;
+
+    if(this->loadingTask->getState() == Image::TaskState::End_Success) {
+        std::cout << "Image fully loaded" << std::endl;
+        if(!this->image->metadata.findStatistics(this->resolutionRatio, static_cast<int>(this->downsamplingFilter))) {
+            this->statistics = this->loadedStatistics;
+            // The preview values were mapped from the preview range, all the slices are then mapped again
+            if(this->updateValueMapping()) {
+                loadedSlices.resize(this->getDimension()[2]);
+                std::iota(loadedSlices.begin(), loadedSlices.end(), 0);
+            }
+            this->image->metadata.setStatistics(this->resolutionRatio, static_cast<int>(this->downsamplingFilter), this->statistics);
+            this->image->saveMetadata();
+            this->image->minValue = this->statistics.getMinNonZeroValue();
+            this->image->maxValue = this->statistics.getMaxValue();
+        }
+        // The loading thread is over, so the cache can be replaced
+        this->compressCache();
+    }
+    this->loadingTask = nullptr;
+    return true;
+}
+
+void Sampler::waitLoading() {
+    if(this->loadingThread.joinable())
+        this->loadingThread.join();
+    if(this->loadingTask)
+        this->storePendingSlices();
+}
+
+void Sampler::cancelLoading() {
+    if(!this->loadingTask)
+        return;
+    while(this->loadingTask->getState() < Image::TaskState::End_Success)
+        this->loadingTask->end(false);
+    this->waitLoading();
+}
+
+Sampler::~Sampler() {
+    this->cancelLoading();
+    delete this->sliceCache;
+}
+
+template<typename voxel_t>
+void Sampler::readStatistics(const ValueMapping& mapping) {
+    const int nbSlices = this->getDimension()[2];
+    int nbThreads = (this->nbThreads > 0) ? this->nbThreads : omp_get_max_threads();
+    nbThreads = std::max(1, std::min(nbThreads, nbSlices));
+
+    this->image->setNbThreads(nbThreads);
+    this->statistics = Statistics(mapping);
+    #pragma omp parallel num_threads(nbThreads)
+    {
+        const int threadIdx = omp_get_thread_num();
+        std::vector<voxel_t> slice;
+        Statistics localStatistics(mapping);
+        #pragma omp for schedule(static)
+        for(int z = 0; z < nbSlices; ++z) {
+            slice.clear();
+            this->readGridSlice(z, slice, 1, threadIdx);
+            localStatistics.add(slice);
+        }
+        #pragma omp critical
+        this->statistics.merge(localStatistics);
+    }
+    this->image->setNbThreads(1);
+}
+
 uint16_t Sampler::getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) const {
     if(this->useCache) {
-        return this->cache->getValue(coord, interpolationMethod);
+        return this->valueMapping.apply<uint16_t>(this->cache->getValue(coord, interpolationMethod));
+    } else {
+        // Nearest neighbor in the slice read at the sampler resolution
+        const glm::ivec3 dimension = this->getDimension();
+        glm::ivec3 p;
+        for(int i = 0; i < 3; ++i)
+            p[i] = std::min(std::max(static_cast<int>(std::floor(coord[i])), 0), dimension[i] - 1);
+        return (*this->getCachedSlice(p.z))[static_cast<std::size_t>(p.y) * dimension.x + p.x];
+    }
+}
+
+void Sampler::getValues(const glm::vec3 * coords, std::size_t nbValues, uint16_t * result, std::vector<float>& scratch, Interpolation::Method interpolationMethod) const {
+    if(this->useCache) {
+        // resize() only allocates when the batch is larger than all the previous ones
+        scratch.resize(nbValues);
+        this->cache->getValues(coords, nbValues, scratch.data(), interpolationMethod);
+        for(std::size_t i = 0; i < nbValues; ++i)
+            result[i] = this->valueMapping.apply<uint16_t>(scratch[i]);
     } else {
-        return this->image->getValue(coord * this->resolutionRatio);
+        for(std::size_t i = 0; i < nbValues; ++i)
+            result[i] = this->getValue(coords[i], interpolationMethod);
     }
 }
 
+SliceCache<std::vector<uint16_t>>::Entry Sampler::getCachedSlice(int sliceIdx) const {
+    return this->sliceCache->getOrLoad(sliceIdx, [this, sliceIdx]() {
+        std::lock_guard<std::mutex> lock(this->sliceReadMutex);
+        std::vector<uint16_t> slice;
+        this->readMappedSlice(sliceIdx, slice, 1, 0);
+        return slice;
+    });
+}
+
 void Sampler::fromSamplerToImage(glm::vec3& p) const {
     p = p * this->resolutionRatio;
 }
@@ -305,20 +775,5 @@ void Sampler::fromImageToSampler(glm::vec3& p) const {
 }
 
 std::vector<int> Sampler::getHistogram() const {
-   if(useCache)  {
-       uint16_t minValue = this->image->minValue;
-       uint16_t maxValue = this->image->maxValue;
-       const CImg img = this->cache->img.get_histogram((maxValue - minValue)+1, minValue, maxValue);
-       std::vector<int> result;
-       for(int i = 0; i < minValue; ++i) {
-           result.push_back(0);
-       }
-       for(auto value : img) {
-           result.push_back(value);
-       }
-       return result;
-   } else {
-       return std::vector<int>{0};
-   }
+   return this->statistics.getHistogram(this->image->minValue, this->image->maxValue);
 }
-
@@ -4,10 +4,38 @@
 #include "../drawable/drawable_grid.hpp"
 #include "tetrahedral_mesh.hpp"
 #include "../images/image.hpp"
+#include "../images/pyramid.hpp"
+#include "../images/slice_cache.hpp"
+#include "../images/sparse_cache.hpp"
+#include "../../legacy/image/utils/include/threaded_task.hpp"
+#include <mutex>
+#include <thread>
 
 //! \addtogroup geometry
 //! @{
 
+//! @brief Default number of threads used to load an image, 0 to use all the available cores.
+#define NB_LOADING_THREADS 0
+
+//! @brief Filter used to downsample the image when it is opened with a subsample factor, see Pyramid.
+#define DOWNSAMPLING_FILTER Pyramid::Filter::Box
+
+//! @brief Size of the bricks of the cache filled by the sampler, 0 to store it x fastest, see TypedCache.
+//! Bricks make the sampling along the y and z axis, along oblique planes and along rays about twice faster, see benchmarkCacheLayouts().
+#define CACHE_BRICK_SIZE 16
+
+//! @brief Compress the cache into a SparseCache once the image is loaded, if it saves at least SPARSE_CACHE_MIN_SAVING of the memory.
+//! The mostly empty volumes and the segmentation atlases then only use a fraction of their size, and the empty bricks are skipped when sampling.
+#define SPARSE_CACHE true
+#define SPARSE_CACHE_MIN_SAVING .25f
+#define SPARSE_CACHE_BRICK_SIZE 16
+
+//! @brief Open the images progressively: a strided preview is loaded at once, the full resolution slices are then read in background.
+#define PROGRESSIVE_LOADING true
+
+//! @brief Maximum number of slices read to build the preview of a progressive loading.
+#define PREVIEW_NB_SLICES 32
+
 //! @brief Store an image from ImageReader into a Cache and allow to access its data using various resolutions using resolutionRaio.
 //! \todo This class was used in previous versions, but currently it doesn't make much sense since the Grid has a voxelSize. To remove.
 struct Sampler {
@@ -22,11 +50,53 @@ public:
 
     bool useCache;
     Cache * cache;
+    //! @brief Slices at the sampler resolution read when useCache is false, only the recently used ones are kept.
+    SliceCache<std::vector<uint16_t>> * sliceCache;
     ImageReader * image;
+    std::vector<std::string> filenames;
+
+    //! @brief Number of threads used to fill the cache, 0 to use all the available cores.
+    int nbThreads;
+
+    //! @brief With a subsample factor the image is filtered by this filter before being stored in the cache.
+    Pyramid::Filter downsamplingFilter;
+
+    //! @brief Statistics of the values at the sampler resolution, accumulated while the cache is filled.
+    //! The value range of image is set from them, the UI has to use them instead of reading the volume again.
+    Statistics statistics;
+
+    //! @brief Map from the stored values to the uint16 values returned by getValue(), getValues() and getGridSlice(),
+    //! the identity except for the floating point images, see ValueMapping::fromRange().
+    ValueMapping valueMapping;
+
+    //! @brief Progress of the background loading of a progressive opening, nullptr when the image is fully loaded.
+    //! Ending it with a failure cancels the loading, see cancelLoading().
+    Image::ThreadedTask::Ptr loadingTask;
 
-    Sampler(const std::vector<std::string>& filename, int subsample, const glm::vec3& voxelSize);
+    //! @param progressive When the cache has to be filled, fill it with a strided preview and read the full resolution slices in background.
+    //! The image is then only read by the loading thread until isLoading() is false, see waitLoading().
+    Sampler(const std::vector<std::string>& filename, int subsample, const glm::vec3& voxelSize, int nbThreads = NB_LOADING_THREADS, bool progressive = PROGRESSIVE_LOADING);
+    ~Sampler();
+
+    bool isLoading() const;
+
+    //! @brief Has to be called regularly by the thread using the sampler while isLoading().
+    //! The slices read by the loading thread are stored in the cache here, so the cache is only modified by the thread sampling it.
+    //! @param loadedSlices Slices stored in the cache at full resolution since the previous call.
+    //! @return true when the loading ended during this call, the statistics are then the ones of the full resolution values.
+    bool updateLoading(std::vector<int>& loadedSlices);
+
+    //! @brief Block until the background loading is over, for the operations reading the image directly.
+    //! The slices read meanwhile are then stored in the cache.
+    void waitLoading();
+
+    //! @brief Stop the background loading, the slices which were not loaded keep their preview values.
+    void cancelLoading();
 
     uint16_t getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod = Interpolation::Method::NearestNeighbor) const;
+    //! @brief Sample nbValues coordinates at once, see Cache::getValues().
+    //! @param scratch Buffer of the values before their mapping, kept by the caller between the batches to avoid an allocation per batch.
+    void getValues(const glm::vec3 * coords, std::size_t nbValues, uint16_t * result, std::vector<float>& scratch, Interpolation::Method interpolationMethod = Interpolation::Method::NearestNeighbor) const;
     template<typename DataType>
     DataType getValue(const glm::vec3& coord) const {
         return this->image->getValue<DataType>(coord * this->resolutionRatio);
@@ -37,12 +107,70 @@ public:
     void fromSamplerToImage(glm::vec3& p) const;
     void fromImageToSampler(glm::vec3& p) const;
 
-    void getGridSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel) const;
+    //! @brief Once the whole image is in the cache the slice is copied from it, otherwise it is read from the image.
+    //! Instantiated for uint8_t, uint16_t and float, the types used by Cache. The values are mapped by valueMapping, except into float.
+    template<typename voxel_t>
+    void getGridSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx = 0) const;
     glm::vec3 getVoxelSize() const;
+    //! @brief Bricks of the cache holding non-zero values, nullptr if the cache is not a SparseCache.
+    const Occupancy * getOccupancy() const;
     Image::ImageDataType getInternalDataType() const;
+    //! @brief Type of the values stored in the cache, see Cache::getStorageType().
+    Image::ImageDataType getStorageType() const;
+    //! @brief Number of channels of the image, which are interleaved in the slices returned by getGridSlice().
+    int getNbChannels() const;
     std::vector<int> getHistogram() const;
 private:
-    void fillCache();
+    //! @brief True when the cache is a TypedCache or a SparseCache storing the whole image at the sampler resolution.
+    bool isCacheFilled;
+    bool isCacheSparse;
+
+    std::thread loadingThread;
+    //! @brief Protect pendingSlices and loadedStatistics, which are written by the loading thread.
+    std::mutex loadingMutex;
+    //! @brief Values of the slices read by the loading thread, in the storage type of the cache, not yet stored in it.
+    std::vector<std::pair<int, std::vector<unsigned char>>> pendingSlices;
+    Statistics loadedStatistics;
+    //! @brief Slices stored in the cache since the previous call to updateLoading().
+    std::vector<int> loadedSlices;
+
+    //! @brief Serialize the reads of the slices stored in sliceCache, which all use the reader of the thread 0.
+    mutable std::mutex sliceReadMutex;
+    SliceCache<std::vector<uint16_t>>::Entry getCachedSlice(int sliceIdx) const;
+
+    template<typename voxel_t>
+    void readGridSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx) const;
+    //! @brief readGridSlice() mapping the floating point values by valueMapping.
+    template<typename voxel_t>
+    void readMappedSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel, int threadIdx) const;
+    //! @brief Set valueMapping from the value range of statistics, and bin the histogram again with it if it was not.
+    //! @return true if valueMapping changed.
+    bool updateValueMapping();
+    //! @brief Fill the cache at full resolution, accumulating the statistics of the values.
+    void fillCache(Statistics& statistics);
+    template<typename voxel_t>
+    void fillCache(TypedCache<voxel_t> * cache, Statistics& statistics);
+    template<typename voxel_t>
+    void fillCacheDownsampled(TypedCache<voxel_t> * cache, Statistics& statistics);
+    //! @brief Fill the cache with one voxel every stride voxels along each axis, each one repeated over its stride^3 block.
+    void fillCachePreview(int stride, Statistics& statistics);
+    template<typename voxel_t>
+    void fillCachePreview(TypedCache<voxel_t> * cache, int stride, Statistics& statistics);
+    //! @brief Replace the filled cache by a SparseCache when it saves enough memory, see SPARSE_CACHE.
+    //! Has to be called once the image is fully loaded, as a SparseCache can't be modified.
+    void compressCache();
+    //! @brief Fill the cache in a background thread, see updateLoading().
+    void startLoading();
+    bool isLoadingCancelled() const;
+    //! @brief Called by the threads filling the cache for each slice. The slice is stored at once,
+    //! or during a background loading kept in pendingSlices until the thread using the sampler stores it.
+    template<typename voxel_t>
+    void storeSlice(TypedCache<voxel_t> * cache, int sliceIdx, const std::vector<voxel_t>& slice);
+    //! @brief Store pendingSlices in the cache, only called by the thread using the sampler.
+    void storePendingSlices();
+    //! @brief Compute the statistics by reading the image when there is no cache to fill.
+    template<typename voxel_t>
+    void readStatistics(const ValueMapping& mapping = ValueMapping());
 };
 
 //! @brief A 3D image deformed by a TetMesh and displayed by a DrawableGrid.
@@ -104,12 +232,21 @@ struct Grid : public TetMesh, public DrawableGrid {
         return this->sampler.getDimension()[2];
     }
     
-    void getGridSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel) const {
+    Image::ImageDataType getStorageType() const {
+        return this->sampler.getStorageType();
+    }
+
+    int getNbChannels() const {
+        return this->sampler.getNbChannels();
+    }
+
+    template<typename voxel_t>
+    void getGridSlice(int sliceIdx, std::vector<voxel_t>& result, int nbChannel) const {
         this->sampler.getGridSlice(sliceIdx, result, nbChannel);
     }
 
     void movePoints(const std::vector<int>& origins, const std::vector<glm::vec3>& targets) override {
-        BaseMesh::movePoints(origins, targets);
+        TetMesh::movePoints(origins, targets);
         DrawableGrid::sendTetmeshToGPU(Grid::InfoToSend(Grid::InfoToSend::VERTICES | Grid::InfoToSend::NORMALS));
     }
 };
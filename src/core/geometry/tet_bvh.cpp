@@ -0,0 +1,149 @@
+#include "tet_bvh.hpp"
+#include "tetrahedral_mesh.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+bool TetBVH::isBuilt(std::size_t nbTetrahedra) const {
+    return nbTetrahedra > 0 && this->tetLeaves.size() == nbTetrahedra;
+}
+
+void TetBVH::build(const TetMesh& tetMesh) {
+    const int nbTetrahedra = tetMesh.getNbTetrahedra();
+    this->nodes.clear();
+    this->tetIndices.resize(nbTetrahedra);
+    std::iota(this->tetIndices.begin(), this->tetIndices.end(), 0);
+    this->tetLeaves.assign(nbTetrahedra, -1);
+    if(nbTetrahedra == 0)
+        return;
+
+    std::vector<glm::vec3> centroids(nbTetrahedra);
+    #pragma omp parallel for schedule(static)
+    for(int tetIdx = 0; tetIdx < nbTetrahedra; ++tetIdx)
+        tetMesh.getTetra(tetIdx).getCentroid(centroids[tetIdx]);
+
+    // A binary tree with at least one tetrahedron per leaf has less than 2 * nbTetrahedra nodes
+    this->nodes.resize(2 * nbTetrahedra - 1);
+    std::atomic<int> nbNodes(1);
+    #pragma omp parallel
+    #pragma omp single
+    this->buildNode(0, 0, nbTetrahedra, centroids, nbNodes);
+    this->nodes.resize(nbNodes);
+    this->refit(tetMesh);
+}
+
+void TetBVH::buildNode(int nodeIdx, int first, int last, const std::vector<glm::vec3>& centroids, std::atomic<int>& nbNodes) {
+    if(last - first <= BVH_LEAF_SIZE) {
+        this->nodes[nodeIdx].first = first;
+        this->nodes[nodeIdx].count = last - first;
+        for(int i = first; i < last; ++i)
+            this->tetLeaves[this->tetIndices[i]] = nodeIdx;
+        return;
+    }
+
+    glm::vec3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX);
+    glm::vec3 centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(int i = first; i < last; ++i) {
+        centroidMin = glm::min(centroidMin, centroids[this->tetIndices[i]]);
+        centroidMax = glm::max(centroidMax, centroids[this->tetIndices[i]]);
+    }
+    const glm::vec3 extent = centroidMax - centroidMin;
+    const int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : ((extent.y > extent.z) ? 1 : 2);
+    const int middle = first + (last - first) / 2;
+    std::nth_element(this->tetIndices.begin() + first, this->tetIndices.begin() + middle, this->tetIndices.begin() + last, [&](int a, int b) {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+
+    // The children are allocated after their parent, which allows refit() to update the nodes in reverse order
+    const int childIdx = nbNodes.fetch_add(2);
+    this->nodes[nodeIdx].first = childIdx;
+    this->nodes[nodeIdx].count = 0;
+    this->nodes[childIdx].parent = nodeIdx;
+    this->nodes[childIdx + 1].parent = nodeIdx;
+    if(last - first > BVH_TASK_SIZE) {
+        #pragma omp task shared(centroids, nbNodes)
+        this->buildNode(childIdx, first, middle, centroids, nbNodes);
+        #pragma omp task shared(centroids, nbNodes)
+        this->buildNode(childIdx + 1, middle, last, centroids, nbNodes);
+    } else {
+        this->buildNode(childIdx, first, middle, centroids, nbNodes);
+        this->buildNode(childIdx + 1, middle, last, centroids, nbNodes);
+    }
+}
+
+void TetBVH::fitLeaf(int nodeIdx, const TetMesh& tetMesh) {
+    Node& node = this->nodes[nodeIdx];
+    node.bbMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    node.bbMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    const std::vector<glm::vec3>& vertices = tetMesh.getVertices();
+    for(int i = node.first; i < node.first + node.count; ++i) {
+        const glm::ivec4& tet = tetMesh.getPointsIdx(this->tetIndices[i]);
+        for(int j = 0; j < 4; ++j) {
+            node.bbMin = glm::min(node.bbMin, vertices[tet[j]]);
+            node.bbMax = glm::max(node.bbMax, vertices[tet[j]]);
+        }
+    }
+}
+
+void TetBVH::fitInner(int nodeIdx) {
+    Node& node = this->nodes[nodeIdx];
+    const Node& left = this->nodes[node.first];
+    const Node& right = this->nodes[node.first + 1];
+    node.bbMin = glm::min(left.bbMin, right.bbMin);
+    node.bbMax = glm::max(left.bbMax, right.bbMax);
+}
+
+void TetBVH::refit(const TetMesh& tetMesh) {
+    const int nbNodes = this->nodes.size();
+    #pragma omp parallel for schedule(static)
+    for(int nodeIdx = 0; nodeIdx < nbNodes; ++nodeIdx)
+        if(this->nodes[nodeIdx].count > 0)
+            this->fitLeaf(nodeIdx, tetMesh);
+    for(int nodeIdx = nbNodes - 1; nodeIdx >= 0; --nodeIdx)
+        if(this->nodes[nodeIdx].count == 0)
+            this->fitInner(nodeIdx);
+}
+
+void TetBVH::refit(const TetMesh& tetMesh, const std::vector<int>& movedTetrahedra) {
+    std::vector<int> leaves;
+    leaves.reserve(movedTetrahedra.size());
+    for(int tetIdx : movedTetrahedra)
+        leaves.push_back(this->tetLeaves[tetIdx]);
+    std::sort(leaves.begin(), leaves.end());
+    leaves.erase(std::unique(leaves.begin(), leaves.end()), leaves.end());
+
+    for(int leafIdx : leaves) {
+        this->fitLeaf(leafIdx, tetMesh);
+        // The ancestors of a node whose box didn't change are already up to date
+        for(int nodeIdx = this->nodes[leafIdx].parent; nodeIdx != -1; nodeIdx = this->nodes[nodeIdx].parent) {
+            const glm::vec3 bbMin = this->nodes[nodeIdx].bbMin;
+            const glm::vec3 bbMax = this->nodes[nodeIdx].bbMax;
+            this->fitInner(nodeIdx);
+            if(this->nodes[nodeIdx].bbMin == bbMin && this->nodes[nodeIdx].bbMax == bbMax)
+                break;
+        }
+    }
+}
+
+int TetBVH::find(const TetMesh& tetMesh, const glm::vec3& p) const {
+    if(this->nodes.empty())
+        return -1;
+    // The median split keeps the tree balanced, its depth is about log2(nbTetrahedra / BVH_LEAF_SIZE)
+    int stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while(stackSize > 0) {
+        const Node& node = this->nodes[stack[--stackSize]];
+        if(glm::any(glm::lessThan(p, node.bbMin)) || glm::any(glm::greaterThan(p, node.bbMax)))
+            continue;
+        if(node.count > 0) {
+            for(int i = node.first; i < node.first + node.count; ++i)
+                if(tetMesh.getTetra(this->tetIndices[i]).isInTetrahedron(p))
+                    return this->tetIndices[i];
+        } else {
+            stack[stackSize++] = node.first + 1;
+            stack[stackSize++] = node.first;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,65 @@
+#ifndef TET_BVH_HPP_
+#define TET_BVH_HPP_
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <vector>
+
+class TetMesh;
+
+//! \addtogroup geometry
+//! @{
+
+//! @brief Maximum number of tetrahedra in a leaf of a TetBVH.
+#define BVH_LEAF_SIZE 4
+
+//! @brief Number of tetrahedra under which a branch of a TetBVH is built on a single thread.
+#define BVH_TASK_SIZE 4096
+
+//! @brief Bounding volume hierarchy over the bounding boxes of the tetrahedra of a TetMesh, used to find the tetrahedron containing a point.
+//!
+//! The tree is built once per topology, in parallel, by splitting the tetrahedra at the median of their centroids along the largest axis.
+//! When the points move only the boxes are updated, see refit(), so the tree stays valid but can become less tight after large deformations.
+struct TetBVH {
+
+    struct Node {
+        glm::vec3 bbMin;
+        glm::vec3 bbMax;
+        //! @brief For an inner node the index of its first child, the second one follows it. For a leaf its first position in tetIndices.
+        int first;
+        //! @brief Number of tetrahedra of a leaf, 0 for an inner node.
+        int count;
+        int parent;
+
+        Node(): bbMin(0., 0., 0.), bbMax(0., 0., 0.), first(0), count(0), parent(-1) {}
+    };
+
+    //! @brief The root is the first node, the children of a node are always stored after it.
+    std::vector<Node> nodes;
+    //! @brief Indices of the tetrahedra sorted by leaf.
+    std::vector<int> tetIndices;
+    //! @brief Leaf containing each tetrahedron.
+    std::vector<int> tetLeaves;
+
+    //! @brief True if the tree was built for a mesh of nbTetrahedra tetrahedra.
+    bool isBuilt(std::size_t nbTetrahedra) const;
+
+    void build(const TetMesh& tetMesh);
+
+    //! @brief Update the boxes of all the nodes after the points of the mesh moved.
+    void refit(const TetMesh& tetMesh);
+    //! @brief Update only the boxes of the branches containing the tetrahedra movedTetrahedra.
+    void refit(const TetMesh& tetMesh, const std::vector<int>& movedTetrahedra);
+
+    //! @brief Index of a tetrahedron containing p, see Tetrahedron::isInTetrahedron(). -1 if there is none.
+    int find(const TetMesh& tetMesh, const glm::vec3& p) const;
+
+private:
+    void buildNode(int nodeIdx, int first, int last, const std::vector<glm::vec3>& centroids, std::atomic<int>& nbNodes);
+    void fitLeaf(int nodeIdx, const TetMesh& tetMesh);
+    void fitInner(int nodeIdx);
+};
+
+//! @}
+
+#endif
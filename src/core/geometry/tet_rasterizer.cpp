@@ -0,0 +1,81 @@
+#include "tet_rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+
+TetRasterizer::TetRasterizer(const glm::vec3 points[4], const int pointsIdx[4]): valid(true), bbMin(0, 0, 0), bbMax(-1, -1, -1) {
+    glm::vec3 pointsMin = points[0];
+    glm::vec3 pointsMax = points[0];
+    for(int i = 1; i < 4; ++i) {
+        pointsMin = glm::min(pointsMin, points[i]);
+        pointsMax = glm::max(pointsMax, points[i]);
+    }
+    for(int i = 0; i < 3; ++i) {
+        this->bbMin[i] = std::ceil(pointsMin[i]);
+        this->bbMax[i] = std::floor(pointsMax[i]);
+    }
+
+    for(int faceIdx = 0; faceIdx < 4; ++faceIdx) {
+        // The face faceIdx is opposite to the point faceIdx, its points are sorted by index to get the same plane in both tetrahedra sharing it
+        int facePoints[3];
+        int nbFacePoints = 0;
+        for(int i = 0; i < 4; ++i)
+            if(i != faceIdx)
+                facePoints[nbFacePoints++] = i;
+        std::sort(facePoints, facePoints + 3, [&](int a, int b) { return pointsIdx[a] < pointsIdx[b]; });
+
+        Face& face = this->faces[faceIdx];
+        const glm::dvec3 origin(points[facePoints[0]]);
+        face.normal = glm::cross(glm::dvec3(points[facePoints[1]]) - origin, glm::dvec3(points[facePoints[2]]) - origin);
+        face.offset = -glm::dot(face.normal, origin);
+        // Negating the plane is exact, so the neighbor computes the opposite value for any point
+        const glm::dvec3 opposite(points[faceIdx]);
+        const double side = face.evaluate(opposite.x, opposite.y, opposite.z);
+        if(side == 0.) {
+            this->valid = false;
+            return;
+        }
+        if(side < 0.) {
+            face.normal = -face.normal;
+            face.offset = -face.offset;
+        }
+        // Sign of dot(normal, (e, e^2, e^3))
+        face.ownsTies = (face.normal.x != 0.) ? face.normal.x > 0. : ((face.normal.y != 0.) ? face.normal.y > 0. : face.normal.z > 0.);
+    }
+}
+
+bool TetRasterizer::contains(int x, int y, int z) const {
+    for(int faceIdx = 0; faceIdx < 4; ++faceIdx)
+        if(!this->faces[faceIdx].isInside(this->faces[faceIdx].evaluate(x, y, z)))
+            return false;
+    return true;
+}
+
+bool TetRasterizer::getSpan(int y, int z, int xMin, int xMax, int& first, int& last) const {
+    // Along the row each face is a linear function of x, which bounds the span on one side
+    double lo = xMin;
+    double hi = xMax;
+    for(int faceIdx = 0; faceIdx < 4; ++faceIdx) {
+        const Face& face = this->faces[faceIdx];
+        if(face.normal.x == 0.) {
+            if(!face.isInside(face.evaluate(0., y, z)))
+                return false;
+            continue;
+        }
+        const double root = -face.evaluate(0., y, z) / face.normal.x;
+        if(face.normal.x > 0.)
+            lo = std::max(lo, root);
+        else
+            hi = std::min(hi, root);
+    }
+    if(lo > hi + 1.)
+        return false;
+
+    // The roots are rounded, the ends of the span are settled with the exact test, which is the one shared with the neighbors
+    first = std::max(xMin, static_cast<int>(std::ceil(lo)) - 1);
+    last = std::min(xMax, static_cast<int>(std::floor(hi)) + 1);
+    while(first <= last && !this->contains(first, y, z))
+        ++first;
+    while(last >= first && !this->contains(last, y, z))
+        --last;
+    return first <= last;
+}
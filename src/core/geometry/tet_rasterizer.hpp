@@ -0,0 +1,68 @@
+#ifndef TET_RASTERIZER_HPP_
+#define TET_RASTERIZER_HPP_
+
+#include <glm/glm.hpp>
+
+//! \addtogroup geometry
+//! @{
+
+//! @brief Scan conversion of a tetrahedron into the points of an integer lattice, as the voxel centers of an image.
+//!
+//! The points inside the tetrahedron are found as spans along x, computed from the planes of its faces,
+//! instead of testing each point of its bounding box.
+//! The planes are computed from the points of the faces sorted by index, so two tetrahedra sharing a face compute the very same plane
+//! with opposite signs. A point lying on a plane is given to the side toward which the lattice is shifted by an infinitesimal (e, e^2, e^3),
+//! so each point of the lattice inside a conforming mesh belongs to exactly one of its tetrahedra, including the points on its faces.
+struct TetRasterizer {
+
+    //! @param points The points of the tetrahedron in lattice coordinates, where the samples are at integer positions.
+    //! The points shared by several tetrahedra must be converted the same way for each of them.
+    //! @param pointsIdx Indices of the points in their mesh, see Tetrahedron::pointsIdx.
+    TetRasterizer(const glm::vec3 points[4], const int pointsIdx[4]);
+
+    //! @brief False for a flat tetrahedron, which contains no point.
+    bool isValid() const { return this->valid; }
+
+    bool contains(int x, int y, int z) const;
+
+    //! @brief First and last x of the points of the row (y, z) inside the tetrahedron, clipped to [xMin, xMax].
+    //! @return false if this part of the row is empty.
+    bool getSpan(int y, int z, int xMin, int xMax, int& first, int& last) const;
+
+    //! @brief Call span(y, z, first, last) for each non empty row of points inside the tetrahedron and inside [bbMin, bbMax[,
+    //! the points of a row go from first to last included.
+    template<typename Function>
+    void rasterize(const glm::ivec3& bbMin, const glm::ivec3& bbMax, const Function& span) const {
+        if(!this->valid)
+            return;
+        const glm::ivec3 lo = glm::max(bbMin, this->bbMin);
+        const glm::ivec3 hi = glm::min(bbMax - glm::ivec3(1, 1, 1), this->bbMax);
+        int first = 0;
+        int last = 0;
+        for(int z = lo.z; z <= hi.z; ++z)
+            for(int y = lo.y; y <= hi.y; ++y)
+                if(this->getSpan(y, z, lo.x, hi.x, first, last))
+                    span(y, z, first, last);
+    }
+
+private:
+    //! @brief The points p inside the face are those with dot(normal, p) + offset > 0, or = 0 if ownsTies.
+    struct Face {
+        glm::dvec3 normal;
+        double offset;
+        bool ownsTies;
+
+        double evaluate(double x, double y, double z) const { return this->normal.x * x + this->normal.y * y + this->normal.z * z + this->offset; }
+        bool isInside(double value) const { return value > 0. || (value == 0. && this->ownsTies); }
+    };
+
+    Face faces[4];
+    bool valid;
+    //! @brief Bounding box of the lattice points which can be inside the tetrahedron, included.
+    glm::ivec3 bbMin;
+    glm::ivec3 bbMax;
+};
+
+//! @}
+
+#endif
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <fstream>
 #include <random>
+#include <numeric>
 
 
 // This function make the link between a face of a tetrahedron and its points
@@ -35,15 +36,15 @@ int Tetrahedron::getPointIndex(int faceIdx, int ptIdxInFace) const{
     return this->pointsIdx[getIdxOfPtInFace(faceIdx, ptIdxInFace)];
 }
 
-glm::vec3 * Tetrahedron::getPoint(int faceIdx, int ptIdxInFace) const {
+const glm::vec3& Tetrahedron::getPoint(int faceIdx, int ptIdxInFace) const {
     return this->points[getIdxOfPtInFace(faceIdx, ptIdxInFace)];
 }
 
-TetMesh::TetMesh(): nbTetra(glm::vec3(0., 0., 0.)), mesh(std::vector<Tetrahedron>()) {}
+TetMesh::TetMesh(): nbTetra(glm::vec3(0., 0., 0.)), affineMapsInitial(nullptr) {}
 
 TetMesh::~TetMesh(){}
 
-std::vector<glm::vec3*> TetMesh::insertCubeIntoPtGrid(std::vector<glm::vec3> cubePts, glm::vec3 indices, std::vector<glm::vec3>& vertices, std::vector<int>& ptIndices) {
+void TetMesh::insertCubeIntoPtGrid(std::vector<glm::vec3> cubePts, glm::vec3 indices, std::vector<glm::vec3>& vertices, std::vector<int>& ptIndices) {
     int x = indices[0];
     int y = indices[1];
     int z = indices[2];
@@ -78,19 +79,6 @@ std::vector<glm::vec3*> TetMesh::insertCubeIntoPtGrid(std::vector<glm::vec3> cub
     texCoord[ptIndices[5]] = cubePts[5]/tetMeshSize;
     texCoord[ptIndices[6]] = cubePts[6]/tetMeshSize;
     texCoord[ptIndices[7]] = cubePts[7]/tetMeshSize;
-
-    std::vector<glm::vec3*> res;
-    res.push_back(&vertices[ptIndices[0]]);
-    res.push_back(&vertices[ptIndices[1]]);
-    res.push_back(&vertices[ptIndices[2]]);
-    res.push_back(&vertices[ptIndices[3]]);
-
-    res.push_back(&vertices[ptIndices[4]]);
-    res.push_back(&vertices[ptIndices[5]]);
-    res.push_back(&vertices[ptIndices[6]]);
-    res.push_back(&vertices[ptIndices[7]]);
-    
-    return res;
 }
 
 std::vector<glm::vec3> buildCube(const glm::vec3& origin, const glm::vec3& size) {
@@ -119,10 +107,10 @@ void Tetrahedron::setIndices(int a, int b, int c, int d) {
 }
 
 Tetrahedron::Tetrahedron() {
-    this->points[0] = nullptr;
-    this->points[1] = nullptr;
-    this->points[2] = nullptr;
-    this->points[3] = nullptr;
+    this->points[0] = glm::vec3(0., 0., 0.);
+    this->points[1] = glm::vec3(0., 0., 0.);
+    this->points[2] = glm::vec3(0., 0., 0.);
+    this->points[3] = glm::vec3(0., 0., 0.);
 
     this->pointsIdx[0] = -1;
     this->pointsIdx[1] = -1;
@@ -133,41 +121,14 @@ Tetrahedron::Tetrahedron() {
     this->neighbors[1] = -1;
     this->neighbors[2] = -1;
     this->neighbors[3] = -1;
-
-    this->normals[0] = glm::vec4(0., 0., 0., 0.);
-    this->normals[1] = glm::vec4(0., 0., 0., 0.);
-    this->normals[2] = glm::vec4(0., 0., 0., 0.);
-    this->normals[3] = glm::vec4(0., 0., 0., 0.);
 }
 
-Tetrahedron::Tetrahedron(glm::vec3* a, glm::vec3* b, glm::vec3* c, glm::vec3* d) {
-    this->points[0] = a; 
-    this->points[1] = b;
-    this->points[2] = c;
-    this->points[3] = d;
-
-    this->pointsIdx[0] = -1;
-    this->pointsIdx[1] = -1;
-    this->pointsIdx[2] = -1;
-    this->pointsIdx[3] = -1;
-
-    this->neighbors[0] = -1;
-    this->neighbors[1] = -1;
-    this->neighbors[2] = -1;
-    this->neighbors[3] = -1;
-
-    this->normals[0] = glm::vec4(0., 0., 0., 0.);
-    this->normals[1] = glm::vec4(0., 0., 0., 0.);
-    this->normals[2] = glm::vec4(0., 0., 0., 0.);
-    this->normals[3] = glm::vec4(0., 0., 0., 0.);
-}
-
-glm::vec4 Tetrahedron::computeBaryCoord(const glm::vec3& p) {
+glm::vec4 Tetrahedron::computeBaryCoord(const glm::vec3& p) const {
     //glm::vec4 bary_tet(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c, const glm::vec3 & d, const glm::vec3 & p)
-    const glm::vec3& a = *this->points[0];
-    const glm::vec3& b = *this->points[1];
-    const glm::vec3& c = *this->points[2];
-    const glm::vec3& d = *this->points[3];
+    const glm::vec3& a = this->points[0];
+    const glm::vec3& b = this->points[1];
+    const glm::vec3& c = this->points[2];
+    const glm::vec3& d = this->points[3];
 
     glm::vec3 vap = p - a;
     glm::vec3 vbp = p - b;
@@ -188,10 +149,10 @@ glm::vec4 Tetrahedron::computeBaryCoord(const glm::vec3& p) {
 }
 
 //bool Tetrahedron::isInTetrahedron(const glm::vec3& p) const {
-//    const glm::vec3& v1 = *this->points[0];
-//    const glm::vec3& v2 = *this->points[1];
-//    const glm::vec3& v3 = *this->points[2];
-//    const glm::vec3& v4 = *this->points[3];
+//    const glm::vec3& v1 = this->points[0];
+//    const glm::vec3& v2 = this->points[1];
+//    const glm::vec3& v3 = this->points[2];
+//    const glm::vec3& v4 = this->points[3];
 //    return SameSide(v1, v2, v3, v4, p) && SameSide(v2, v3, v4, v1, p) && SameSide(v3, v4, v1, v2, p) && SameSide(v4, v1, v2, v3, p);
 //}
 
@@ -200,10 +161,10 @@ float det(const glm::vec3& b, const glm::vec3& c, const glm::vec3& d) {
 }
 
 bool Tetrahedron::isInTetrahedron(const glm::vec3& p) const {
-    const glm::vec3& v0 = *this->points[0];
-    const glm::vec3& v1 = *this->points[1];
-    const glm::vec3& v2 = *this->points[2];
-    const glm::vec3& v3 = *this->points[3];
+    const glm::vec3& v0 = this->points[0];
+    const glm::vec3& v1 = this->points[1];
+    const glm::vec3& v2 = this->points[2];
+    const glm::vec3& v3 = this->points[3];
 
     const glm::vec3& a = v0 - p;
     const glm::vec3& b = v1 - p;
@@ -218,32 +179,32 @@ bool Tetrahedron::isInTetrahedron(const glm::vec3& p) const {
     return ret0 || ret1;
 }
 
-glm::vec3 Tetrahedron::baryToWorldCoord(const glm::vec4& coord) {
-    const glm::vec3& v1 = *this->points[0];
-    const glm::vec3& v2 = *this->points[1];
-    const glm::vec3& v3 = *this->points[2];
-    const glm::vec3& v4 = *this->points[3];
+glm::vec3 Tetrahedron::baryToWorldCoord(const glm::vec4& coord) const {
+    const glm::vec3& v1 = this->points[0];
+    const glm::vec3& v2 = this->points[1];
+    const glm::vec3& v3 = this->points[2];
+    const glm::vec3& v4 = this->points[3];
     float x = coord[0]*v1[0] + coord[1]*v2[0] + coord[2]*v3[0] + coord[3]*v4[0];
     float y = coord[0]*v1[1] + coord[1]*v2[1] + coord[2]*v3[1] + coord[3]*v4[1];
     float z = coord[0]*v1[2] + coord[1]*v2[2] + coord[2]*v3[2] + coord[3]*v4[2];
     return glm::vec3(x, y, z);
 }
 
-glm::vec3 Tetrahedron::baryToCoord(const glm::vec4& coord, const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3, const glm::vec3& v4) {
+glm::vec3 Tetrahedron::baryToCoord(const glm::vec4& coord, const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3, const glm::vec3& v4) const {
     float x = coord[0]*v1[0] + coord[1]*v2[0] + coord[2]*v3[0] + coord[3]*v4[0];
     float y = coord[0]*v1[1] + coord[1]*v2[1] + coord[2]*v3[1] + coord[3]*v4[1];
     float z = coord[0]*v1[2] + coord[1]*v2[2] + coord[2]*v3[2] + coord[3]*v4[2];
     return glm::vec3(x, y, z);
 }
 
-void Tetrahedron::computeNormals() {
+void Tetrahedron::computeNormals(glm::vec4 normals[4]) const {
     for(int faceIdx = 0; faceIdx < 4; ++faceIdx) {
-        glm::vec3 p0 = glm::vec3(glm::vec4(*this->points[getIdxOfPtInFace(faceIdx, 0)], 1.));
-        glm::vec3 p1 = glm::vec3(glm::vec4(*this->points[getIdxOfPtInFace(faceIdx, 1)], 1.));
-        glm::vec3 p2 = glm::vec3(glm::vec4(*this->points[getIdxOfPtInFace(faceIdx, 2)], 1.));
+        glm::vec3 p0 = glm::vec3(glm::vec4(this->points[getIdxOfPtInFace(faceIdx, 0)], 1.));
+        glm::vec3 p1 = glm::vec3(glm::vec4(this->points[getIdxOfPtInFace(faceIdx, 1)], 1.));
+        glm::vec3 p2 = glm::vec3(glm::vec4(this->points[getIdxOfPtInFace(faceIdx, 2)], 1.));
 
-        glm::vec3 pF  = glm::vec3(glm::vec4(*this->points[faceIdx], 1.));
-        glm::vec3 pFO = glm::vec3(glm::vec4(*this->points[(faceIdx + 1) % 4], 1.));
+        glm::vec3 pF  = glm::vec3(glm::vec4(this->points[faceIdx], 1.));
+        glm::vec3 pFO = glm::vec3(glm::vec4(this->points[(faceIdx + 1) % 4], 1.));
 
         glm::vec3 n1   = p1 - p0;
         glm::vec3 n2   = p2 - p0;
@@ -252,14 +213,14 @@ void Tetrahedron::computeNormals() {
         glm::vec4 v1			  = glm::vec4(pF - pFO, 1.);
         glm::vec4::value_type val = 1. / glm::dot(v1, norm);
         norm.w					  = val;
-        this->normals[faceIdx] = norm;
+        normals[faceIdx] = norm;
     }
 }
 
 void Tetrahedron::getCentroid(glm::vec3& centroid) const {
     centroid = glm::vec3(0., 0., 0.);
     for(int i = 0; i < 4; ++i) {
-        centroid += *this->points[i];
+        centroid += this->points[i];
     }
     centroid /= 4.f;
 }
@@ -267,14 +228,14 @@ void Tetrahedron::getCentroid(glm::vec3& centroid) const {
 glm::vec3 Tetrahedron::getBBMin() const {
     glm::vec3 min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
     for(int i = 0; i < 4; ++i) {
-        if(min.x > this->points[i]->x)
-            min.x = this->points[i]->x;
+        if(min.x > this->points[i].x)
+            min.x = this->points[i].x;
 
-        if(min.y > this->points[i]->y)
-            min.y = this->points[i]->y;
+        if(min.y > this->points[i].y)
+            min.y = this->points[i].y;
 
-        if(min.z > this->points[i]->z)
-            min.z = this->points[i]->z;
+        if(min.z > this->points[i].z)
+            min.z = this->points[i].z;
     }
     return min;
 }
@@ -282,14 +243,14 @@ glm::vec3 Tetrahedron::getBBMin() const {
 glm::vec3 Tetrahedron::getBBMax() const {
     glm::vec3 max = glm::vec3(FLT_MIN, FLT_MIN, FLT_MIN);
     for(int i = 0; i < 4; ++i) {
-        if(max.x < this->points[i]->x)
-            max.x = this->points[i]->x;
+        if(max.x < this->points[i].x)
+            max.x = this->points[i].x;
 
-        if(max.y < this->points[i]->y)
-            max.y = this->points[i]->y;
+        if(max.y < this->points[i].y)
+            max.y = this->points[i].y;
 
-        if(max.z < this->points[i]->z)
-            max.z = this->points[i]->z;
+        if(max.z < this->points[i].z)
+            max.z = this->points[i].z;
     }
     return max;
 }
@@ -321,10 +282,10 @@ glm::vec3 Tetrahedron::getBBMax() const {
 //
 
 bool Tetrahedron::planeIntersect(const glm::vec3& origin, const glm::vec3& direction) const {
-    return !((glm::dot(*this->points[0] - origin, direction) > 0.) ==
-             (glm::dot(*this->points[1] - origin, direction) > 0.) ==
-             (glm::dot(*this->points[2] - origin, direction) > 0.) ==
-             (glm::dot(*this->points[3] - origin, direction) > 0.));
+    return !((glm::dot(this->points[0] - origin, direction) > 0.) ==
+             (glm::dot(this->points[1] - origin, direction) > 0.) ==
+             (glm::dot(this->points[2] - origin, direction) > 0.) ==
+             (glm::dot(this->points[3] - origin, direction) > 0.));
 }
 
 bool Tetrahedron::faceIntersect(const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) const {
@@ -396,8 +357,8 @@ void TetMesh::buildGrid(const glm::vec3& nbCube, const glm::vec3& sizeCube, cons
             for(int i = 0; i < nbCube[0]; ++i) {
                 glm::vec3 offset = glm::vec3(i*sizeCube[0], j*sizeCube[1], k*sizeCube[2]);
                 std::vector<glm::vec3> cubePts = buildCube(origin+offset, sizeCube);
-                std::vector<glm::vec3*> cubePtsAdress = insertCubeIntoPtGrid(cubePts, glm::vec3(i, j, k), this->vertices, ptIndices);
-                this->decomposeAndAddCube(cubePtsAdress, ptIndices);
+                this->insertCubeIntoPtGrid(cubePts, glm::vec3(i, j, k), this->vertices, ptIndices);
+                this->decomposeAndAddCube(ptIndices);
             }
         }
     }
@@ -406,95 +367,99 @@ void TetMesh::buildGrid(const glm::vec3& nbCube, const glm::vec3& sizeCube, cons
 }
 
 bool TetMesh::isEmpty() const {
-    return this->mesh.empty();
+    return this->tetPoints.empty();
 }
 
 Tetrahedron TetMesh::getTetra(int idx) const {
-    return mesh[idx];
-} 
+    Tetrahedron tet;
+    for(int i = 0; i < 4; ++i) {
+        tet.pointsIdx[i] = this->tetPoints[idx][i];
+        tet.neighbors[i] = this->tetNeighbors[idx][i];
+        tet.points[i] = this->vertices[tet.pointsIdx[i]];
+    }
+    return tet;
+}
+
+void TetMesh::addTetrahedron(int a, int b, int c, int d) {
+    this->tetPoints.push_back(glm::ivec4(a, b, c, d));
+    this->tetNeighbors.push_back(glm::ivec4(-1, -1, -1, -1));
+}
+
+namespace {
+    //! @brief Last tetrahedron found by each thread, the default start of its next walk.
+    thread_local const TetMesh * lastMesh = nullptr;
+    thread_local int lastTetraIdx = -1;
+}
 
 int TetMesh::inTetraIdx(const glm::vec3& p) const {
-    // Naive version
-    int i = 0;
-    for(int i = 0; i < mesh.size(); ++i)
-        if(mesh[i].isInTetrahedron(p))
-            return i;
-    return -1;
-    //auto rng = std::default_random_engine {};
-
-    //std::uniform_int_distribution<std::mt19937::result_type> dist(0,this->mesh.size()-1);
-    //std::random_device dev;
-    //std::mt19937 rng2(dev());
-    //int seedIdx = dist(rng2);
-
-    //int idx = seedIdx;
-    //glm::vec3 centroid(0., 0., 0.);
-    //do {
-    //    std::vector<int> validNeigh;
-    //    validNeigh.clear();
-    //    const Tetrahedron& tet = this->mesh[idx];
-    //    tet.getCentroid(centroid);
-
-    //    for(int i = 0; i < 4; ++i) {
-    //        const glm::vec3& p1 = this->vertices[tet.getPointIndex(i, 0)];
-    //        const glm::vec3& p2 = this->vertices[tet.getPointIndex(i, 1)];
-    //        const glm::vec3& p3 = this->vertices[tet.getPointIndex(i, 2)];
-
-    //        if(tet.faceIntersect(p, centroid, p1, p2, p3)) {
-    //            if(tet.neighbors[i] != -1) {
-    //                validNeigh.push_back(tet.neighbors[i]);
-    //            }
-    //        }
-    //    }
-    //    if(!validNeigh.empty()) {
-    //        if(tet.isInTetrahedron(p)) {
-    //            //std::cout << "Found" << std::endl;
-    //            return idx;
-    //        }
-    //        //if(validNeigh.size() > 1)
-    //            //std::cout << "BUG" << std::endl;
-    //        // This slow the computation a lot, but this is mandatory to avoid infinite loop in degenerate cases
-    //        // https://hal.inria.fr/inria-00072509/document : at the end of page 11, fig.5
-    //        //std::shuffle(std::begin(validNeigh), std::end(validNeigh), rng);
-    //        idx = validNeigh[0];
-    //        //std::cout << idx << std::endl;
-    //    } else {
-    //        //std::cout << "Naïve" << std::endl;
-    //        idx = -1;
-    //        int i = 0;
-    //        for(int i = 0; i < mesh.size(); ++i)
-    //            if(mesh[i].isInTetrahedron(p))
-    //                return i;
-    //        return -1;
-    //    }
-    //} while(true);
-    //return idx;
+    return this->inTetraIdx(p, -1);
+}
+
+int TetMesh::inTetraIdx(const glm::vec3& p, int hintIdx) const {
+    const int nbTetrahedra = this->getNbTetrahedra();
+    if(hintIdx < 0 || hintIdx >= nbTetrahedra)
+        hintIdx = (lastMesh == this && lastTetraIdx < nbTetrahedra) ? lastTetraIdx : -1;
+
+    // Remembering stochastic walk, see "Walking in a triangulation" by Devillers et al.
+    // The face we came from is never crossed back and the faces are tested in a random order,
+    // which prevents the walk from cycling in the non-Delaunay meshes
+    static thread_local std::minstd_rand rng;
+    int idx = hintIdx;
+    int previousIdx = -1;
+    for(int step = 0; idx != -1 && step < TET_WALK_MAX_STEPS; ++step) {
+        const Tetrahedron tet = this->getTetra(idx);
+        const glm::vec4 baryCoord = tet.computeBaryCoord(p);
+        const int firstFace = rng() % 4;
+        int nextIdx = idx;
+        for(int i = 0; i < 4; ++i) {
+            // The face i is opposite to the point i, p is behind it if its barycentric coordinate is negative
+            const int faceIdx = (firstFace + i) % 4;
+            if(baryCoord[faceIdx] < 0. && (previousIdx == -1 || tet.neighbors[faceIdx] != previousIdx)) {
+                nextIdx = tet.neighbors[faceIdx];
+                break;
+            }
+        }
+        if(nextIdx == idx) {
+            // p can still be on a face or in a degenerated tetrahedron
+            if(!tet.isInTetrahedron(p))
+                break;
+            lastMesh = this;
+            lastTetraIdx = idx;
+            return idx;
+        }
+        // nextIdx is -1 when the walk leaves the mesh, which isn't always convex
+        previousIdx = idx;
+        idx = nextIdx;
+    }
+
+    int result = -1;
+    if(this->bvh.isBuilt(nbTetrahedra)) {
+        result = this->bvh.find(*this, p);
+    } else {
+        for(int i = 0; i < nbTetrahedra && result == -1; ++i)
+            if(this->getTetra(i).isInTetrahedron(p))
+                result = i;
+    }
+    if(result != -1) {
+        lastMesh = this;
+        lastTetraIdx = result;
+    }
+    return result;
 }
 
 // This function is private because it doesn't update fields nbTetra, bbMin and bbMax
 // Thus it can only be used in buildGrid function
-void TetMesh::decomposeAndAddCube(std::vector<glm::vec3*> pts, const std::vector<int>& ptsIdx) {
-    if(pts.size() > 8) {
+void TetMesh::decomposeAndAddCube(const std::vector<int>& ptsIdx) {
+    if(ptsIdx.size() > 8) {
         std::cerr << "Error: can't add a cube with more than 8 vertices" << std::endl;
         return;
     }
-    mesh.push_back(Tetrahedron(pts[3], pts[2], pts[1], pts[6]));
-    mesh.back().setIndices(ptsIdx[3], ptsIdx[2], ptsIdx[1], ptsIdx[6]);
-
-    mesh.push_back(Tetrahedron(pts[4], pts[0], pts[5], pts[7]));
-    mesh.back().setIndices(ptsIdx[4], ptsIdx[0], ptsIdx[5], ptsIdx[7]);
-
-    mesh.push_back(Tetrahedron(pts[5], pts[3], pts[6], pts[7]));
-    mesh.back().setIndices(ptsIdx[5], ptsIdx[3], ptsIdx[6], ptsIdx[7]);
-
-    mesh.push_back(Tetrahedron(pts[0], pts[3], pts[5], pts[7]));
-    mesh.back().setIndices(ptsIdx[0], ptsIdx[3], ptsIdx[5], ptsIdx[7]);
-
-    mesh.push_back(Tetrahedron(pts[0], pts[3], pts[1], pts[5]));
-    mesh.back().setIndices(ptsIdx[0], ptsIdx[3], ptsIdx[1], ptsIdx[5]);
-
-    mesh.push_back(Tetrahedron(pts[1], pts[3], pts[6], pts[5]));
-    mesh.back().setIndices(ptsIdx[1], ptsIdx[3], ptsIdx[6], ptsIdx[5]);
+    this->addTetrahedron(ptsIdx[3], ptsIdx[2], ptsIdx[1], ptsIdx[6]);
+    this->addTetrahedron(ptsIdx[4], ptsIdx[0], ptsIdx[5], ptsIdx[7]);
+    this->addTetrahedron(ptsIdx[5], ptsIdx[3], ptsIdx[6], ptsIdx[7]);
+    this->addTetrahedron(ptsIdx[0], ptsIdx[3], ptsIdx[5], ptsIdx[7]);
+    this->addTetrahedron(ptsIdx[0], ptsIdx[3], ptsIdx[1], ptsIdx[5]);
+    this->addTetrahedron(ptsIdx[1], ptsIdx[3], ptsIdx[6], ptsIdx[5]);
 
     //3 . 2 . 1 . 6
     //4 . 0 . 5 . 7
@@ -549,26 +514,123 @@ public:
 void TetMesh::computeNeighborhood() {
 	// generate the correspondance by looking at which faces are similar
 	std::map<Face, std::pair<int, int>> adjacent_faces;
-	for (std::size_t tetIdx = 0; tetIdx < this->mesh.size(); tetIdx++) {
-        Tetrahedron& tet = this->mesh[tetIdx];
+	for (std::size_t tetIdx = 0; tetIdx < this->tetPoints.size(); tetIdx++) {
+        const glm::ivec4& tet = this->tetPoints[tetIdx];
 		for (int faceIdx = 0; faceIdx < 4; faceIdx++) {
-			Face face = Face(tet.pointsIdx[getIdxOfPtInFace(faceIdx,0)],
-                             tet.pointsIdx[getIdxOfPtInFace(faceIdx,1)],
-                             tet.pointsIdx[getIdxOfPtInFace(faceIdx,2)]);
+			Face face = Face(tet[getIdxOfPtInFace(faceIdx,0)],
+                             tet[getIdxOfPtInFace(faceIdx,1)],
+                             tet[getIdxOfPtInFace(faceIdx,2)]);
 			std::map<Face, std::pair<int, int>>::iterator it = adjacent_faces.find(face);
 			if (it == adjacent_faces.end()) {
 				adjacent_faces[face] = std::make_pair(static_cast<int>(tetIdx), faceIdx);
 			} else {
-				tet.neighbors[faceIdx]						              = it->second.first;
-				this->mesh[it->second.first].neighbors[it->second.second] = tetIdx;
+				this->tetNeighbors[tetIdx][faceIdx]                      = it->second.first;
+				this->tetNeighbors[it->second.first][it->second.second] = tetIdx;
 			}
 		}
 	}
+
+    // Tetrahedra around each point, counted then filled
+    this->vertexTetOffsets.assign(this->vertices.size() + 1, 0);
+    for(const glm::ivec4& tet : this->tetPoints)
+        for(int i = 0; i < 4; ++i)
+            this->vertexTetOffsets[tet[i] + 1] += 1;
+    std::partial_sum(this->vertexTetOffsets.begin(), this->vertexTetOffsets.end(), this->vertexTetOffsets.begin());
+    this->vertexTets.resize(this->vertexTetOffsets.back());
+    std::vector<int> insertIdx(this->vertexTetOffsets.begin(), this->vertexTetOffsets.end() - 1);
+    for(int tetIdx = 0; tetIdx < this->tetPoints.size(); ++tetIdx)
+        for(int i = 0; i < 4; ++i)
+            this->vertexTets[insertIdx[this->tetPoints[tetIdx][i]]++] = tetIdx;
 }
 
 void TetMesh::computeNormals() {
-    for(int tetIdx = 0; tetIdx < this->mesh.size(); ++tetIdx) {
-        this->mesh[tetIdx].computeNormals();
+    const int nbTetrahedra = this->getNbTetrahedra();
+    this->tetNormals.resize(4 * nbTetrahedra);
+    #pragma omp parallel for schedule(static)
+    for(int tetIdx = 0; tetIdx < nbTetrahedra; ++tetIdx) {
+        this->getTetra(tetIdx).computeNormals(&this->tetNormals[4 * tetIdx]);
+    }
+    if(this->bvh.isBuilt(nbTetrahedra))
+        this->bvh.refit(*this);
+    else
+        this->bvh.build(*this);
+    if(this->affineMapsInitial)
+        this->computeAffineMaps(*this->affineMapsInitial);
+}
+
+void TetMesh::movePoints(const std::vector<int>& origins, const std::vector<glm::vec3>& targets) {
+    // When a large part of the mesh moves everything is updated at once
+    const bool isIndexed = this->bvh.isBuilt(this->getNbTetrahedra()) && this->vertexTetOffsets.size() == this->vertices.size() + 1;
+    if(!isIndexed || origins.size() * 4 > this->vertices.size()) {
+        BaseMesh::movePoints(origins, targets);
+        return;
+    }
+    std::vector<int> movedTetrahedra;
+    for(std::size_t i = 0; i < origins.size(); ++i) {
+        const int pointIdx = origins[i];
+        this->vertices[pointIdx] = targets[i];
+        movedTetrahedra.insert(movedTetrahedra.end(), this->vertexTets.begin() + this->vertexTetOffsets[pointIdx], this->vertexTets.begin() + this->vertexTetOffsets[pointIdx + 1]);
+    }
+    std::sort(movedTetrahedra.begin(), movedTetrahedra.end());
+    movedTetrahedra.erase(std::unique(movedTetrahedra.begin(), movedTetrahedra.end()), movedTetrahedra.end());
+    const bool hasAffineMaps = this->affineMaps.size() == this->tetPoints.size();
+    for(int tetIdx : movedTetrahedra) {
+        this->getTetra(tetIdx).computeNormals(&this->tetNormals[4 * tetIdx]);
+        if(hasAffineMaps)
+            this->computeAffineMap(tetIdx);
+    }
+    this->bvh.refit(*this, movedTetrahedra);
+    this->updatebbox();
+}
+
+void TetMesh::computeAffineMaps(const TetMesh& initial) {
+    this->affineMapsInitial = &initial;
+    // The initial mesh can be built after this one
+    const int nbTetrahedra = this->getNbTetrahedra();
+    if(initial.getNbTetrahedra() != nbTetrahedra) {
+        this->affineMaps.clear();
+        return;
+    }
+    this->affineMaps.resize(nbTetrahedra);
+    #pragma omp parallel for schedule(static)
+    for(int tetIdx = 0; tetIdx < nbTetrahedra; ++tetIdx)
+        this->computeAffineMap(tetIdx);
+}
+
+void TetMesh::computeAffineMap(int tetIdx) {
+    const Tetrahedron tet = this->getTetra(tetIdx);
+    const Tetrahedron initialTet = this->affineMapsInitial->getTetra(tetIdx);
+    // A point origin + edges * b of this tetrahedron is at initialOrigin + initialEdges * b in the initial one
+    // The map is computed in double as the edges can be small compared to the coordinates
+    const glm::dvec3 origin(tet.points[0]);
+    const glm::dvec3 initialOrigin(initialTet.points[0]);
+    glm::dmat3 edges;
+    glm::dmat3 initialEdges;
+    for(int i = 0; i < 3; ++i) {
+        edges[i] = glm::dvec3(tet.points[i + 1]) - origin;
+        initialEdges[i] = glm::dvec3(initialTet.points[i + 1]) - initialOrigin;
+    }
+    const glm::dmat3 linear = initialEdges * glm::inverse(edges);
+    glm::mat4x3& map = this->affineMaps[tetIdx];
+    for(int i = 0; i < 3; ++i)
+        map[i] = glm::vec3(linear[i]);
+    map[3] = glm::vec3(initialOrigin - linear * origin);
+}
+
+bool TetMesh::locate(const glm::vec3& p, int& tetraIdx, glm::vec4& baryCoord, int hintIdx) const {
+    tetraIdx = this->inTetraIdx(p, hintIdx);
+    if(tetraIdx == -1)
+        return false;
+    baryCoord = this->getTetra(tetraIdx).computeBaryCoord(p);
+    return true;
+}
+
+void TetMesh::locate(const glm::vec3 * points, std::size_t nbPoints, int * tetraIdx, glm::vec4 * baryCoords) const {
+    int hintIdx = -1;
+    for(std::size_t i = 0; i < nbPoints; ++i) {
+        // The points outside of the mesh keep the last tetrahedron found as hint
+        if(this->locate(points[i], tetraIdx[i], baryCoords[i], hintIdx))
+            hintIdx = tetraIdx[i];
     }
 }
 
@@ -576,6 +638,10 @@ bool TetMesh::getCoordInInitial(const TetMesh& initial, const glm::vec3& p, glm:
     if(tetraIdx == -1) {
         tetraIdx = this->inTetraIdx(p);
     }
+    if(tetraIdx != -1 && &initial == this->affineMapsInitial && this->affineMaps.size() == this->tetPoints.size()) {
+        out = this->affineMaps[tetraIdx] * glm::vec4(p, 1.);
+        return true;
+    }
     if(tetraIdx != -1) {
         glm::vec4 baryCoordInDeformed = this->getTetra(tetraIdx).computeBaryCoord(p);
         glm::vec3 coordInInitial = initial.getTetra(tetraIdx).baryToWorldCoord(baryCoordInDeformed);
@@ -588,6 +654,10 @@ bool TetMesh::getCoordInInitial(const TetMesh& initial, const glm::vec3& p, glm:
 
 bool TetMesh::getCoordInInitialOut(const TetMesh& initial, const glm::vec3& p, glm::vec3& out, int& tetraIdx) const {
     tetraIdx = this->inTetraIdx(p);
+    if(tetraIdx != -1 && &initial == this->affineMapsInitial && this->affineMaps.size() == this->tetPoints.size()) {
+        out = this->affineMaps[tetraIdx] * glm::vec4(p, 1.);
+        return true;
+    }
     if(tetraIdx != -1) {
         glm::vec4 baryCoordInDeformed = this->getTetra(tetraIdx).computeBaryCoord(p);
         glm::vec3 coordInInitial = initial.getTetra(tetraIdx).baryToWorldCoord(baryCoordInDeformed);
@@ -680,17 +750,13 @@ void TetMesh::loadMESH(std::string const &filename) {
             for (unsigned int j = 0; j < 4; j++)
                 myfile >> v[j];
             myfile >> s;
-            mesh.push_back(Tetrahedron(&this->vertices[v[0]-1], &this->vertices[v[1]-1], &this->vertices[v[2]-1], &this->vertices[v[3]-1]));
-            this->mesh.back().pointsIdx[0] = v[0]-1;
-            this->mesh.back().pointsIdx[1] = v[1]-1;
-            this->mesh.back().pointsIdx[2] = v[2]-1;
-            this->mesh.back().pointsIdx[3] = v[3]-1;
+            this->addTetrahedron(v[0]-1, v[1]-1, v[2]-1, v[3]-1);
         }
     }
     myfile.close ();
 
     std::cout << "Points: " << this->vertices.size() << std::endl;
-    std::cout << "Tetrahedron: " << this->mesh.size() << std::endl;
+    std::cout << "Tetrahedron: " << this->getNbTetrahedra() << std::endl;
 
     this->history = new History(this->vertices, this->coordinate_system);
 
@@ -705,11 +771,11 @@ void TetMesh::loadMESH(std::string const &filename) {
 
 void TetMesh::sortTet(const glm::vec3& cameraOrigin, std::vector<std::pair<int, float>>& idxDepthMap) {
     idxDepthMap.clear();
-    idxDepthMap = std::vector<std::pair<int, float>>(this->mesh.size());
+    idxDepthMap = std::vector<std::pair<int, float>>(this->getNbTetrahedra());
 
     glm::vec3 centroid;
-    for(int i = 0; i < this->mesh.size(); ++i) {
-        this->mesh[i].getCentroid(centroid);
+    for(int i = 0; i < this->getNbTetrahedra(); ++i) {
+        this->getTetra(i).getCentroid(centroid);
         idxDepthMap[i] = std::make_pair(i, glm::distance(centroid, cameraOrigin));
     }
 
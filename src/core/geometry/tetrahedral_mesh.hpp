@@ -2,38 +2,45 @@
 #define TETRAHEDRALMESH_HPP_
 
 #include "base_mesh.hpp"
+#include "tet_bvh.hpp"
+#include "../utils/aligned_allocator.hpp"
 //#include "../include/mesh_deformer.hpp"
 
 struct MeshDeformer;
 
+//! @brief Maximum number of tetrahedra crossed by a walk, see TetMesh::inTetraIdx(), before falling back to the TetBVH.
+#define TET_WALK_MAX_STEPS 32
+
+//! @brief Alignment in bytes of the arrays of the tetrahedra of a TetMesh, a cache line.
+#define TET_ARRAY_ALIGNMENT 64
+
 //! \addtogroup geometry
 //! @{
+//! @brief A tetrahedron of a TetMesh, copied out of its arrays by TetMesh::getTetra().
+//! It holds the positions of its points at the time of the copy, so it has to be fetched again once they move.
 struct Tetrahedron {
-    //! @brief This attribute is optionnal, this data can be deleted and the functions computeBary, isInTet and baryToWord can be moved out in TetMesh.
-    glm::vec3 * points[4];
-    glm::vec4 normals[4];
+    glm::vec3 points[4];
 
     int pointsIdx[4];
     int neighbors[4];
 
     Tetrahedron();
 
-    Tetrahedron(glm::vec3* a, glm::vec3* b, glm::vec3* c, glm::vec3* d);
-
     void setIndices(int a, int b, int c, int d);
 
-    glm::vec4 computeBaryCoord(const glm::vec3& p);
+    glm::vec4 computeBaryCoord(const glm::vec3& p) const;
 
     bool isInTetrahedron(const glm::vec3& p) const;
 
-    glm::vec3 baryToWorldCoord(const glm::vec4& coord);
-    glm::vec3 baryToCoord(const glm::vec4& coord, const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3, const glm::vec3& v4);
+    glm::vec3 baryToWorldCoord(const glm::vec4& coord) const;
+    glm::vec3 baryToCoord(const glm::vec4& coord, const glm::vec3& v1, const glm::vec3& v2, const glm::vec3& v3, const glm::vec3& v4) const;
 
-    void computeNormals();
+    //! @brief Normal of each face, with in w the inverse of its dot product with the vector from the next point to the opposite one.
+    void computeNormals(glm::vec4 normals[4]) const;
 
     int getPointIndex(int faceIdx, int ptIdxInFace) const;
 
-    glm::vec3 * getPoint(int faceIdx, int ptIdxInFace) const;
+    const glm::vec3& getPoint(int faceIdx, int ptIdxInFace) const;
 
     void getCentroid(glm::vec3& centroid) const;
 
@@ -46,10 +53,13 @@ struct Tetrahedron {
     glm::vec3 getBBMin() const;
 };
 
+//! @brief Tetrahedral mesh stored as a structure of arrays, the tetrahedra only refer to their points by index.
 class TetMesh : public BaseMesh {
 
 public:
-    std::vector<Tetrahedron> mesh;
+    template<typename T>
+    using TetArray = AlignedVector<T, TET_ARRAY_ALIGNMENT>;
+
     glm::vec3 nbTetra;
 
     TetMesh();
@@ -60,11 +70,40 @@ public:
     void buildGrid(const glm::vec3& nbCube, const glm::vec3& sizeCube, const glm::vec3& origin);
 
     void computeNeighborhood();
+    //! @brief Also update the TetBVH used by inTetraIdx(), which is built at the first call.
     void computeNormals() override;
 
+    using BaseMesh::movePoints;
+    //! @brief When few points move, only the normals and the TetBVH boxes of the tetrahedra around them are updated.
+    void movePoints(const std::vector<int>& origins, const std::vector<glm::vec3>& targets) override;
+
     // Specific to Tethrahedal mesh
+    int getNbTetrahedra() const { return this->tetPoints.size(); }
     Tetrahedron getTetra(int idx) const;
+    //! @brief Indices of the points of the tetrahedron tetIdx, see Tetrahedron::pointsIdx.
+    const glm::ivec4& getPointsIdx(int tetIdx) const { return this->tetPoints[tetIdx]; }
+    //! @brief Tetrahedron behind each face of the tetrahedron tetIdx, -1 on the border of the mesh.
+    const glm::ivec4& getNeighbors(int tetIdx) const { return this->tetNeighbors[tetIdx]; }
+    //! @brief The 4 normals of the faces of the tetrahedron tetIdx, see Tetrahedron::computeNormals().
+    const glm::vec4 * getNormals(int tetIdx) const { return &this->tetNormals[4 * tetIdx]; }
+    //! @brief Index of the tetrahedron containing p, -1 if p is outside of the mesh.
+    //! Walks from the last tetrahedron found by the calling thread in this mesh, so close consecutive queries are cheap.
     int inTetraIdx(const glm::vec3& p) const;
+    //! @brief Walk through the neighbors from the tetrahedron hintIdx to the one containing p.
+    //! When the walk leaves the mesh or takes more than TET_WALK_MAX_STEPS steps the TetBVH is used instead.
+    //! @param hintIdx A tetrahedron close to p, usually the result of the previous query. If -1 the last tetrahedron found by the calling thread is used.
+    int inTetraIdx(const glm::vec3& p, int hintIdx) const;
+    //! @brief Find the tetrahedron containing p and the barycentric coordinates of p in it.
+    //! @return false if p is outside of the mesh.
+    bool locate(const glm::vec3& p, int& tetraIdx, glm::vec4& baryCoord, int hintIdx = -1) const;
+    //! @brief Locate nbPoints points, each walk starts from the tetrahedron of the previous point found.
+    //! @param tetraIdx Set to -1 for the points outside of the mesh, their baryCoords are not set.
+    void locate(const glm::vec3 * points, std::size_t nbPoints, int * tetraIdx, glm::vec4 * baryCoords) const;
+    //! @brief Precompute for each tetrahedron the affine map from its position in this mesh to its position in initial, used by getCoordInInitial().
+    //! The maps are then updated each time the points of this mesh move. initial must have the same tetrahedra and its points must not move.
+    void computeAffineMaps(const TetMesh& initial);
+    //! @brief Position in initial of the point p of this mesh, a single matrix product once computeAffineMaps() is called with initial.
+    //! @param tetraIdx The tetrahedron containing p if it is already known.
     bool getCoordInInitial(const TetMesh& initial, const glm::vec3& p, glm::vec3& out, int tetraIdx = -1) const;
     bool getCoordInInitialOut(const TetMesh& initial, const glm::vec3& p, glm::vec3& out, int& tetraIdx) const;
     bool getCoordInImage(const glm::vec3& p, glm::vec3& out, int tetraIdx = -1) const;
@@ -76,10 +115,28 @@ public:
     ~TetMesh();
 
 private:
+    //! @brief The tetrahedron i is made of tetPoints[i], tetNeighbors[i] and the normals tetNormals[4*i] to tetNormals[4*i+3].
+    //! The kernels over all the tetrahedra only read the arrays they need, and the tetrahedra stay valid when vertices is reallocated or the mesh copied.
+    TetArray<glm::ivec4> tetPoints;
+    TetArray<glm::ivec4> tetNeighbors;
+    TetArray<glm::vec4> tetNormals;
+
+    TetBVH bvh;
+    //! @brief Tetrahedra around each point, the ones around the point i are vertexTets[vertexTetOffsets[i]] to vertexTets[vertexTetOffsets[i+1]-1].
+    std::vector<int> vertexTetOffsets;
+    std::vector<int> vertexTets;
+    //! @brief Maps of computeAffineMaps(), kept apart from the tetrahedra so that a query reads a single contiguous matrix.
+    //! Empty if the maps are not computed.
+    std::vector<glm::mat4x3> affineMaps;
+    const TetMesh * affineMapsInitial;
+
+    void computeAffineMap(int tetIdx);
+
     // This function is private because it doesn't update fields nbTetra, bbMin and bbMax
     // Thus it can only be used in buildGrid function
-    void decomposeAndAddCube(std::vector<glm::vec3*> pts, const std::vector<int>& ptsIdx);
-    std::vector<glm::vec3*> insertCubeIntoPtGrid(std::vector<glm::vec3> cubePts, glm::vec3 indices, std::vector<glm::vec3>& ptGrid, std::vector<int>& ptIndices);
+    void decomposeAndAddCube(const std::vector<int>& ptsIdx);
+    void insertCubeIntoPtGrid(std::vector<glm::vec3> cubePts, glm::vec3 indices, std::vector<glm::vec3>& ptGrid, std::vector<int>& ptIndices);
+    void addTetrahedron(int a, int b, int c, int d);
     int from3DTo1D(const glm::vec3& p) const;
 };
 //! @}
@@ -0,0 +1,487 @@
+#include "brick_volume.hpp"
+#include "image.hpp"
+#include <zlib.h>
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+glm::ivec3 BrickVolume::getLevelResolution(const glm::ivec3& resolution, int level) {
+    const int factor = 1 << level;
+    return (resolution + glm::ivec3(factor - 1)) / factor;
+}
+
+glm::ivec3 BrickVolume::getNbBricks(const glm::ivec3& levelResolution, int brickSize) {
+    return (levelResolution + glm::ivec3(brickSize - 1)) / brickSize;
+}
+
+namespace {
+
+    //! @brief Slices of a level waiting to be written, a slab always starts on a brick boundary.
+    template<typename voxel_t>
+    struct LevelSlab {
+        glm::ivec3 resolution;
+        glm::ivec3 nbBricks;
+        std::size_t firstBrick;
+        int firstSlice;
+        int nbSlices;
+        std::vector<voxel_t> values;
+    };
+
+    template<typename voxel_t>
+    struct BrickWriter {
+        std::ofstream& file;
+        int brickSize;
+        std::vector<LevelSlab<voxel_t>> levels;
+        std::vector<BrickVolume::BrickInfo> index;
+
+        BrickWriter(std::ofstream& file, const glm::ivec3& resolution, int brickSize, int nbLevels): file(file), brickSize(brickSize) {
+            std::size_t firstBrick = 0;
+            for(int level = 0; level < nbLevels; ++level) {
+                LevelSlab<voxel_t> slab;
+                slab.resolution = BrickVolume::getLevelResolution(resolution, level);
+                slab.nbBricks = BrickVolume::getNbBricks(slab.resolution, brickSize);
+                slab.firstBrick = firstBrick;
+                slab.firstSlice = 0;
+                slab.nbSlices = 0;
+                slab.values.resize(static_cast<std::size_t>(slab.resolution.x) * slab.resolution.y * brickSize);
+                firstBrick += static_cast<std::size_t>(slab.nbBricks.x) * slab.nbBricks.y * slab.nbBricks.z;
+                this->levels.push_back(std::move(slab));
+            }
+            this->index.resize(firstBrick, BrickVolume::BrickInfo{0, 0});
+        }
+
+        voxel_t * getNextSlice(int level) {
+            LevelSlab<voxel_t>& slab = this->levels[level];
+            return slab.values.data() + static_cast<std::size_t>(slab.nbSlices) * slab.resolution.x * slab.resolution.y;
+        }
+
+        //! @brief To call once the slice given by getNextSlice() has been filled.
+        void pushSlice(int level) {
+            LevelSlab<voxel_t>& slab = this->levels[level];
+            slab.nbSlices += 1;
+            if(slab.nbSlices == this->brickSize || slab.firstSlice + slab.nbSlices == slab.resolution.z)
+                this->flush(level);
+        }
+
+        void flush(int level) {
+            LevelSlab<voxel_t>& slab = this->levels[level];
+            const int brickZ = slab.firstSlice / this->brickSize;
+            const int nbBricksInSlab = slab.nbBricks.x * slab.nbBricks.y;
+            const std::size_t brickVoxels = static_cast<std::size_t>(this->brickSize) * this->brickSize * this->brickSize;
+            std::vector<std::vector<unsigned char>> compressed(nbBricksInSlab);
+
+            #pragma omp parallel
+            {
+                std::vector<voxel_t> brick(brickVoxels);
+                #pragma omp for schedule(dynamic)
+                for(int b = 0; b < nbBricksInSlab; ++b) {
+                    const glm::ivec3 origin(b % slab.nbBricks.x * this->brickSize, b / slab.nbBricks.x * this->brickSize, 0);
+                    std::fill(brick.begin(), brick.end(), static_cast<voxel_t>(0));
+                    const int width = std::min(this->brickSize, slab.resolution.x - origin.x);
+                    const int height = std::min(this->brickSize, slab.resolution.y - origin.y);
+                    for(int k = 0; k < slab.nbSlices; ++k) {
+                        for(int j = 0; j < height; ++j) {
+                            const voxel_t * row = slab.values.data() + (static_cast<std::size_t>(k) * slab.resolution.y + origin.y + j) * slab.resolution.x + origin.x;
+                            std::copy(row, row + width, brick.data() + (static_cast<std::size_t>(k) * this->brickSize + j) * this->brickSize);
+                        }
+                    }
+                    uLongf compressedSize = compressBound(brickVoxels * sizeof(voxel_t));
+                    compressed[b].resize(compressedSize);
+                    compress2(compressed[b].data(), &compressedSize, reinterpret_cast<const Bytef*>(brick.data()), brickVoxels * sizeof(voxel_t), Z_BEST_SPEED);
+                    compressed[b].resize(compressedSize);
+                }
+            }
+
+            for(int b = 0; b < nbBricksInSlab; ++b) {
+                BrickVolume::BrickInfo& info = this->index[slab.firstBrick + static_cast<std::size_t>(brickZ) * nbBricksInSlab + b];
+                info.offset = static_cast<uint64_t>(this->file.tellp());
+                info.compressedSize = compressed[b].size();
+                this->file.write(reinterpret_cast<const char*>(compressed[b].data()), compressed[b].size());
+            }
+
+            if(level + 1 < this->levels.size())
+                this->downsample(level);
+
+            slab.firstSlice += slab.nbSlices;
+            slab.nbSlices = 0;
+        }
+
+        //! @brief Push the slab of the level, filtered with a 2x2x2 box, to the next level.
+        void downsample(int level) {
+            const LevelSlab<voxel_t>& slab = this->levels[level];
+            const glm::ivec3 nextResolution = this->levels[level + 1].resolution;
+            const int nbNextSlices = (slab.nbSlices + 1) / 2;
+            for(int k = 0; k < nbNextSlices; ++k) {
+                voxel_t * nextSlice = this->getNextSlice(level + 1);
+                const int z0 = 2 * k;
+                const int z1 = std::min(2 * k + 1, slab.nbSlices - 1);
+                #pragma omp parallel for schedule(static)
+                for(int j = 0; j < nextResolution.y; ++j) {
+                    const int y0 = 2 * j;
+                    const int y1 = std::min(2 * j + 1, slab.resolution.y - 1);
+                    for(int i = 0; i < nextResolution.x; ++i) {
+                        const int x0 = 2 * i;
+                        const int x1 = std::min(2 * i + 1, slab.resolution.x - 1);
+                        double sum = 0.;
+                        for(int z : {z0, z1})
+                            for(int y : {y0, y1})
+                                for(int x : {x0, x1})
+                                    sum += slab.values[(static_cast<std::size_t>(z) * slab.resolution.y + y) * slab.resolution.x + x];
+                        if constexpr (std::is_integral<voxel_t>::value)
+                            nextSlice[static_cast<std::size_t>(j) * nextResolution.x + i] = static_cast<voxel_t>(sum / 8. + .5);
+                        else
+                            nextSlice[static_cast<std::size_t>(j) * nextResolution.x + i] = static_cast<voxel_t>(sum / 8.);
+                    }
+                }
+                this->pushSlice(level + 1);
+            }
+        }
+    };
+
+    template<typename voxel_t>
+    bool writeTemplated(ImageReader& image, std::ofstream& file, BrickVolume::Header& header) {
+        const glm::ivec3 resolution(header.resolution[0], header.resolution[1], header.resolution[2]);
+        BrickWriter<voxel_t> writer(file, resolution, header.brickSize, header.nbLevels);
+
+        // The index is written once all the bricks are known
+        const std::streampos indexPosition = file.tellp();
+        file.write(reinterpret_cast<const char*>(writer.index.data()), writer.index.size() * sizeof(BrickVolume::BrickInfo));
+
+        const std::pair<glm::vec3, glm::vec3> bboxes{glm::vec3(0., 0., 0.), glm::vec3(resolution)};
+        const std::size_t sliceSize = static_cast<std::size_t>(resolution.x) * resolution.y;
+        const int nbThreads = std::max(1, std::min(omp_get_max_threads(), static_cast<int>(header.brickSize)));
+        image.setNbThreads(nbThreads);
+        for(int firstSlice = 0; firstSlice < resolution.z; firstSlice += header.brickSize) {
+            std::cout << "Write bricks of slices [" << firstSlice << "/" << resolution.z << "]" << std::endl;
+            const int nbSlices = std::min(static_cast<int>(header.brickSize), resolution.z - firstSlice);
+            voxel_t * slab = writer.getNextSlice(0);
+            #pragma omp parallel num_threads(nbThreads)
+            {
+                const int threadIdx = omp_get_thread_num();
+                std::vector<voxel_t> slice;
+                slice.reserve(sliceSize);
+                #pragma omp for schedule(static)
+                for(int k = 0; k < nbSlices; ++k) {
+                    slice.clear();
+                    image.getSlice(firstSlice + k, slice, 1, {1, 1}, bboxes, threadIdx);
+                    std::copy(slice.begin(), slice.end(), slab + k * sliceSize);
+                }
+            }
+            for(int k = 0; k < nbSlices; ++k)
+                writer.pushSlice(0);
+        }
+        image.setNbThreads(1);
+
+        file.seekp(indexPosition);
+        file.write(reinterpret_cast<const char*>(writer.index.data()), writer.index.size() * sizeof(BrickVolume::BrickInfo));
+        return file.good();
+    }
+}
+
+bool BrickVolume::write(ImageReader& image, const std::string& filename, int brickSize, int nbLevels) {
+    const glm::ivec3 resolution = image.imgResolution;
+    if(nbLevels <= 0) {
+        nbLevels = 1;
+        while(glm::any(glm::greaterThan(getLevelResolution(resolution, nbLevels - 1), glm::ivec3(brickSize))))
+            nbLevels += 1;
+    }
+
+    Header header;
+    std::memcpy(header.magic, "BVOL", 4);
+    header.version = VERSION;
+    for(int i = 0; i < 3; ++i) {
+        header.resolution[i] = resolution[i];
+        header.voxelSize[i] = image.voxelSize[i];
+    }
+    header.brickSize = brickSize;
+    header.nbLevels = nbLevels;
+    header.storageType = Cache::getStorageType(image.getInternalDataType());
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()) {
+        std::cerr << "Error: unable to open [" << filename << "] for writing" << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+    std::cout << "Convert image to bricked volume [" << filename << "] with [" << nbLevels << "] levels" << std::endl;
+    bool success = false;
+    if(header.storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+        success = writeTemplated<uint8_t>(image, file, header);
+    } else if(header.storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+        success = writeTemplated<float>(image, file, header);
+    } else {
+        success = writeTemplated<uint16_t>(image, file, header);
+    }
+    if(!success)
+        std::cerr << "Error: failed to write [" << filename << "]" << std::endl;
+    return success;
+}
+
+/***/
+
+BrickVolumeReader::BrickVolumeReader(const std::string& filename, std::size_t cacheCapacity): cacheCapacity(cacheCapacity) {
+    if(!this->file.open(filename) || this->file.size < sizeof(BrickVolume::Header)) {
+        std::cerr << "Error: unable to open [" << filename << "]" << std::endl;
+        this->file.close();
+        return;
+    }
+    std::memcpy(&this->header, this->file.data, sizeof(BrickVolume::Header));
+    if(std::strncmp(this->header.magic, "BVOL", 4) != 0 || this->header.version != BrickVolume::VERSION) {
+        std::cerr << "Error: [" << filename << "] is not a bricked volume, or its version is not supported" << std::endl;
+        this->file.close();
+        return;
+    }
+
+    const glm::ivec3 resolution(this->header.resolution[0], this->header.resolution[1], this->header.resolution[2]);
+    std::size_t nbBricks = 0;
+    for(int level = 0; level < this->header.nbLevels; ++level) {
+        this->levelFirstBrick.push_back(nbBricks);
+        const glm::ivec3 levelNbBricks = BrickVolume::getNbBricks(BrickVolume::getLevelResolution(resolution, level), this->header.brickSize);
+        nbBricks += static_cast<std::size_t>(levelNbBricks.x) * levelNbBricks.y * levelNbBricks.z;
+    }
+    if(this->file.size < sizeof(BrickVolume::Header) + nbBricks * sizeof(BrickVolume::BrickInfo)) {
+        std::cerr << "Error: [" << filename << "] is truncated" << std::endl;
+        this->file.close();
+        return;
+    }
+    this->index.resize(nbBricks);
+    std::memcpy(this->index.data(), this->file.data + sizeof(BrickVolume::Header), nbBricks * sizeof(BrickVolume::BrickInfo));
+
+    this->imgDataType = static_cast<Image::ImageDataType>(this->header.storageType);
+    this->bytesPerVoxel = (this->imgDataType & Image::ImageDataType::Bit_8) ? 1 : ((this->imgDataType & Image::ImageDataType::Floating) ? 4 : 2);
+    this->brickBytes = static_cast<std::size_t>(this->header.brickSize) * this->header.brickSize * this->header.brickSize * this->bytesPerVoxel;
+    this->imgResolution = glm::vec3(resolution);
+    this->voxelSize = glm::vec3(this->header.voxelSize[0], this->header.voxelSize[1], this->header.voxelSize[2]);
+}
+
+glm::ivec3 BrickVolumeReader::getLevelResolution(int level) const {
+    return BrickVolume::getLevelResolution(glm::ivec3(this->imgResolution), level);
+}
+
+bool BrickVolumeReader::decompressBrick(std::size_t brickIdx, std::vector<unsigned char>& result) const {
+    const BrickVolume::BrickInfo& info = this->index[brickIdx];
+    result.resize(this->brickBytes);
+    uLongf size = this->brickBytes;
+    if(info.offset + info.compressedSize > this->file.size ||
+       uncompress(result.data(), &size, this->file.data + info.offset, info.compressedSize) != Z_OK || size != this->brickBytes) {
+        std::cerr << "Error: corrupted brick [" << brickIdx << "]" << std::endl;
+        std::fill(result.begin(), result.end(), 0);
+        return false;
+    }
+    return true;
+}
+
+BrickVolumeReader::Brick BrickVolumeReader::getBrick(std::size_t brickIdx) const {
+    {
+        std::lock_guard<std::mutex> lock(this->cacheMutex);
+        auto it = this->cachedBricks.find(brickIdx);
+        if(it != this->cachedBricks.end()) {
+            this->usedBricks.splice(this->usedBricks.begin(), this->usedBricks, it->second.first);
+            return it->second.second;
+        }
+    }
+
+    // Decompression is done without the lock to allow several threads to page in bricks at the same time
+    std::shared_ptr<std::vector<unsigned char>> brick = std::make_shared<std::vector<unsigned char>>();
+    this->decompressBrick(brickIdx, *brick);
+
+    std::lock_guard<std::mutex> lock(this->cacheMutex);
+    auto it = this->cachedBricks.find(brickIdx);
+    if(it != this->cachedBricks.end())
+        return it->second.second;
+    this->usedBricks.push_front(brickIdx);
+    this->cachedBricks[brickIdx] = std::make_pair(this->usedBricks.begin(), brick);
+    const std::size_t capacity = std::max<std::size_t>(1, this->cacheCapacity / this->brickBytes);
+    while(this->cachedBricks.size() > capacity) {
+        this->cachedBricks.erase(this->usedBricks.back());
+        this->usedBricks.pop_back();
+    }
+    return brick;
+}
+
+std::size_t BrickVolumeReader::getBrickIdx(const glm::ivec3& p, int level) const {
+    const glm::ivec3 nbBricks = BrickVolume::getNbBricks(this->getLevelResolution(level), this->header.brickSize);
+    const glm::ivec3 brick = p / static_cast<int>(this->header.brickSize);
+    return this->levelFirstBrick[level] + (static_cast<std::size_t>(brick.z) * nbBricks.y + brick.y) * nbBricks.x + brick.x;
+}
+
+float BrickVolumeReader::readVoxel(const unsigned char * brick, std::size_t idx) const {
+    if(this->bytesPerVoxel == 1)
+        return brick[idx];
+    if(this->bytesPerVoxel == 2) {
+        uint16_t value;
+        std::memcpy(&value, brick + idx * 2, 2);
+        return value;
+    }
+    float value;
+    std::memcpy(&value, brick + idx * 4, 4);
+    return value;
+}
+
+float BrickVolumeReader::getVoxel(const glm::ivec3& p, int level) const {
+    const glm::ivec3 resolution = this->getLevelResolution(level);
+    if(p.x < 0 || p.y < 0 || p.z < 0 || p.x >= resolution.x || p.y >= resolution.y || p.z >= resolution.z)
+        return 0.f;
+    const int brickSize = this->header.brickSize;
+    const glm::ivec3 local = p % brickSize;
+    return this->readVoxel(this->getBrick(this->getBrickIdx(p, level))->data(), (static_cast<std::size_t>(local.z) * brickSize + local.y) * brickSize + local.x);
+}
+
+uint16_t BrickVolumeReader::getValue(const glm::vec3& coord) const {
+    return static_cast<uint16_t>(this->getVoxel(glm::ivec3(glm::floor(coord)), 0));
+}
+
+float BrickVolumeReader::getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod, int level) const {
+    const glm::ivec3 resolution = this->getLevelResolution(level);
+    if(coord[0]<0 || coord[1]<0 || coord[2]<0 || coord[0]>=resolution.x || coord[1]>=resolution.y || coord[2]>=resolution.z) return 0.f;
+
+    // Neighbors are usually in the same brick, so the last brick is kept to avoid locking the cache for each of them
+    const int brickSize = this->header.brickSize;
+    std::size_t lastBrickIdx = this->index.size();
+    Brick lastBrick;
+    auto fetch = [&](const glm::ivec3& p) -> float {
+        if(p.x < 0 || p.y < 0 || p.z < 0 || p.x >= resolution.x || p.y >= resolution.y || p.z >= resolution.z)
+            return 0.f;
+        const std::size_t brickIdx = this->getBrickIdx(p, level);
+        if(brickIdx != lastBrickIdx) {
+            lastBrick = this->getBrick(brickIdx);
+            lastBrickIdx = brickIdx;
+        }
+        const glm::ivec3 local = p % brickSize;
+        return this->readVoxel(lastBrick->data(), (static_cast<std::size_t>(local.z) * brickSize + local.y) * brickSize + local.x);
+    };
+
+    const glm::ivec3 p0(glm::floor(coord));
+    if(interpolationMethod == Interpolation::Method::NearestNeighbor)
+        return fetch(p0);
+
+    const glm::vec3 d = coord - glm::vec3(p0);
+    if(interpolationMethod == Interpolation::Method::Linear) {
+        float value = 0.f;
+        for(int k = 0; k < 2; ++k)
+            for(int j = 0; j < 2; ++j)
+                for(int i = 0; i < 2; ++i)
+                    value += fetch(p0 + glm::ivec3(i, j, k)) * (i ? d.x : 1.f - d.x) * (j ? d.y : 1.f - d.y) * (k ? d.z : 1.f - d.z);
+        return value;
+    }
+
+    // Catmull-Rom spline, as CImg::cubic_atXYZ_c() used by TypedCache
+    auto cubic = [](float p0, float p1, float p2, float p3, float t) {
+        return p1 + 0.5f * (t * (p2 - p0) + t * t * (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) + t * t * t * (-p0 + 3.f * p1 - 3.f * p2 + p3));
+    };
+    float planes[4];
+    for(int k = 0; k < 4; ++k) {
+        float rows[4];
+        for(int j = 0; j < 4; ++j) {
+            float values[4];
+            for(int i = 0; i < 4; ++i)
+                values[i] = fetch(p0 + glm::ivec3(i - 1, j - 1, k - 1));
+            rows[j] = cubic(values[0], values[1], values[2], values[3], d.x);
+        }
+        planes[k] = cubic(rows[0], rows[1], rows[2], rows[3], d.y);
+    }
+    const float value = cubic(planes[0], planes[1], planes[2], planes[3], d.z);
+    // The result is clamped to the range of the stored type
+    if(this->bytesPerVoxel == 1)
+        return std::min(std::max(value, 0.f), 255.f);
+    if(this->bytesPerVoxel == 2)
+        return std::min(std::max(value, 0.f), 65535.f);
+    return value;
+}
+
+template<typename out_t>
+void BrickVolumeReader::getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx) const {
+    const int brickSize = this->header.brickSize;
+    const glm::ivec2 first(bboxes.first[0], bboxes.first[1]);
+    const glm::ivec2 last(std::min<int>(bboxes.second[0], this->imgResolution[0]), std::min<int>(bboxes.second[1], this->imgResolution[1]));
+    const glm::ivec2 stride(offsets.first, offsets.second);
+    const int rowSize = Convert::getNbValues(first.x, bboxes.second[0], stride.x) * nbChannel;
+    const int nbRows = Convert::getNbValues(first.y, bboxes.second[1], stride.y);
+    const std::size_t insertIdx = result.size();
+    result.resize(insertIdx + static_cast<std::size_t>(rowSize) * nbRows, 0);
+
+    // First coordinate kept by the stride in [begin, end[
+    auto firstKept = [](int begin, int origin, int stride) {
+        return (begin <= origin) ? origin : origin + ((begin - origin + stride - 1) / stride) * stride;
+    };
+
+    // Each brick crossed by the slice is fetched once
+    const int z = sliceIdx % brickSize;
+    for(int brickY = first.y / brickSize * brickSize; brickY < last.y; brickY += brickSize) {
+        for(int brickX = first.x / brickSize * brickSize; brickX < last.x; brickX += brickSize) {
+            const Brick brick = this->getBrick(this->getBrickIdx(glm::ivec3(brickX, brickY, sliceIdx), 0));
+            const int yEnd = std::min(brickY + brickSize, last.y);
+            const int xEnd = std::min(brickX + brickSize, last.x);
+            for(int y = firstKept(brickY, first.y, stride.y); y < yEnd; y += stride.y) {
+                out_t * row = result.data() + insertIdx + static_cast<std::size_t>((y - first.y) / stride.y) * rowSize;
+                const std::size_t brickRow = (static_cast<std::size_t>(z) * brickSize + (y - brickY)) * brickSize;
+                for(int x = firstKept(brickX, first.x, stride.x); x < xEnd; x += stride.x) {
+                    const out_t value = static_cast<out_t>(this->readVoxel(brick->data(), brickRow + (x - brickX)));
+                    std::fill_n(row + ((x - first.x) / stride.x) * nbChannel, nbChannel, value);
+                }
+            }
+        }
+    }
+}
+
+template void BrickVolumeReader::getSlice<uint8_t>(int, std::vector<uint8_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<uint16_t>(int, std::vector<uint16_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<float>(int, std::vector<float>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<uint32_t>(int, std::vector<uint32_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<uint64_t>(int, std::vector<uint64_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<int8_t>(int, std::vector<int8_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<int16_t>(int, std::vector<int16_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<int32_t>(int, std::vector<int32_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<int64_t>(int, std::vector<int64_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void BrickVolumeReader::getSlice<double>(int, std::vector<double>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+
+Statistics BrickVolumeReader::computeStatistics(const ValueMapping& mapping) const {
+    const int brickSize = this->header.brickSize;
+    const glm::ivec3 resolution(this->imgResolution);
+    const glm::ivec3 nbBricks = BrickVolume::getNbBricks(resolution, brickSize);
+    const int nbLevelBricks = nbBricks.x * nbBricks.y * nbBricks.z;
+    Statistics statistics(mapping);
+
+    #pragma omp parallel
+    {
+        Statistics localStatistics(mapping);
+        std::vector<unsigned char> brick;
+        std::vector<float> row(brickSize);
+        #pragma omp for schedule(dynamic)
+        for(int b = 0; b < nbLevelBricks; ++b) {
+            this->decompressBrick(this->levelFirstBrick[0] + b, brick);
+            const glm::ivec3 origin = glm::ivec3(b % nbBricks.x, (b / nbBricks.x) % nbBricks.y, b / (nbBricks.x * nbBricks.y)) * brickSize;
+            const glm::ivec3 size = glm::min(glm::ivec3(brickSize), resolution - origin);
+            // The padding of the border bricks is not part of the image
+            for(int k = 0; k < size.z; ++k) {
+                for(int j = 0; j < size.y; ++j) {
+                    for(int i = 0; i < size.x; ++i)
+                        row[i] = this->readVoxel(brick.data(), (static_cast<std::size_t>(k) * brickSize + j) * brickSize + i);
+                    localStatistics.add(row.data(), size.x);
+                }
+            }
+        }
+        #pragma omp critical
+        statistics.merge(localStatistics);
+    }
+    return statistics;
+}
+
+/***/
+
+PagedCache::PagedCache(const BrickVolumeReader * reader, const glm::vec3& resolutionRatio): reader(reader), level(0), coordScale(resolutionRatio) {
+    // Use the pyramid level matching the resolution ratio when there is one
+    if(resolutionRatio.x == resolutionRatio.y && resolutionRatio.y == resolutionRatio.z) {
+        const int ratio = static_cast<int>(resolutionRatio.x);
+        int level = 0;
+        while((1 << (level + 1)) <= ratio && ratio % (1 << (level + 1)) == 0 && level + 1 < reader->getNbLevels())
+            level += 1;
+        this->level = level;
+        this->coordScale = resolutionRatio / static_cast<float>(1 << level);
+    }
+    std::cout << "Read bricks from level [" << this->level << "]" << std::endl;
+}
@@ -0,0 +1,149 @@
+#ifndef BRICK_VOLUME_HPP_
+#define BRICK_VOLUME_HPP_
+
+#include "cache.hpp"
+#include "mapped_file.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Default number of voxels along each side of a brick.
+#define BRICK_SIZE 64
+//! @brief Default memory budget, in bytes, of the decompressed bricks kept by a BrickVolumeReader.
+#define BRICK_CACHE_CAPACITY (std::size_t(1) << 30)
+
+struct ImageReader;
+
+//! @brief Chunked volume format (.bvol) allowing to work on images bigger than the RAM.
+//!
+//! The file starts with a Header, followed by the BrickInfo index of every brick of every level, followed by the bricks.
+//! A brick is a cube of brickSize^3 voxels stored with the Cache storage type and compressed with zlib, bricks on the
+//! image borders are padded with zeros.
+//! Level 0 is the full resolution image, each level halves the resolution of the previous one with a 2x2x2 box filter.
+//! In each level the bricks are sorted along x, then y, then z.
+namespace BrickVolume {
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t resolution[3];
+        float voxelSize[3];
+        uint32_t brickSize;
+        uint32_t nbLevels;
+        uint32_t storageType;
+    };
+
+    struct BrickInfo {
+        uint64_t offset;
+        uint64_t compressedSize;
+    };
+
+    const uint32_t VERSION = 1;
+
+    glm::ivec3 getLevelResolution(const glm::ivec3& resolution, int level);
+    glm::ivec3 getNbBricks(const glm::ivec3& levelResolution, int brickSize);
+
+    //! @brief Convert any image to the .bvol format.
+    //! The source is read once, brickSize slices at a time, so the whole image is never loaded in memory.
+    //! @param nbLevels Number of levels of the pyramid, 0 to add levels until the whole image fits in a single brick.
+    bool write(ImageReader& image, const std::string& filename, int brickSize = BRICK_SIZE, int nbLevels = 0);
+}
+
+//! @brief Read a .bvol file. Bricks are decompressed on demand and the last used ones are kept in a LRU cache bounded by cacheCapacity bytes.
+//! All the functions can be called from several threads at the same time.
+struct BrickVolumeReader {
+
+    glm::vec3 voxelSize;
+    glm::vec3 imgResolution;
+    Image::ImageDataType imgDataType;
+
+    BrickVolumeReader(const std::string& filename, std::size_t cacheCapacity = BRICK_CACHE_CAPACITY);
+
+    bool isValid() const { return this->file.isOpen(); }
+
+    int getNbLevels() const { return this->header.nbLevels; }
+    glm::ivec3 getLevelResolution(int level) const;
+
+    Image::ImageDataType getInternalDataType() const { return this->imgDataType; }
+
+    //! @brief Value of the voxel p of the level, 0 outside the image.
+    float getVoxel(const glm::ivec3& p, int level) const;
+
+    //! @brief Value at full resolution using nearest neighbor interpolation.
+    uint16_t getValue(const glm::vec3& coord) const;
+
+    //! @brief Value at coord, expressed in voxels of the level.
+    float getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod, int level) const;
+
+    //! @brief See ImageReader::getSlice(), the slice is read from the full resolution level.
+    //! Instantiated for uint8_t, uint16_t and float, the types used by Cache, and for the other types ImageReader::getImage() can return.
+    template<typename out_t>
+    void getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx = 0) const;
+
+    //! @brief See Cache::computeStatistics(), computed on the full resolution level without using the bricks cache.
+    Statistics computeStatistics(const ValueMapping& mapping = ValueMapping()) const;
+
+private:
+    typedef std::shared_ptr<const std::vector<unsigned char>> Brick;
+
+    MappedFile file;
+    BrickVolume::Header header;
+    std::vector<BrickVolume::BrickInfo> index;
+    //! @brief Index of the first brick of each level in index.
+    std::vector<std::size_t> levelFirstBrick;
+    std::size_t bytesPerVoxel;
+    std::size_t brickBytes;
+
+    std::size_t cacheCapacity;
+    mutable std::mutex cacheMutex;
+    //! @brief Brick indices, the most recently used first.
+    mutable std::list<std::size_t> usedBricks;
+    mutable std::unordered_map<std::size_t, std::pair<std::list<std::size_t>::iterator, Brick>> cachedBricks;
+
+    bool decompressBrick(std::size_t brickIdx, std::vector<unsigned char>& result) const;
+    Brick getBrick(std::size_t brickIdx) const;
+    std::size_t getBrickIdx(const glm::ivec3& p, int level) const;
+    float readVoxel(const unsigned char * brick, std::size_t idx) const;
+};
+
+//! @brief Cache backend for Sampler which reads the values from a BrickVolumeReader instead of loading the whole image.
+//! When the resolution ratio of the sampler is a power of 2 the matching level of the pyramid is used.
+struct PagedCache : public Cache {
+    const BrickVolumeReader * reader;
+    int level;
+    //! @brief Scale from the sampler space to the voxels of the level.
+    glm::vec3 coordScale;
+
+    PagedCache(const BrickVolumeReader * reader, const glm::vec3& resolutionRatio);
+
+    Image::ImageDataType getStorageType() const override {
+        return this->reader->getInternalDataType();
+    }
+
+    int getNbChannels() const override {
+        return 1;
+    }
+
+    void reset() override {}
+
+    //! @brief The bricks are read on demand, there is no volume of coefficients for CubicBSpline, see Cache::getSupportedInterpolation().
+    float getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) const override {
+        return this->reader->getValue(coord * this->coordScale, this->getInterpolation(interpolationMethod), this->level);
+    }
+
+    Statistics computeStatistics(const ValueMapping& mapping = ValueMapping()) const override {
+        return this->reader->computeStatistics(mapping);
+    }
+};
+
+//! @}
+
+#endif
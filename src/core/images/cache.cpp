@@ -1,10 +1,16 @@
 #include "cache.hpp"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
 
 Interpolation::Method Interpolation::fromString(const std::string& method) {
     if(method == "Linear")
         return Method::Linear;
     if(method == "Cubic")
         return Method::Cubic;
+    if(method == "CubicBSpline")
+        return Method::CubicBSpline;
     return Method::NearestNeighbor;
 }
 
@@ -13,76 +19,166 @@ std::string Interpolation::toString(const Interpolation::Method& method) {
         return "Linear";
     if(method == Method::Cubic)
         return "Cubic";
+    if(method == Method::CubicBSpline)
+        return "CubicBSpline";
     return "NearestNeighbor";
 }
 
 std::vector<std::string> Interpolation::toStringList() {
-    return {"NearestNeighbor", "Linear", "Cubic"};
+    return {"NearestNeighbor", "Linear", "Cubic", "CubicBSpline"};
 }
 
-/************************************/
-
-Cache::Cache(glm::vec3 imageSize): img(CImg<uint16_t>(imageSize[0], imageSize[1], imageSize[2], 1, 0)) {}
-
-void Cache::reset() {
-    //this->img.assign(this->img.width(), this->img.height(), this->img.depth(), 0);
-    this->img = CImg<uint16_t>(this->img.width(), this->img.height(), this->img.depth(), 1, 0);
+Interpolation::Method Cache::getInterpolation(Interpolation::Method interpolationMethod) const {
+    const Interpolation::Method supported = this->getSupportedInterpolation(interpolationMethod);
+    if(supported != interpolationMethod && !this->hasWarnedInterpolation.exchange(true))
+        std::cerr << "WARNING: the " << Interpolation::toString(interpolationMethod) << " interpolation is not available for this image, the " << Interpolation::toString(supported) << " one is used instead" << std::endl;
+    return supported;
 }
 
-void Cache::storeImage(int imageIdx, const std::vector<uint16_t>& data) {
-    this->img.get_shared_slice(imageIdx).assign(data.data(), this->img.width(), this->img.height(), 1.);
+namespace {
+    //! @brief In-place cubic B-spline prefilter of a line, see M. Unser, "Splines: a perfect fit for signal and image processing", 1999.
+    void prefilterLine(std::vector<double>& c) {
+        const int n = static_cast<int>(c.size());
+        if(n < 2)
+            return;
+        const double z = std::sqrt(3.) - 2.;
+        const double lambda = (1. - z) * (1. - 1. / z);
+        for(double& value : c)
+            value *= lambda;
+
+        // Causal initialization with mirror boundaries, truncated when the powers of z are negligible
+        const int horizon = static_cast<int>(std::ceil(std::log(1e-9) / std::log(std::fabs(z))));
+        if(horizon < n) {
+            double zn = z;
+            double sum = c[0];
+            for(int k = 1; k < horizon; ++k) {
+                sum += zn * c[k];
+                zn *= z;
+            }
+            c[0] = sum;
+        } else {
+            double zn = z;
+            const double iz = 1. / z;
+            double z2n = std::pow(z, n - 1);
+            double sum = c[0] + z2n * c[n - 1];
+            z2n *= z2n * iz;
+            for(int k = 1; k < n - 1; ++k) {
+                sum += (zn + z2n) * c[k];
+                zn *= z;
+                z2n *= iz;
+            }
+            c[0] = sum / (1. - zn * zn);
+        }
+        for(int k = 1; k < n; ++k)
+            c[k] += z * c[k - 1];
+        c[n - 1] = (z / (z * z - 1.)) * (z * c[n - 2] + c[n - 1]);
+        for(int k = n - 2; k >= 0; --k)
+            c[k] = z * (c[k + 1] - c[k]);
+    }
 }
 
-uint16_t Cache::getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) {
-    if(coord[0]<0 || coord[1]<0 || coord[2]<0 || coord[0]>=this->img.width() || coord[1]>=this->img.height() || coord[2]>=this->img.depth()) return static_cast<uint16_t>(0);
-    if(interpolationMethod == Interpolation::Method::Linear) {
-        return static_cast<uint16_t>(this->img.linear_atXYZ(coord[0], coord[1], coord[2], 0, static_cast<uint16_t>(0)));
-    } else if (interpolationMethod == Interpolation::Method::Cubic) {
-        return static_cast<uint16_t>(this->img.cubic_atXYZ_c(coord[0], coord[1], coord[2], 0, static_cast<uint16_t>(0)));
-    } else {
-        return static_cast<uint16_t>(this->img.atXYZ(coord[0], coord[1], coord[2]));
+void Interpolation::prefilterBSpline(float * data, const Volume<float>& volume) {
+    const glm::ivec3 dimension(volume.width, volume.height, volume.depth);
+    for(int axis = 0; axis < 3; ++axis) {
+        const int axisU = (axis == 0) ? 1 : 0;
+        const int axisV = (axis == 2) ? 1 : 2;
+        std::vector<std::ptrdiff_t> offsets(dimension[axis]);
+        for(int i = 0; i < dimension[axis]; ++i)
+            offsets[i] = volume.getOffset(axis, i);
+        const int nbLines = dimension[axisU] * dimension[axisV];
+        #pragma omp parallel
+        {
+            std::vector<double> line(dimension[axis]);
+            #pragma omp for schedule(static)
+            for(int l = 0; l < nbLines; ++l) {
+                float * first = data + volume.getOffset(axisU, l % dimension[axisU]) + volume.getOffset(axisV, l / dimension[axisU]);
+                for(int i = 0; i < dimension[axis]; ++i)
+                    line[i] = first[offsets[i]];
+                prefilterLine(line);
+                for(int i = 0; i < dimension[axis]; ++i)
+                    first[offsets[i]] = static_cast<float>(line[i]);
+            }
+        }
     }
 }
 
 /************************************/
 
-//Cache::Cache(TIFF * tiff, glm::vec3 imageSize, Image::ImageDataType imageDataType, int capacity = 3): tif(tiff), imageSize(imageSize), capacity(capacity), imgDataType(imageDataType), nbInsertion(0), data(std::vector<std::vector<std::vector<uint16_t>>>(this->capacity, std::vector<std::vector<uint16_t>>(this->imageSize[0], std::vector<uint16_t>(this->imageSize[1], 0)))), indices(std::vector<int>(this->capacity, -1)) {}
-UnsortedCache::UnsortedCache(glm::vec3 imageSize, int capacity = 3): imageSize(imageSize), capacity(capacity), nbInsertion(0), data(std::vector<std::vector<uint16_t>>(this->capacity, std::vector<uint16_t>())), indices(std::vector<int>(this->capacity, -1)) {}
-
-uint16_t UnsortedCache::getValue(const glm::vec3& coord) {
-    return this->data[this->getCachedIdx(coord[2])][coord[1]*this->imageSize[0]+coord[0]];
-}
-
-int UnsortedCache::getCachedIdx(int imageIdx) const {
-    if(!this->isCached(imageIdx)) {
-        std::cout << "ERROR: try to load an imahe that is not in cache !" << std::endl;
-        return -1;
-    }
-    auto it = std::find(this->indices.begin(), this->indices.end(), imageIdx);
-    return std::distance(this->indices.begin(), it);
+Image::ImageDataType Cache::getStorageType(Image::ImageDataType imgDataType) {
+    if(imgDataType & Image::ImageDataType::Floating)
+        return Image::ImageDataType::Floating | Image::ImageDataType::Bit_32;
+    if(imgDataType & Image::ImageDataType::Bit_8)
+        return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8;
+    return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16;
 }
 
-bool UnsortedCache::isCached(int imageIdx) const {
-    return (std::find(this->indices.begin(), this->indices.end(), imageIdx) != this->indices.end());
+Cache * Cache::create(glm::vec3 imageSize, Image::ImageDataType imgDataType, int nbChannels, int brickSize) {
+    const Image::ImageDataType storageType = getStorageType(imgDataType);
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8))
+        return new TypedCache<uint8_t>(imageSize, nbChannels, brickSize);
+    if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32))
+        return new TypedCache<float>(imageSize, nbChannels, brickSize);
+    return new TypedCache<uint16_t>(imageSize, nbChannels, brickSize);
 }
 
-std::vector<uint16_t> * UnsortedCache::storeImage(int imageIdx) {
-    std::pair<glm::vec3, glm::vec3> bboxes{glm::vec3(0., 0., 0.), glm::vec3(this->imageSize)};
-
-    int nextImageToReplace = this->getNextCachedImageToReplace();
-    indices[nextImageToReplace] = imageIdx;
-    this->data[nextImageToReplace].clear();
-    this->nbInsertion += 1;
-    return &this->data[nextImageToReplace];
-}
-
-int UnsortedCache::getNextCachedImageToReplace() const {
-    return this->nbInsertion % this->capacity;
-}
+/************************************/
 
-void UnsortedCache::setCapacity(int capacity) {
-    this->capacity = capacity;
-    this->data = std::vector<std::vector<uint16_t>>(this->capacity, std::vector<uint16_t>());
-    this->indices = std::vector<int>(this->capacity, -1);
+void benchmarkCacheLayouts(const glm::ivec3& imageSize, const std::vector<int>& brickSizes, Interpolation::Method interpolationMethod) {
+    const int nbSlices = 16;
+    const glm::vec3 center = glm::vec3(imageSize) / 2.f;
+    const float extent = static_cast<float>(std::min(imageSize.x, std::min(imageSize.y, imageSize.z)));
+
+    // Pixel centers of nbSlices slices orthogonal to normal around the center of the volume, with one sample per voxel
+    auto getCoordinates = [&](const glm::vec3& normal, const glm::vec3& u, const glm::vec3& v, const glm::ivec2& size) {
+        std::vector<glm::vec3> coords;
+        coords.reserve(static_cast<std::size_t>(size.x) * size.y * nbSlices);
+        for(int k = 0; k < nbSlices; ++k) {
+            const glm::vec3 origin = center + normal * ((k + .5f) / nbSlices - .5f) * extent;
+            for(int j = 0; j < size.y; ++j)
+                for(int i = 0; i < size.x; ++i)
+                    coords.push_back(origin + u * (i + .5f - size.x / 2.f) + v * (j + .5f - size.y / 2.f));
+        }
+        return coords;
+    };
+    const std::vector<std::string> names{"YZ", "XZ", "XY", "Oblique"};
+    const std::vector<std::vector<glm::vec3>> planes{
+        getCoordinates(glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1), glm::ivec2(imageSize.y, imageSize.z)),
+        getCoordinates(glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::ivec2(imageSize.x, imageSize.z)),
+        getCoordinates(glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::ivec2(imageSize.x, imageSize.y)),
+        getCoordinates(glm::normalize(glm::vec3(1, 1, 1)), glm::normalize(glm::vec3(1, -1, 0)), glm::normalize(glm::vec3(1, 1, -2)), glm::ivec2(extent, extent))
+    };
+
+    std::cout << "Benchmark of the cache layouts on " << imageSize.x << "x" << imageSize.y << "x" << imageSize.z << " voxels, [" << Interpolation::toString(interpolationMethod) << "] interpolation, in millions of samples per second" << std::endl;
+    for(int brickSize : brickSizes) {
+        TypedCache<uint16_t> cache(imageSize, 1, brickSize);
+        std::vector<uint16_t> slice(static_cast<std::size_t>(imageSize.x) * imageSize.y);
+        for(int z = 0; z < imageSize.z; ++z) {
+            for(std::size_t i = 0; i < slice.size(); ++i)
+                slice[i] = static_cast<uint16_t>((i * 31 + z * 17) % 4096);
+            cache.storeImage(z, slice);
+        }
+
+        std::cout << (brickSize > 0 ? "Bricks " + std::to_string(brickSize) + "^3" : std::string("Plain")) << ":";
+        for(int p = 0; p < planes.size(); ++p) {
+            std::vector<float> result(planes[p].size());
+            const auto start = std::chrono::steady_clock::now();
+            #pragma omp parallel for schedule(static)
+            for(int k = 0; k < nbSlices; ++k) {
+                const std::size_t sliceSize = planes[p].size() / nbSlices;
+                cache.getValues(planes[p].data() + k * sliceSize, sliceSize, result.data() + k * sliceSize, interpolationMethod);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << " " << names[p] << " " << std::fixed << std::setprecision(1) << planes[p].size() / elapsed.count() / 1e6;
+        }
+        std::cout << " | extraction:";
+        for(int axis = 0; axis < 3; ++axis) {
+            std::vector<uint16_t> values;
+            const auto start = std::chrono::steady_clock::now();
+            for(int k = 0; k < nbSlices; ++k)
+                cache.getAxisSlice(axis, (k * imageSize[axis]) / nbSlices, values);
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << " " << names[axis] << " " << values.size() / elapsed.count() / 1e6;
+        }
+        std::cout << std::endl;
+    }
 }
-
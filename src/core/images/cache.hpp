@@ -2,63 +2,313 @@
 #define CACHE_HPP_
 
 #include "../../legacy/image/utils/include/image_api_common.hpp"
+#include "convert.hpp"
+#include "interpolation.hpp"
+#include "statistics.hpp"
 #define cimg_display 0
 #include "../../third_party/cimg/CImg.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 //! \addtogroup img
 //! @{
 
-namespace Interpolation {
-
-    enum class Method {
-        NearestNeighbor,
-        Linear,
-        Cubic
-    };
-
-    Method fromString(const std::string& method);
-    std::string toString(const Interpolation::Method& method);
-    std::vector<std::string> toStringList();
-}
+//! @brief Maximum size in megabytes of the volume of coefficients of the CubicBSpline interpolation, see TypedCache.
+//! The coefficients are stored as float, so they take 4 times the memory of an uint8 cache.
+//! A larger cache samples with the Cubic interpolation instead.
+#define BSPLINE_COEFFICIENTS_BUDGET_MB 2048
 
 using namespace cimg_library;
 
 //! @brief Store an image into a CImg structure. Storing the image in a CImg allows access to many features, like interpolation.
+//! The values are stored with the type returned by getStorageType(), which is chosen once when the image is opened.
+//! Interpolations are then computed on this type, see TypedCache for the implementation.
+//! An image can have multiple channels, the interpolation functions only read the first one.
 struct Cache {
-    CImg<uint16_t> img;
+    //! @brief Type used to store the values of an image of type imgDataType.
+    //! 8 bits images are stored as uint8, floating point images as float and the other images as uint16.
+    static Image::ImageDataType getStorageType(Image::ImageDataType imgDataType);
+
+    //! @brief Create an empty cache storing its values with the type getStorageType(imgDataType).
+    //! @param brickSize Size of the bricks of the layout of the values, 0 to store them x fastest, see TypedCache.
+    static Cache * create(glm::vec3 imageSize, Image::ImageDataType imgDataType, int nbChannels = 1, int brickSize = 0);
+
+    virtual ~Cache() {}
+
+    virtual Image::ImageDataType getStorageType() const = 0;
+
+    virtual int getNbChannels() const = 0;
+
+    virtual void reset() = 0;
 
-    Cache(glm::vec3 imageSize);
+    //! @brief Interpolation computed by getValue() and getValues() when interpolationMethod is asked.
+    //! The default implementation has no volume of coefficients, so CubicBSpline is computed as Cubic.
+    virtual Interpolation::Method getSupportedInterpolation(Interpolation::Method interpolationMethod) const {
+        return interpolationMethod == Interpolation::Method::CubicBSpline ? Interpolation::Method::Cubic : interpolationMethod;
+    }
 
-    void storeImage(int imageIdx, const std::vector<uint16_t>& data);
+    //! @brief Same as getSupportedInterpolation(), with a warning the first time the asked interpolation is replaced.
+    Interpolation::Method getInterpolation(Interpolation::Method interpolationMethod) const;
 
-    void reset();
+    //! @brief Interpolation is computed on the stored type, only the result is converted.
+    virtual float getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) const = 0;
 
-    uint16_t getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod);
+    //! @brief Sample nbValues coordinates at once, the interpolation method is only dispatched once for the whole batch.
+    //! The default implementation calls getValue() for each coordinate.
+    virtual void getValues(const glm::vec3 * coords, std::size_t nbValues, float * result, Interpolation::Method interpolationMethod) const {
+        for(std::size_t i = 0; i < nbValues; ++i)
+            result[i] = this->getValue(coords[i], interpolationMethod);
+    }
+
+    //! @brief Read the whole cache to compute the statistics of the image, all the channels are accumulated together.
+    //! Used when the cache was not filled by Sampler::fillCache(), which accumulates them while loading,
+    //! and to bin the floating point values with the mapping found from their range, see Statistics::mapping.
+    virtual Statistics computeStatistics(const ValueMapping& mapping = ValueMapping()) const = 0;
+
+private:
+    mutable std::atomic<bool> hasWarnedInterpolation{false};
 };
 
-//! @brief Unlike Cache, this %cache implementation allows to store parts of the image only, saving memory. However it do no allow interpolation this is it is currently unused.
-struct UnsortedCache {
-    // Maximum number of slices to be stored
-    int capacity;
-    int nbInsertion;
-    glm::vec3 imageSize;
+//! @brief The channels are stored as the spectrum of the CImg, each channel is then a contiguous volume that can be interpolated.
+//! The slices are interleaved when they are stored or extracted, see ImageReader::getSlice().
+//!
+//! A channel is either stored x fastest, as a plain CImg, or by bricks of brickSize^3 voxels.
+//! With bricks the neighbors along y and z are close in memory, so the slices along x and y, the oblique slices
+//! and the rays read far less cache lines and pages. The bricks are then stored in a CImg of 1 row per channel.
+//! The values are always accessed through getVolume(), which gives the offset of a voxel in both layouts.
+//!
+//! The CubicBSpline interpolation samples a volume of coefficients stored alongside the values, with the same layout.
+//! It is only allocated when this interpolation is used, and computed again when the values change.
+//! A cache whose coefficients would exceed BSPLINE_COEFFICIENTS_BUDGET_MB uses the Cubic interpolation instead.
+template<typename voxel_t>
+struct TypedCache : public Cache {
+    CImg<voxel_t> img;
+    glm::ivec3 dimension;
+    //! @brief Size of the bricks, 0 for the plain layout.
+    int brickSize;
+
+    //! @param brickSize 0 for the plain layout, otherwise a power of 2.
+    TypedCache(glm::vec3 imageSize, int nbChannels = 1, int brickSize = 0): dimension(imageSize), brickSize(brickSize), version(0), coefficientsVersion(-1) {
+        this->allocate(nbChannels);
+    }
+    //! @brief Wrap already loaded values without any copy, data has to stay valid while the cache is used.
+    TypedCache(glm::vec3 imageSize, voxel_t * data): img(CImg<voxel_t>(data, imageSize[0], imageSize[1], imageSize[2], 1, true)), dimension(imageSize), brickSize(0), version(0), coefficientsVersion(-1) {}
+
+    Image::ImageDataType getStorageType() const override;
+
+    int getNbChannels() const override {
+        return this->img.spectrum();
+    }
+
+    //! @brief Addressing of the values of a channel.
+    Interpolation::Volume<voxel_t> getVolume(int channel = 0) const {
+        const voxel_t * data = this->img.data() + channel * this->getChannelSize();
+        if(this->brickSize > 0)
+            return Interpolation::Volume<voxel_t>(data, this->dimension.x, this->dimension.y, this->dimension.z, this->brickSize);
+        return Interpolation::Volume<voxel_t>(data, this->dimension.x, this->dimension.y, this->dimension.z);
+    }
 
-    std::vector<int> indices;
-    std::vector<std::vector<uint16_t>> data;
+    //! @brief Store a slice whose getNbChannels() channels are interleaved.
+    void storeImage(int imageIdx, const std::vector<voxel_t>& data) {
+        this->storeImage(imageIdx, data.data());
+    }
 
-    UnsortedCache(glm::vec3 imageSize, int capacity);
+    void storeImage(int imageIdx, const voxel_t * data) {
+        this->version += 1;
+        if(this->img.spectrum() == 1 && this->brickSize == 0) {
+            this->img.get_shared_slice(imageIdx).assign(data, this->img.width(), this->img.height(), 1.);
+            return;
+        }
+        const int nbChannels = this->img.spectrum();
+        const std::vector<std::ptrdiff_t> offsetsX = this->getOffsets(0);
+        for(int channel = 0; channel < nbChannels; ++channel) {
+            const Interpolation::Volume<voxel_t> volume = this->getVolume(channel);
+            voxel_t * out = const_cast<voxel_t*>(volume.data) + volume.getOffset(2, imageIdx);
+            for(int y = 0; y < this->dimension.y; ++y) {
+                voxel_t * row = out + volume.getOffset(1, y);
+                const voxel_t * in = data + static_cast<std::size_t>(y) * this->dimension.x * nbChannels + channel;
+                for(int x = 0; x < this->dimension.x; ++x)
+                    row[offsetsX[x]] = in[x * nbChannels];
+            }
+        }
+    }
 
-    std::vector<uint16_t> * storeImage(int imageIdx);
-    uint16_t getValue(const glm::vec3& coord);
+    //! @brief Append the values of a slice to result, converted to out_t, with nbChannel interleaved channels.
+    //! The last channel is duplicated if the cache has less than nbChannel channels.
+    template<typename out_t>
+    void getSlice(int imageIdx, std::vector<out_t>& result, int nbChannel) const {
+        const std::size_t insertIdx = result.size();
+        const int sliceSize = this->dimension.x * this->dimension.y;
+        result.resize(insertIdx + static_cast<std::size_t>(sliceSize) * nbChannel);
+        if(this->img.spectrum() == 1 && this->brickSize == 0) {
+            Convert::convertRow<voxel_t, out_t>(this->img.data(0, 0, imageIdx), result.data() + insertIdx, 0, sliceSize, 1, nbChannel);
+            return;
+        }
+        const std::vector<std::ptrdiff_t> offsetsX = this->getOffsets(0);
+        for(int channel = 0; channel < nbChannel; ++channel) {
+            const Interpolation::Volume<voxel_t> volume = this->getVolume(std::min(channel, this->img.spectrum() - 1));
+            const voxel_t * in = volume.data + volume.getOffset(2, imageIdx);
+            out_t * out = result.data() + insertIdx + channel;
+            for(int y = 0; y < this->dimension.y; ++y) {
+                const voxel_t * row = in + volume.getOffset(1, y);
+                out_t * outRow = out + static_cast<std::size_t>(y) * this->dimension.x * nbChannel;
+                for(int x = 0; x < this->dimension.x; ++x)
+                    outRow[static_cast<std::size_t>(x) * nbChannel] = Convert::convertValue<voxel_t, out_t>(row[offsetsX[x]]);
+            }
+        }
+    }
 
-    bool isCached(int imageIdx) const;
-    int getCachedIdx(int imageIdx) const;
-    int getNextCachedImageToReplace() const;
+    //! @brief Append the values of the slice sliceIdx orthogonal to axis of a channel to result.
+    //! The slice is stored row by row, its rows are along x for the axis 1 and 2, along y for the axis 0.
+    template<typename out_t>
+    void getAxisSlice(int axis, int sliceIdx, std::vector<out_t>& result, int channel = 0) const {
+        const int axisU = (axis == 0) ? 1 : 0;
+        const int axisV = (axis == 2) ? 1 : 2;
+        const int sizeU = this->dimension[axisU];
+        const int sizeV = this->dimension[axisV];
+        const Interpolation::Volume<voxel_t> volume = this->getVolume(channel);
+        const std::vector<std::ptrdiff_t> offsetsU = this->getOffsets(axisU);
+        const voxel_t * in = volume.data + volume.getOffset(axis, sliceIdx);
+        const std::size_t insertIdx = result.size();
+        result.resize(insertIdx + static_cast<std::size_t>(sizeU) * sizeV);
+        for(int v = 0; v < sizeV; ++v) {
+            const voxel_t * row = in + volume.getOffset(axisV, v);
+            out_t * out = result.data() + insertIdx + static_cast<std::size_t>(v) * sizeU;
+            for(int u = 0; u < sizeU; ++u)
+                out[u] = Convert::convertValue<voxel_t, out_t>(row[offsetsU[u]]);
+        }
+    }
 
-    void setCapacity(int capacity);
+    void reset() override {
+        this->version += 1;
+        this->allocate(this->img.spectrum());
+    }
+
+    float getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) const override {
+        float value = 0.f;
+        this->getValues(&coord, 1, &value, interpolationMethod);
+        return value;
+    }
+
+    Interpolation::Method getSupportedInterpolation(Interpolation::Method interpolationMethod) const override {
+        if(interpolationMethod == Interpolation::Method::CubicBSpline && this->getChannelSize() * sizeof(float) > (std::size_t(BSPLINE_COEFFICIENTS_BUDGET_MB) << 20))
+            return Interpolation::Method::Cubic;
+        return interpolationMethod;
+    }
+
+    //! @brief The first sampling with CubicBSpline computes the coefficients of the first channel, they are computed again
+    //! the first time they are used after the cache is modified.
+    void getValues(const glm::vec3 * coords, std::size_t nbValues, float * result, Interpolation::Method interpolationMethod) const override {
+        interpolationMethod = this->getInterpolation(interpolationMethod);
+        if(interpolationMethod != Interpolation::Method::CubicBSpline) {
+            Interpolation::sample(this->getVolume(), coords, nbValues, result, interpolationMethod);
+            return;
+        }
+        // Kept alive even if other threads compute new coefficients meanwhile
+        const std::shared_ptr<const CImg<float>> coefficients = this->getCoefficients();
+        Interpolation::sample<Interpolation::Method::CubicBSpline>(this->getCoefficientsVolume(*coefficients), coords, nbValues, result);
+        // The overshoots are clamped to the range of the type, as the Catmull-Rom spline
+        if constexpr (std::is_integral<voxel_t>::value) {
+            for(std::size_t i = 0; i < nbValues; ++i)
+                result[i] = static_cast<float>(static_cast<voxel_t>(std::min(std::max(result[i], static_cast<float>(std::numeric_limits<voxel_t>::min())), static_cast<float>(std::numeric_limits<voxel_t>::max()))));
+        }
+    }
+
+    Statistics computeStatistics(const ValueMapping& mapping = ValueMapping()) const override {
+        Statistics statistics(mapping);
+        const std::size_t sliceSize = static_cast<std::size_t>(this->dimension.x) * this->dimension.y;
+        #pragma omp parallel
+        {
+            Statistics localStatistics(mapping);
+            std::vector<voxel_t> slice;
+            // The channels are stored one after the other, so the slices of all the channels are contiguous in the plain layout
+            #pragma omp for schedule(static)
+            for(int z = 0; z < this->dimension.z * this->img.spectrum(); ++z) {
+                if(this->brickSize == 0) {
+                    localStatistics.add(this->img.data() + z * sliceSize, sliceSize);
+                } else {
+                    // The padding of the bricks is not part of the image
+                    slice.clear();
+                    this->getAxisSlice(2, z % this->dimension.z, slice, z / this->dimension.z);
+                    localStatistics.add(slice);
+                }
+            }
+            #pragma omp critical
+            statistics.merge(localStatistics);
+        }
+        return statistics;
+    }
+
+private:
+    //! @brief Incremented each time the values are modified.
+    std::atomic<int64_t> version;
+    //! @brief Coefficients of the cubic B-spline of the first channel, stored with the layout of the values.
+    mutable std::shared_ptr<const CImg<float>> coefficients;
+    //! @brief Version of the values the coefficients were computed from.
+    mutable int64_t coefficientsVersion;
+    mutable std::mutex coefficientsMutex;
+
+    Interpolation::Volume<float> getCoefficientsVolume(const CImg<float>& coefficients) const {
+        if(this->brickSize > 0)
+            return Interpolation::Volume<float>(coefficients.data(), this->dimension.x, this->dimension.y, this->dimension.z, this->brickSize);
+        return Interpolation::Volume<float>(coefficients.data(), this->dimension.x, this->dimension.y, this->dimension.z);
+    }
+
+    std::shared_ptr<const CImg<float>> getCoefficients() const {
+        std::lock_guard<std::mutex> lock(this->coefficientsMutex);
+        // The values can be modified while the coefficients are computed, they are then computed again the next time
+        const int64_t version = this->version;
+        if(this->coefficients && this->coefficientsVersion == version)
+            return this->coefficients;
+        const std::size_t channelSize = this->getChannelSize();
+        std::shared_ptr<CImg<float>> coefficients = std::make_shared<CImg<float>>(this->img.width(), this->img.height(), this->img.depth(), 1);
+        const voxel_t * values = this->img.data();
+        float * data = coefficients->data();
+        #pragma omp parallel for schedule(static)
+        for(std::size_t i = 0; i < channelSize; ++i)
+            data[i] = static_cast<float>(values[i]);
+        Interpolation::prefilterBSpline(data, this->getCoefficientsVolume(*coefficients));
+        this->coefficients = coefficients;
+        this->coefficientsVersion = version;
+        return coefficients;
+    }
+
+    std::size_t getChannelSize() const {
+        return static_cast<std::size_t>(this->img.width()) * this->img.height() * this->img.depth();
+    }
+
+    //! @brief Offsets of the voxels along an axis, see Interpolation::Volume::getOffset().
+    std::vector<std::ptrdiff_t> getOffsets(int axis) const {
+        const Interpolation::Volume<voxel_t> volume = this->getVolume();
+        std::vector<std::ptrdiff_t> offsets(this->dimension[axis]);
+        for(int i = 0; i < this->dimension[axis]; ++i)
+            offsets[i] = volume.getOffset(axis, i);
+        return offsets;
+    }
+
+    void allocate(int nbChannels) {
+        if(this->brickSize > 0) {
+            const glm::ivec3 nbBricks = Interpolation::Volume<voxel_t>::getNbBricks(this->dimension, this->brickSize);
+            const int brickVolume = this->brickSize * this->brickSize * this->brickSize;
+            this->img = CImg<voxel_t>(nbBricks.x * brickVolume, nbBricks.y, nbBricks.z, nbChannels, 0);
+        } else {
+            this->img = CImg<voxel_t>(this->dimension.x, this->dimension.y, this->dimension.z, nbChannels, 0);
+        }
+    }
 };
 
+template<> inline Image::ImageDataType TypedCache<uint8_t>::getStorageType() const { return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8; }
+template<> inline Image::ImageDataType TypedCache<uint16_t>::getStorageType() const { return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16; }
+template<> inline Image::ImageDataType TypedCache<float>::getStorageType() const { return Image::ImageDataType::Floating | Image::ImageDataType::Bit_32; }
+
+//! @brief Print the throughput of the slices sampled in a synthetic volume of imageSize voxels stored with each brick size,
+//! 0 being the plain layout. The slices orthogonal to each axis and oblique slices are sampled with interpolationMethod,
+//! then the slices orthogonal to each axis are extracted with TypedCache::getAxisSlice(). Run with --bench-cache-layouts, see main().
+void benchmarkCacheLayouts(const glm::ivec3& imageSize, const std::vector<int>& brickSizes, Interpolation::Method interpolationMethod);
+
 //! @}
 
 #endif
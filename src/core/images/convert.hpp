@@ -0,0 +1,113 @@
+#ifndef CONVERT_HPP_
+#define CONVERT_HPP_
+
+#include "../../legacy/image/utils/include/image_api_common.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Kernels converting rows of image values from their type in the file to the type used by the software.
+//!
+//! The type of the source is dispatched once per image with getRowKernel(), then a row is converted with a tight loop
+//! writing directly in a preallocated output, which allows the compiler to vectorize it.
+namespace Convert {
+
+    //! @brief Convert a single value.
+    //! Signed values are shifted to the unsigned range by flipping their sign bit, so the minimum signed value becomes 0.
+    template<typename in_t, typename out_t>
+    inline out_t convertValue(in_t value) {
+        if constexpr (std::is_integral<in_t>::value && std::is_signed<in_t>::value) {
+            using unsigned_t = typename std::make_unsigned<in_t>::type;
+            constexpr unsigned_t signBit = unsigned_t(1) << (sizeof(in_t) * CHAR_BIT - 1);
+            return static_cast<out_t>(static_cast<unsigned_t>(static_cast<unsigned_t>(value) ^ signBit));
+        } else {
+            return static_cast<out_t>(value);
+        }
+    }
+
+    //! @brief Number of values read in a row by convertRow().
+    inline int getNbValues(int begin, int end, int stride) {
+        return (end > begin) ? (end - begin + stride - 1) / stride : 0;
+    }
+
+    //! @brief Convert the values [begin, end[ of a row, taking one value every stride values.
+    //! @param duplicate Each converted value is written duplicate times in a row, to fill multiple channels.
+    //! @param out Has to be able to store getNbValues(begin, end, stride) * duplicate values.
+    //! @return The number of values written.
+    template<typename in_t, typename out_t>
+    std::size_t convertRow(const in_t * in, out_t * out, int begin, int end, int stride, int duplicate) {
+        const int nbValues = getNbValues(begin, end, stride);
+        in += begin;
+        if(stride == 1 && duplicate == 1) {
+            constexpr bool isCopy = std::is_same<in_t, out_t>::value && !(std::is_integral<in_t>::value && std::is_signed<in_t>::value);
+            if constexpr (isCopy) {
+                std::copy(in, in + nbValues, out);
+            } else {
+                #pragma omp simd
+                for(int i = 0; i < nbValues; ++i)
+                    out[i] = convertValue<in_t, out_t>(in[i]);
+            }
+        } else if(duplicate == 1) {
+            #pragma omp simd
+            for(int i = 0; i < nbValues; ++i)
+                out[i] = convertValue<in_t, out_t>(in[i * stride]);
+        } else if(duplicate == 2) {
+            #pragma omp simd
+            for(int i = 0; i < nbValues; ++i) {
+                const out_t value = convertValue<in_t, out_t>(in[i * stride]);
+                out[2 * i] = value;
+                out[2 * i + 1] = value;
+            }
+        } else {
+            for(int i = 0; i < nbValues; ++i) {
+                const out_t value = convertValue<in_t, out_t>(in[i * stride]);
+                std::fill(out + i * duplicate, out + (i + 1) * duplicate, value);
+            }
+        }
+        return static_cast<std::size_t>(nbValues) * duplicate;
+    }
+
+    template<typename out_t>
+    using RowKernel = std::size_t (*)(const void * in, out_t * out, int begin, int end, int stride, int duplicate);
+
+    template<typename in_t, typename out_t>
+    std::size_t convertRowUntyped(const void * in, out_t * out, int begin, int end, int stride, int duplicate) {
+        return convertRow<in_t, out_t>(static_cast<const in_t*>(in), out, begin, end, stride, duplicate);
+    }
+
+    //! @brief Get the kernel converting values of type imgDataType to out_t.
+    //! @return nullptr if the type isn't supported.
+    template<typename out_t>
+    RowKernel<out_t> getRowKernel(Image::ImageDataType imgDataType) {
+        if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+            return &convertRowUntyped<uint8_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16)) {
+            return &convertRowUntyped<uint16_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32)) {
+            return &convertRowUntyped<uint32_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64)) {
+            return &convertRowUntyped<uint64_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_8)) {
+            return &convertRowUntyped<int8_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_16)) {
+            return &convertRowUntyped<int16_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_32)) {
+            return &convertRowUntyped<int32_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_64)) {
+            return &convertRowUntyped<int64_t, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+            return &convertRowUntyped<float, out_t>;
+        } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_64)) {
+            return &convertRowUntyped<double, out_t>;
+        }
+        return nullptr;
+    }
+}
+
+//! @}
+
+#endif
@@ -4,143 +4,471 @@
 #include <glm/gtx/io.hpp>
 #include <algorithm>
 #include <limits.h>
+#include <omp.h>
 
-TIFFReader::TIFFReader(const std::vector<std::string>& filename): tiffReader(new TIFFReaderLibtiff(filename)) {
+TIFFReader::TIFFReader(const std::vector<std::string>& filename): nbChannels(1), tiffReader(new TIFFReaderLibtiff(filename)), mappedReader(nullptr) {
+    this->threadReaders.push_back(this->tiffReader);
     this->imgResolution = this->tiffReader->getImageResolution();
     this->imgDataType = this->tiffReader->getImageInternalDataType(); 
     this->voxelSize = this->tiffReader->getVoxelSize();
+    this->openMappedReader();
+}
+
+TIFFReader::TIFFReader(const MetadataCache::Metadata& metadata): nbChannels(metadata.nbChannels), tiffReader(new TIFFReaderLibtiff(metadata.filenames, std::vector<toff_t>(metadata.directoryOffsets.begin(), metadata.directoryOffsets.end()))), mappedReader(nullptr) {
+    this->threadReaders.push_back(this->tiffReader);
+    this->tiffReader->planes = metadata.planes;
+    this->imgResolution = metadata.imgResolution;
+    this->imgDataType = metadata.imgDataType;
+    this->voxelSize = metadata.voxelSize;
+    if(!metadata.slicePositions.empty()) {
+        TIFFMappedReader * mappedReader = new TIFFMappedReader(metadata.filenames, this->imgResolution, this->imgResolution[2] * this->nbChannels, std::vector<std::pair<int, std::size_t>>(metadata.slicePositions.begin(), metadata.slicePositions.end()));
+        if(mappedReader->isValid()) {
+            std::cout << "Uncompressed uint16 image: read from memory mapped files" << std::endl;
+            this->mappedReader = mappedReader;
+        } else {
+            delete mappedReader;
+        }
+    }
+}
+
+void TIFFReader::fillMetadata(MetadataCache::Metadata& metadata) const {
+    metadata.imgResolution = this->imgResolution;
+    metadata.voxelSize = this->voxelSize;
+    metadata.imgDataType = this->imgDataType;
+    metadata.nbChannels = this->nbChannels;
+    metadata.filenames = this->tiffReader->filenames;
+    metadata.directoryOffsets.assign(this->tiffReader->directoryOffsets.begin(), this->tiffReader->directoryOffsets.end());
+    metadata.planes = this->tiffReader->planes;
+    metadata.slicePositions.clear();
+    if(this->mappedReader)
+        metadata.slicePositions.assign(this->mappedReader->slicePositions.begin(), this->mappedReader->slicePositions.end());
+}
+
+void TIFFReader::benchmarkDecoding(int nbSlices) {
+    const int previousNbDecoders = this->tiffReader->getNbDecoders();
+    const int nbImages = std::max(1, std::min(nbSlices, static_cast<int>(this->imgResolution[2]))) * this->nbChannels;
+    const uint32 nbRows = this->imgResolution[1];
+    auto decode = [&]() {
+        std::size_t nbBytes = 0;
+        for(int imageIdx = 0; imageIdx < nbImages; ++imageIdx) {
+            this->tiffReader->setImageToRead(imageIdx);
+            this->tiffReader->readRows(0, nbRows);
+            nbBytes += static_cast<std::size_t>(this->tiffReader->getScanLineSize()) * nbRows;
+        }
+        return nbBytes;
+    };
+    decode();
+    for(int nbDecoders : {1, omp_get_max_threads()}) {
+        this->tiffReader->setNbDecoders(nbDecoders);
+        const double start = omp_get_wtime();
+        const std::size_t nbBytes = decode();
+        const double duration = omp_get_wtime() - start;
+        std::cout << "Decoded [" << nbImages << "] images using [" << nbDecoders << "] threads in " << duration << "s: " << static_cast<double>(nbBytes) / (duration * 1e6) << " MB/s" << std::endl;
+    }
+    this->tiffReader->setNbDecoders(previousNbDecoders);
+}
+
+void TIFFReader::setNbThreads(int nbThreads) {
+    nbThreads = std::max(nbThreads, 1);
+    while(this->threadReaders.size() > nbThreads) {
+        this->threadReaders.back()->closeImage();
+        delete this->threadReaders.back();
+        this->threadReaders.pop_back();
+    }
+    while(this->threadReaders.size() < nbThreads) {
+        this->threadReaders.push_back(new TIFFReaderLibtiff(this->tiffReader->filenames, this->tiffReader->directoryOffsets));
+        this->threadReaders.back()->planes = this->tiffReader->planes;
+    }
+}
+
+void TIFFReader::openMappedReader() {
+    delete this->mappedReader;
+    this->mappedReader = nullptr;
+    if(!TIFFMappedReader::isCompatible(this->tiffReader->tif))
+        return;
+    TIFFMappedReader * mappedReader = new TIFFMappedReader(this->tiffReader, this->imgResolution, this->imgResolution[2] * this->nbChannels);
+    if(mappedReader->isValid()) {
+        std::cout << "Uncompressed uint16 image: read from memory mapped files" << std::endl;
+        this->mappedReader = mappedReader;
+    } else {
+        delete mappedReader;
+    }
 }
 
 Image::ImageDataType TIFFReader::getInternalDataType() const {
     return this->imgDataType;
 }
 
-// Function to cast for the getValue
-uint16_t getToLowPrecision(Image::ImageDataType imgDataType, const tdata_t& buf, int idx) {
-    if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
-        uint8_t * data = static_cast<std::uint8_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16)) {
-        uint16_t * data = static_cast<std::uint16_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32)) {
-        uint32_t * data = static_cast<std::uint32_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64)) {
-        uint64_t * data = static_cast<std::uint64_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_8)) {
-        int8_t * data = static_cast<std::int8_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_16)) {
-        int16_t * data = static_cast<std::int16_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_32)) {
-        int32_t * data = static_cast<std::int32_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_64)) {
-        int64_t * data = static_cast<std::int64_t*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
-        float * data = static_cast<float*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_64)) {
-        double * data = static_cast<double*>(buf);
-        return static_cast<std::uint16_t>(data[idx]);
-    } 
+uint16_t TIFFReader::getValue(const glm::vec3& coord) const {
+    return this->getValue<uint16_t>(coord);
 }
 
-uint16_t TIFFReader::getValue(const glm::vec3& coord) const {
-    // If we read directly from the raw image we use Nearest Neighbor interpolation
-    const glm::vec3 newCoord{std::floor(coord[0]), std::floor(coord[1]), std::floor(coord[2])};
-    int imageIdx = newCoord[2];
-    this->tiffReader->setImageToRead(imageIdx);
-    tdata_t buf = _TIFFmalloc(this->tiffReader->getScanLineSize());
-    this->tiffReader->readScanline(buf, newCoord[1]);
-    uint16_t res = getToLowPrecision(this->getInternalDataType(), buf, newCoord[0]);
-    _TIFFfree(buf);
-    return res;
-}
-
-//Function to cast and insert for the get slice
-// Important: a cast do not change a value, so if we want to cast from an int we need to make a conversion, this is the usage of needInversion
-template <typename data_t>
-void castToUintAndInsert(data_t * values, std::vector<uint16_t>& res, int duplicate, int offset, std::pair<glm::vec3, glm::vec3> bboxes, bool needInversion = false) {
-    for(int i = bboxes.first[0]; i < bboxes.second[0]; i+=offset) {
-        for(int j = 0; j < duplicate; ++j)
-            if(needInversion)
-                res.push_back(static_cast<uint16_t>((std::bitset<sizeof(data_t) * CHAR_BIT>(values[i]).flip(std::bitset<sizeof(data_t)*CHAR_BIT>().size()-1)).to_ulong())); 
-            else
-                res.push_back(static_cast<uint16_t>(values[i])); 
+template<typename out_t>
+void TIFFReader::getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx) const {
+    const uint32 firstRow = bboxes.first[1];
+    const uint32 lastRow = bboxes.second[1];
+
+    // The type is dispatched once for the whole slice, and the result is allocated once
+    Convert::RowKernel<out_t> convertRow = Convert::getRowKernel<out_t>(this->getInternalDataType());
+    const int nbValues = Convert::getNbValues(bboxes.first[0], bboxes.second[0], offsets.first);
+    const int nbRows = Convert::getNbValues(firstRow, lastRow, offsets.second);
+    std::size_t insertIdx = result.size();
+    result.resize(insertIdx + static_cast<std::size_t>(nbValues) * nbChannel * nbRows);
+
+    // Rows [firstRow, lastRow[ of an image, rowBytes bytes per row
+    TIFFReaderLibtiff * tiffReader = this->threadReaders[threadIdx];
+    auto readRows = [&](int imageIdx, std::size_t& rowBytes) -> const unsigned char * {
+        if(this->mappedReader) {
+            rowBytes = static_cast<std::size_t>(this->imgResolution[0]) * sizeof(uint16_t);
+            return reinterpret_cast<const unsigned char*>(this->mappedReader->getSliceView(imageIdx)) + firstRow * rowBytes;
+        }
+        tiffReader->setImageToRead(imageIdx);
+        rowBytes = tiffReader->getScanLineSize();
+        return tiffReader->readRows(firstRow, lastRow, offsets.second);
+    };
+
+    if(this->nbChannels == 1) {
+        std::size_t rowBytes = 0;
+        const unsigned char * rows = readRows(sliceIdx, rowBytes);
+        for (uint32 row = firstRow; row < lastRow; row+=offsets.second)
+            insertIdx += convertRow(rows + (row - firstRow) * rowBytes, result.data() + insertIdx, bboxes.first[0], bboxes.second[0], offsets.first, nbChannel);
+        return;
+    }
+
+    // Each channel is a separate image, its values are interleaved with the other channels in the result
+    const int nbReadChannels = std::min(nbChannel, this->nbChannels);
+    std::vector<out_t> channelRow(nbValues);
+    for(int channel = 0; channel < nbReadChannels; ++channel) {
+        // The last channel read also fills the channels missing in the image
+        const int nbCopies = (channel == nbReadChannels - 1) ? nbChannel - channel : 1;
+        std::size_t rowBytes = 0;
+        const unsigned char * rows = readRows(sliceIdx * this->nbChannels + channel, rowBytes);
+        out_t * out = result.data() + insertIdx + channel;
+        for (uint32 row = firstRow; row < lastRow; row+=offsets.second) {
+            convertRow(rows + (row - firstRow) * rowBytes, channelRow.data(), bboxes.first[0], bboxes.second[0], offsets.first, 1);
+            for(int i = 0; i < nbValues; ++i) {
+                for(int copy = 0; copy < nbCopies; ++copy)
+                    out[i * nbChannel + copy] = channelRow[i];
+            }
+            out += static_cast<std::size_t>(nbValues) * nbChannel;
+        }
+    }
+}
+
+template void TIFFReader::getSlice<uint8_t>(int, std::vector<uint8_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void TIFFReader::getSlice<uint16_t>(int, std::vector<uint16_t>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+template void TIFFReader::getSlice<float>(int, std::vector<float>&, int, std::pair<int, int>, std::pair<glm::vec3, glm::vec3>, int) const;
+
+/***/
+
+namespace OMETIFF {
+
+    bool getPlanes(const Pixels& pixels, int nbChannels, const std::string& xmlFilename, std::vector<std::string>& filenames, std::vector<std::pair<int, int>>& planes) {
+        const int sizeZ = pixels.size.z;
+        if(sizeZ <= 0 || pixels.sizeC <= 0 || pixels.sizeT <= 0 || pixels.dimensionOrder.size() != 5)
+            return false;
+
+        // Size and stride of Z, C and T in the planes order
+        int sizes[3] = {sizeZ, pixels.sizeC, pixels.sizeT};
+        int strides[3] = {0, 0, 0};
+        int stride = 1;
+        for(int i = 2; i < 5; ++i) {
+            const std::size_t dimension = std::string("ZCT").find(pixels.dimensionOrder[i]);
+            if(dimension == std::string::npos)
+                return false;
+            strides[dimension] = stride;
+            stride *= sizes[dimension];
+        }
+        const int nbPlanes = stride;
+
+        // Without TiffData all the planes are stored in order in the file containing the XML
+        std::vector<TiffData> tiffData = pixels.tiffData;
+        if(tiffData.empty())
+            tiffData.push_back(TiffData());
+
+        filenames.clear();
+        planes.assign(static_cast<std::size_t>(sizeZ) * nbChannels, std::make_pair(-1, -1));
+        for(const TiffData& data : tiffData) {
+            const std::string& filename = data.filename.empty() ? xmlFilename : data.filename;
+            const int fileIdx = std::find(filenames.begin(), filenames.end(), filename) - filenames.begin();
+            if(fileIdx == filenames.size())
+                filenames.push_back(filename);
+
+            const int first = data.firstZ * strides[0] + data.firstC * strides[1] + data.firstT * strides[2];
+            const int planeCount = (data.planeCount < 0) ? nbPlanes - first : data.planeCount;
+            for(int i = 0; i < planeCount && first + i < nbPlanes; ++i) {
+                const int planeIdx = first + i;
+                const int z = (planeIdx / strides[0]) % sizes[0];
+                const int c = (planeIdx / strides[1]) % sizes[1];
+                const int t = (planeIdx / strides[2]) % sizes[2];
+                if(t == 0 && c < nbChannels)
+                    planes[z * nbChannels + c] = std::make_pair(fileIdx, data.ifd + i);
+            }
+        }
+        return std::none_of(planes.begin(), planes.end(), [](const std::pair<int, int>& plane) { return plane.first < 0; });
     }
 }
 
-//Function to cast and insert for the get slice
-void castToLowPrecision(Image::ImageDataType imgDataType, const tdata_t& buf, std::vector<uint16_t>& res, int duplicate, int offset, std::pair<glm::vec3, glm::vec3> bboxes) {
-    if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
-        uint8_t * data = static_cast<std::uint8_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16)) {
-        uint16_t * data = static_cast<uint16_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32)) {
-        uint32_t * data = static_cast<std::uint32_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64)) {
-        uint64_t * data = static_cast<std::uint64_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_8)) {
-        int8_t * data = static_cast<std::int8_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_16)) {
-        int16_t * data = static_cast<std::int16_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_32)) {
-        int32_t * data = static_cast<std::int32_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_64)) {
-        int64_t * data = static_cast<std::int64_t*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
-        float * data = static_cast<float*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_64)) {
-        double * data = static_cast<double*>(buf);
-        castToUintAndInsert(data, res, duplicate, offset, bboxes);
-    } 
-}
-
-void TIFFReader::getSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes) const {
-    this->tiffReader->setImageToRead(sliceIdx);
-
-    tdata_t buf;
-    buf = _TIFFmalloc(this->tiffReader->getScanLineSize());
-
-    uint32 row;
-    for (row = bboxes.first[1]; row < bboxes.second[1]; row+=offsets.second) {
-        this->tiffReader->readScanline(buf, row);
-        castToLowPrecision(this->getInternalDataType(), buf, result, nbChannel, offsets.first, bboxes);
+OMETIFFReader::OMETIFFReader(const std::vector<std::string>& filename) : TIFFReader(filename) {
+    std::cout << "Start of the OME-TIFF format parsing..." << std::endl;
+    QDir path = QDir(QFileInfo(filename[0].c_str()).absolutePath());
+    char * xmlData = nullptr;
+    TIFFGetField(this->tiffReader->tif, TIFFTAG_IMAGEDESCRIPTION, &xmlData);
+    if(!xmlData || std::string(xmlData).empty()) {
+        std::cout << "WARNING: no XML data has been found in the first ome.tiff file. Those files will be parse as regular tiff files." << std::endl;
+        return;
+    }
+
+    // Only the Pixels of the first Image are read
+    OMETIFF::Pixels pixels;
+    std::vector<std::string> fileList;
+    bool isInPixels = false;
+    bool isPixelsRead = false;
+    bool isInTiffData = false;
+    QXmlStreamReader xmlReader(xmlData);
+    while (!xmlReader.atEnd()) {
+        const QXmlStreamReader::TokenType token = xmlReader.readNext();
+        const QString name = xmlReader.name().toString();
+        if(token == QXmlStreamReader::EndElement) {
+            if(name == QString("Pixels") && isInPixels) {
+                isInPixels = false;
+                isPixelsRead = true;
+            } else if(name == QString("TiffData")) {
+                isInTiffData = false;
+            }
+            continue;
+        }
+        if(token != QXmlStreamReader::StartElement)
+            continue;
+        const QXmlStreamAttributes attributes = xmlReader.attributes();
+        auto getInt = [&](const char * attribute, int defaultValue) {
+            return attributes.hasAttribute(attribute) ? attributes.value(attribute).toString().toInt() : defaultValue;
+        };
+        if(name == QString("Pixels") && !isPixelsRead) {
+            isInPixels = true;
+            pixels.size = glm::ivec3(getInt("SizeX", 0), getInt("SizeY", 0), getInt("SizeZ", 1));
+            pixels.sizeC = getInt("SizeC", 1);
+            pixels.sizeT = getInt("SizeT", 1);
+            if(attributes.hasAttribute("DimensionOrder"))
+                pixels.dimensionOrder = attributes.value("DimensionOrder").toString().toStdString();
+        } else if(name == QString("TiffData") && isInPixels) {
+            isInTiffData = true;
+            OMETIFF::TiffData data;
+            data.ifd = getInt("IFD", 0);
+            data.firstZ = getInt("FirstZ", 0);
+            data.firstC = getInt("FirstC", 0);
+            data.firstT = getInt("FirstT", 0);
+            // Without PlaneCount, a TiffData with an IFD describes a single plane, otherwise all the remaining planes
+            data.planeCount = getInt("PlaneCount", attributes.hasAttribute("IFD") ? 1 : -1);
+            pixels.tiffData.push_back(data);
+        } else if(name == QString("UUID")) {
+            if(attributes.hasAttribute("FileName")) {
+                const std::string finalFileName = path.filePath(attributes.value("FileName").toString()).toStdString();
+                if(isInTiffData)
+                    pixels.tiffData.back().filename = finalFileName;
+                if(fileExist(finalFileName))
+                    fileList.push_back(finalFileName);
+            }
+        }
+    }
+    if (xmlReader.hasError()) {
+        std::cout << "WARNING: the XML file contained in the first ome tiff file's comment has errors." << std::endl;
     }
-    _TIFFfree(buf);
+
+    const int nbChannels = std::min(pixels.sizeC, MAX_NB_CHANNELS);
+    std::vector<std::string> filenames;
+    std::vector<std::pair<int, int>> planes;
+    const bool isPlanesValid = isPixelsRead && OMETIFF::getPlanes(pixels, nbChannels, filename[0], filenames, planes) &&
+                               std::all_of(filenames.begin(), filenames.end(), [](const std::string& file) { return fileExist(file); });
+    if(isPlanesValid) {
+        std::cout << "[" << filenames.size() << "] files found, [" << pixels.sizeC << "] channels" << std::endl;
+        if(pixels.sizeC > nbChannels)
+            std::cout << "WARNING: only the first [" << nbChannels << "] channels are loaded" << std::endl;
+        if(pixels.sizeT > 1)
+            std::cout << "WARNING: only the first time point is loaded" << std::endl;
+        this->tiffReader->filenames = filenames;
+        this->tiffReader->planes = planes;
+        this->imgResolution = glm::vec3(pixels.size);
+        this->nbChannels = nbChannels;
+    } else if(!fileList.empty()) {
+        // Each file listed is a single slice
+        std::cout << "[" << fileList.size() << "] files found" << std::endl;
+        this->tiffReader->filenames = fileList;
+        this->imgResolution[2] = fileList.size();
+    } else {
+        std::cout << "WARNING: no file has been found in the XML of the ome.tiff file. It will be parse as a regular tiff file." << std::endl;
+        return;
+    }
+    // The opened file may not be the first one of the list
+    this->tiffReader->openedImage = -1;
+    this->openMappedReader();
 }
 
 /***/
 
-TIFFReaderLibtiff::TIFFReaderLibtiff(const std::vector<std::string>& filename): filenames(filename) {
+bool TIFFMappedReader::isCompatible(TIFF * tif) {
+    uint16_t compression = COMPRESSION_NONE;
+    uint16_t planarConfig = PLANARCONFIG_CONTIG;
+    uint16_t samplesPerPixel = 1;
+    uint16_t bitsPerSample = 0;
+    uint16_t sampleFormat = SAMPLEFORMAT_UINT;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planarConfig);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &sampleFormat);
+    return compression == COMPRESSION_NONE &&
+           samplesPerPixel == 1 &&
+           bitsPerSample == 16 &&
+           sampleFormat == SAMPLEFORMAT_UINT &&
+           !TIFFIsTiled(tif) &&
+           !TIFFIsByteSwapped(tif);
+}
+
+TIFFMappedReader::TIFFMappedReader(TIFFReaderLibtiff * tiffReader, const glm::vec3& imgResolution, int nbPlanes): imgResolution(imgResolution), nbPlanes(nbPlanes) {
+    const std::size_t sliceSize = static_cast<std::size_t>(imgResolution[0]) * static_cast<std::size_t>(imgResolution[1]) * sizeof(uint16_t);
+
+    for(const std::string& filename : tiffReader->filenames) {
+        MappedFile * file = new MappedFile();
+        if(!file->open(filename)) {
+            delete file;
+            return;
+        }
+        this->files.push_back(file);
+    }
+
+    for(int sliceIdx = 0; sliceIdx < nbPlanes; ++sliceIdx) {
+        tiffReader->setImageToRead(sliceIdx);
+        // Each directory can have its own layout
+        if(!isCompatible(tiffReader->tif))
+            return;
+
+        uint64_t * stripOffsets = nullptr;
+        uint64_t * stripByteCounts = nullptr;
+        if(!TIFFGetField(tiffReader->tif, TIFFTAG_STRIPOFFSETS, &stripOffsets) || !TIFFGetField(tiffReader->tif, TIFFTAG_STRIPBYTECOUNTS, &stripByteCounts))
+            return;
+
+        // The slice can be viewed only if its strips are stored one after the other
+        std::size_t nbBytes = 0;
+        const uint32_t nbStrips = TIFFNumberOfStrips(tiffReader->tif);
+        for(uint32_t strip = 0; strip < nbStrips; ++strip) {
+            if(stripOffsets[strip] != stripOffsets[0] + nbBytes)
+                return;
+            nbBytes += stripByteCounts[strip];
+        }
+
+        const int fileIdx = tiffReader->getFileIdx(sliceIdx);
+        const std::size_t position = stripOffsets[0];
+        if(nbBytes < sliceSize || position + sliceSize > this->files[fileIdx]->size || position % alignof(uint16_t) != 0)
+            return;
+        this->slicePositions.push_back(std::make_pair(fileIdx, position));
+    }
+    tiffReader->setImageToRead(0);
+}
+
+TIFFMappedReader::TIFFMappedReader(const std::vector<std::string>& filenames, const glm::vec3& imgResolution, int nbPlanes, const std::vector<std::pair<int, std::size_t>>& slicePositions): imgResolution(imgResolution), nbPlanes(nbPlanes) {
+    const std::size_t sliceSize = static_cast<std::size_t>(imgResolution[0]) * static_cast<std::size_t>(imgResolution[1]) * sizeof(uint16_t);
+
+    for(const std::string& filename : filenames) {
+        MappedFile * file = new MappedFile();
+        if(!file->open(filename)) {
+            delete file;
+            return;
+        }
+        this->files.push_back(file);
+    }
+
+    // The positions are only trusted if they are inside the files
+    for(const std::pair<int, std::size_t>& position : slicePositions) {
+        if(position.first < 0 || position.first >= this->files.size() || position.second + sliceSize > this->files[position.first]->size) {
+            this->slicePositions.clear();
+            return;
+        }
+        this->slicePositions.push_back(position);
+    }
+}
+
+TIFFMappedReader::~TIFFMappedReader() {
+    for(MappedFile * file : this->files)
+        delete file;
+}
+
+bool TIFFMappedReader::isValid() const {
+    return this->slicePositions.size() == static_cast<std::size_t>(this->nbPlanes);
+}
+
+const uint16_t * TIFFMappedReader::getSliceView(int sliceIdx) const {
+    const std::pair<int, std::size_t>& position = this->slicePositions[sliceIdx];
+    return reinterpret_cast<const uint16_t*>(this->files[position.first]->data + position.second);
+}
+
+uint16_t * TIFFMappedReader::getVolumeView() const {
+    if(this->files.size() != 1 || this->slicePositions.empty() || this->nbPlanes != this->imgResolution[2])
+        return nullptr;
+    const std::size_t sliceSize = static_cast<std::size_t>(this->imgResolution[0]) * static_cast<std::size_t>(this->imgResolution[1]) * sizeof(uint16_t);
+    const std::size_t firstPosition = this->slicePositions[0].second;
+    for(std::size_t sliceIdx = 0; sliceIdx < this->slicePositions.size(); ++sliceIdx) {
+        if(this->slicePositions[sliceIdx].second != firstPosition + sliceIdx * sliceSize)
+            return nullptr;
+    }
+    return reinterpret_cast<uint16_t*>(this->files[0]->data + firstPosition);
+}
+
+/***/
+
+TIFFReaderLibtiff::TIFFReaderLibtiff(const std::vector<std::string>& filename): filenames(filename), currentImage(0), nbDecoders(omp_get_max_threads()) {
     TIFFSetWarningHandler(nullptr); // Prevent to display warning
     this->tif = TIFFOpen(this->filenames[0].c_str(), "r");
     this->openedImage = 0;
+    this->currentDirectory = 0;
+    if(this->filenames.size() == 1)
+        this->buildDirectoryOffsets();
+}
+
+TIFFReaderLibtiff::TIFFReaderLibtiff(const std::vector<std::string>& filename, const std::vector<toff_t>& directoryOffsets): filenames(filename), directoryOffsets(directoryOffsets), currentImage(0), nbDecoders(omp_get_max_threads()) {
+    TIFFSetWarningHandler(nullptr); // Prevent to display warning
+    this->tif = TIFFOpen(this->filenames[0].c_str(), "r");
+    this->openedImage = 0;
+    this->currentDirectory = 0;
+}
+
+void TIFFReaderLibtiff::buildDirectoryOffsets() {
+    this->directoryOffsets.clear();
+    do {
+        this->directoryOffsets.push_back(TIFFCurrentDirOffset(this->tif));
+    } while (TIFFReadDirectory(this->tif));
+    // Go back to the first image
+    TIFFSetSubDirectory(this->tif, this->directoryOffsets[0]);
+    this->currentDirectory = 0;
 }
 
 void TIFFReaderLibtiff::openImage(int imageIdx) {
+    if(imageIdx == this->openedImage)
+        return;
     TIFFClose(this->tif);
     this->tif = TIFFOpen(this->filenames[imageIdx].c_str(), "r");
+    this->openedImage = imageIdx;
+    this->currentDirectory = 0;
 }
 
 void TIFFReaderLibtiff::closeImage() {
+    for(TIFFReaderLibtiff * decoder : this->decoders) {
+        decoder->closeImage();
+        delete decoder;
+    }
+    this->decoders.clear();
     TIFFClose(this->tif);
 }
 
+void TIFFReaderLibtiff::setNbDecoders(int nbDecoders) {
+    this->nbDecoders = std::max(nbDecoders, 1);
+    while(this->decoders.size() > this->nbDecoders) {
+        this->decoders.back()->closeImage();
+        delete this->decoders.back();
+        this->decoders.pop_back();
+    }
+}
+
 glm::vec3 TIFFReaderLibtiff::getImageResolution() const {
     uint32_t width = 0;
     uint32_t depth = 0;
@@ -149,9 +477,7 @@ glm::vec3 TIFFReaderLibtiff::getImageResolution() const {
     TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
     int dircount = 0;
     if(this->filenames.size() == 1) {
-        do {
-            dircount++;
-        } while (TIFFReadDirectory(tif));
+        dircount = this->directoryOffsets.size();
     } else {
         dircount = this->filenames.size(); 
     }
@@ -269,11 +595,128 @@ Image::ImageDataType TIFFReaderLibtiff::getImageInternalDataType() const {
 
 }
 
+bool TIFFReaderLibtiff::readRowsParallel(uint32 firstRow, uint32 lastRow, unsigned char * out) {
+    uint32_t width = 0;
+    uint32_t length = 0;
+    TIFFGetField(this->tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(this->tif, TIFFTAG_IMAGELENGTH, &length);
+    const bool tiled = this->isTiled();
+    uint32_t blockWidth = width;
+    uint32_t blockLength = length;
+    if(tiled) {
+        TIFFGetField(this->tif, TIFFTAG_TILEWIDTH, &blockWidth);
+        TIFFGetField(this->tif, TIFFTAG_TILELENGTH, &blockLength);
+    } else {
+        TIFFGetFieldDefaulted(this->tif, TIFFTAG_ROWSPERSTRIP, &blockLength);
+        blockLength = std::min(blockLength, length);
+    }
+
+    // Blocks containing the rows and the position of their first voxel in the image
+    std::vector<uint32> blocks;
+    std::vector<std::pair<uint32, uint32>> positions;
+    for(uint32 y = firstRow - firstRow % blockLength; y < lastRow; y += blockLength) {
+        for(uint32 x = 0; x < width; x += blockWidth) {
+            blocks.push_back(tiled ? TIFFComputeTile(this->tif, x, y, 0, 0) : TIFFComputeStrip(this->tif, y, 0));
+            positions.push_back(std::make_pair(x, y));
+        }
+    }
+    if(blocks.size() < 2)
+        return false;
+
+    // A handle can't be used by multiple threads, so the encoded blocks are all read by this one
+    this->rawBlocks.resize(std::max(this->rawBlocks.size(), blocks.size()));
+    std::vector<char> isRead(blocks.size(), 1);
+    for(int i = 0; i < blocks.size(); ++i) {
+        std::vector<unsigned char>& rawBlock = this->rawBlocks[i];
+        rawBlock.resize(TIFFGetStrileByteCount(this->tif, blocks[i]));
+        const tmsize_t readSize = tiled ? TIFFReadRawTile(this->tif, blocks[i], rawBlock.data(), rawBlock.size()) : TIFFReadRawStrip(this->tif, blocks[i], rawBlock.data(), rawBlock.size());
+        isRead[i] = readSize >= 0;
+    }
+
+    const int nbDecoders = std::min(this->nbDecoders, static_cast<int>(blocks.size()));
+    while(this->decoders.size() < nbDecoders) {
+        this->decoders.push_back(new TIFFReaderLibtiff(this->filenames, this->directoryOffsets));
+        this->decoders.back()->planes = this->planes;
+        this->decoders.back()->setNbDecoders(1);
+    }
+
+    const tsize_t scanLineSize = this->getScanLineSize();
+    const tsize_t blockRowSize = tiled ? TIFFTileRowSize(this->tif) : scanLineSize;
+    const tmsize_t blockSize = tiled ? TIFFTileSize(this->tif) : TIFFStripSize(this->tif);
+    const tsize_t pixelSize = blockRowSize / blockWidth;
+    #pragma omp parallel num_threads(nbDecoders)
+    {
+        // Each decoder uses the codec state of its own handle, which has to be on the same image
+        TIFFReaderLibtiff * decoder = this->decoders[omp_get_thread_num()];
+        decoder->setImageToRead(this->currentImage);
+        decoder->blockBuffer.resize(blockSize);
+        #pragma omp for schedule(dynamic)
+        for(int i = 0; i < blocks.size(); ++i) {
+            std::vector<unsigned char>& rawBlock = this->rawBlocks[i];
+            const uint32 x = positions[i].first;
+            const uint32 y = positions[i].second;
+            const uint32 blockLastRow = std::min(y + blockLength, static_cast<uint32>(length));
+            const uint32 copyFirstRow = std::max(y, firstRow);
+            const uint32 copyLastRow = std::min(blockLastRow, lastRow);
+            // Tiles on the right border are padded
+            const tsize_t copySize = std::min(blockWidth, width - x) * pixelSize;
+            bool isDecoded = false;
+            if(isRead[i] && !tiled && copyFirstRow == y && copyLastRow == blockLastRow) {
+                // The whole strip is needed, decode it in place
+                if(TIFFReadFromUserBuffer(decoder->tif, blocks[i], rawBlock.data(), rawBlock.size(), out + (y - firstRow) * scanLineSize, (blockLastRow - y) * scanLineSize))
+                    continue;
+            } else if(isRead[i]) {
+                isDecoded = TIFFReadFromUserBuffer(decoder->tif, blocks[i], rawBlock.data(), rawBlock.size(), decoder->blockBuffer.data(), blockSize);
+            }
+            // As in readRows(), the rows of a broken block must not keep the values of the previous slice
+            if(!isDecoded)
+                std::cerr << "ERROR: can't decode the " << (tiled ? "tile [" : "strip [") << blocks[i] << "] of the image [" << this->currentImage << "]" << std::endl;
+            for(uint32 row = copyFirstRow; row < copyLastRow; ++row) {
+                unsigned char * dst = out + (row - firstRow) * scanLineSize + x * pixelSize;
+                if(isDecoded) {
+                    const unsigned char * src = decoder->blockBuffer.data() + (row - y) * blockRowSize;
+                    std::copy(src, src + copySize, dst);
+                } else {
+                    std::fill(dst, dst + copySize, 0);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int TIFFReaderLibtiff::getFileIdx(int imageIdx) const {
+    if(!this->planes.empty())
+        return this->planes[imageIdx].first;
+    return (this->filenames.size() > 1) ? imageIdx : 0;
+}
+
 void TIFFReaderLibtiff::setImageToRead(int sliceIdx) {
-    if(this->filenames.size() > 1) {
+    this->currentImage = sliceIdx;
+    if(!this->planes.empty()) {
+        if(sliceIdx < 0 || sliceIdx >= this->planes.size()) {
+            std::cerr << "ERROR: try to read the image [" << sliceIdx << "] but the image only has [" << this->planes.size() << "] planes" << std::endl;
+            return;
+        }
+        const std::pair<int, int>& plane = this->planes[sliceIdx];
+        this->openImage(plane.first);
+        if(plane.second != this->currentDirectory) {
+            // The directories are indexed only when all the planes are in a single file
+            if(this->filenames.size() == 1 && plane.second < this->directoryOffsets.size())
+                TIFFSetSubDirectory(this->tif, this->directoryOffsets[plane.second]);
+            else
+                TIFFSetDirectory(this->tif, plane.second);
+            this->currentDirectory = plane.second;
+        }
+    } else if(this->filenames.size() > 1) {
         this->openImage(sliceIdx);
-    } else {
-        TIFFSetDirectory(this->tif, sliceIdx);
+    } else if(sliceIdx != this->currentDirectory) {
+        if(sliceIdx < 0 || sliceIdx >= this->directoryOffsets.size()) {
+            std::cerr << "ERROR: try to read the slice [" << sliceIdx << "] but the image only has [" << this->directoryOffsets.size() << "] slices" << std::endl;
+            return;
+        }
+        TIFFSetSubDirectory(this->tif, this->directoryOffsets[sliceIdx]);
+        this->currentDirectory = sliceIdx;
     }
 }
 
@@ -284,3 +727,119 @@ tsize_t TIFFReaderLibtiff::getScanLineSize() const {
 int TIFFReaderLibtiff::readScanline(tdata_t buf, uint32 row) const {
     return TIFFReadScanline(this->tif, buf, row);
 }
+
+bool TIFFReaderLibtiff::isTiled() const {
+    return TIFFIsTiled(this->tif);
+}
+
+bool TIFFReaderLibtiff::isCompressed() const {
+    uint16_t compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(this->tif, TIFFTAG_COMPRESSION, &compression);
+    return compression != COMPRESSION_NONE;
+}
+
+bool TIFFReaderLibtiff::canReadByBlock() const {
+    uint16_t planarConfig = PLANARCONFIG_CONTIG;
+    uint16_t samplesPerPixel = 1;
+    uint16_t bitsPerSample = 0;
+    TIFFGetFieldDefaulted(this->tif, TIFFTAG_PLANARCONFIG, &planarConfig);
+    TIFFGetFieldDefaulted(this->tif, TIFFTAG_SAMPLESPERPIXEL, &samplesPerPixel);
+    TIFFGetFieldDefaulted(this->tif, TIFFTAG_BITSPERSAMPLE, &bitsPerSample);
+    if(planarConfig == PLANARCONFIG_SEPARATE && samplesPerPixel > 1)
+        return false;
+    return bitsPerSample % 8 == 0;
+}
+
+const unsigned char * TIFFReaderLibtiff::readRows(uint32 firstRow, uint32 lastRow, uint32 rowStep) {
+    uint32_t width = 0;
+    uint32_t length = 0;
+    TIFFGetField(this->tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(this->tif, TIFFTAG_IMAGELENGTH, &length);
+    lastRow = std::min(lastRow, static_cast<uint32>(length));
+    if(lastRow <= firstRow)
+        return this->rowBuffer.data();
+
+    const tsize_t scanLineSize = this->getScanLineSize();
+    this->rowBuffer.resize(static_cast<std::size_t>(lastRow - firstRow) * scanLineSize);
+    unsigned char * out = this->rowBuffer.data();
+
+    if(!this->canReadByBlock()) {
+        if(this->isTiled()) {
+            std::cerr << "ERROR: tiled images with separated planes are not supported" << std::endl;
+            std::fill(this->rowBuffer.begin(), this->rowBuffer.end(), 0);
+            return out;
+        }
+        for(uint32 row = firstRow; row < lastRow; row += rowStep) {
+            if(this->readScanline(out + (row - firstRow) * scanLineSize, row) < 0) {
+                std::cerr << "ERROR: can't read the row [" << row << "] of the image [" << this->currentImage << "]" << std::endl;
+                std::fill(out + (row - firstRow) * scanLineSize, out + (row - firstRow + 1) * scanLineSize, 0);
+            }
+        }
+        return out;
+    }
+
+    // Inside a parallel region each thread already decodes its own slices
+    if(this->nbDecoders > 1 && !omp_in_parallel() && this->isCompressed() && this->readRowsParallel(firstRow, lastRow, out))
+        return out;
+
+    if(!this->isTiled()) {
+        uint32_t rowsPerStrip = length;
+        TIFFGetFieldDefaulted(this->tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        rowsPerStrip = std::min(rowsPerStrip, length);
+        this->blockBuffer.resize(TIFFStripSize(this->tif));
+
+        for(uint32 stripFirstRow = firstRow - firstRow % rowsPerStrip; stripFirstRow < lastRow; stripFirstRow += rowsPerStrip) {
+            const tstrip_t strip = TIFFComputeStrip(this->tif, stripFirstRow, 0);
+            const uint32 stripLastRow = std::min(stripFirstRow + rowsPerStrip, static_cast<uint32>(length));
+            const uint32 copyFirstRow = std::max(stripFirstRow, firstRow);
+            const uint32 copyLastRow = std::min(stripLastRow, lastRow);
+            tmsize_t readSize = 0;
+            if(copyFirstRow == stripFirstRow && copyLastRow == stripLastRow) {
+                // The whole strip is needed, decode it in place
+                readSize = TIFFReadEncodedStrip(this->tif, strip, out + (stripFirstRow - firstRow) * scanLineSize, (stripLastRow - stripFirstRow) * scanLineSize);
+            } else {
+                readSize = TIFFReadEncodedStrip(this->tif, strip, this->blockBuffer.data(), this->blockBuffer.size());
+                if(readSize >= 0)
+                    std::copy(this->blockBuffer.begin() + (copyFirstRow - stripFirstRow) * scanLineSize,
+                              this->blockBuffer.begin() + (copyLastRow - stripFirstRow) * scanLineSize,
+                              out + (copyFirstRow - firstRow) * scanLineSize);
+            }
+            // The buffer is reused between slices, the rows of a broken strip must not keep the previous values
+            if(readSize < 0) {
+                std::cerr << "ERROR: can't decode the strip [" << strip << "] of the image [" << this->currentImage << "]" << std::endl;
+                std::fill(out + (copyFirstRow - firstRow) * scanLineSize, out + (copyLastRow - firstRow) * scanLineSize, 0);
+            }
+        }
+    } else {
+        uint32_t tileWidth = 0;
+        uint32_t tileLength = 0;
+        TIFFGetField(this->tif, TIFFTAG_TILEWIDTH, &tileWidth);
+        TIFFGetField(this->tif, TIFFTAG_TILELENGTH, &tileLength);
+        const tsize_t tileRowSize = TIFFTileRowSize(this->tif);
+        const tsize_t pixelSize = tileRowSize / tileWidth;
+        this->blockBuffer.resize(TIFFTileSize(this->tif));
+
+        for(uint32 tileY = firstRow - firstRow % tileLength; tileY < lastRow; tileY += tileLength) {
+            const uint32 copyFirstRow = std::max(tileY, firstRow);
+            const uint32 copyLastRow = std::min(tileY + tileLength, lastRow);
+            for(uint32 tileX = 0; tileX < width; tileX += tileWidth) {
+                const ttile_t tile = TIFFComputeTile(this->tif, tileX, tileY, 0, 0);
+                const bool isDecoded = TIFFReadEncodedTile(this->tif, tile, this->blockBuffer.data(), this->blockBuffer.size()) >= 0;
+                if(!isDecoded)
+                    std::cerr << "ERROR: can't decode the tile [" << tile << "] of the image [" << this->currentImage << "]" << std::endl;
+                // Tiles on the right border are padded
+                const tsize_t copySize = std::min(tileWidth, width - tileX) * pixelSize;
+                for(uint32 row = copyFirstRow; row < copyLastRow; ++row) {
+                    unsigned char * dst = out + (row - firstRow) * scanLineSize + tileX * pixelSize;
+                    if(isDecoded) {
+                        const unsigned char * src = this->blockBuffer.data() + (row - tileY) * tileRowSize;
+                        std::copy(src, src + copySize, dst);
+                    } else {
+                        std::fill(dst, dst + copySize, 0);
+                    }
+                }
+            }
+        }
+    }
+    return out;
+}
@@ -6,6 +6,11 @@
 #include <tiff.h>
 #include <tiffio.h>
 #include "cache.hpp"
+#include "mapped_file.hpp"
+#include "convert.hpp"
+#include "brick_volume.hpp"
+#include "raw_volume.hpp"
+#include "metadata_cache.hpp"
 #include <fstream>
 #include <bitset>
 //#include <sys/stat.h>
@@ -20,8 +25,7 @@
 //! \defgroup img Image
 //! @brief Modules to read images from multiple formats. 
 //! The main class is ImageReader .
-//! These classes do not implement any writing functions.
-//! The only functions to write images are Scene::writeDeformedImageTemplated() and Scene::writeGreyscaleTIFFImage() .
+//! The only writing class is RawVolumeWriter, the TIFF images are written by Scene::writeDeformedImageTemplated() and Scene::writeGreyscaleTIFFImage() .
 //
 //! \addtogroup img
 //! @{
@@ -37,7 +41,15 @@ struct TIFFReaderLibtiff {
     int openedImage;
     std::vector<std::string> filenames;
 
+    //! @brief Offsets of all the directories (IFD) of a single file stack, built once at opening.
+    //! It allows to jump directly to any slice instead of walking the IFD chain from the start.
+    std::vector<toff_t> directoryOffsets;
+    //! @brief Index of the directory currently read in a single file stack.
+    int currentDirectory;
+
     TIFFReaderLibtiff(const std::vector<std::string>& filename);
+    //! @brief Open a new handle on files already indexed, used to read the same image from multiple threads.
+    TIFFReaderLibtiff(const std::vector<std::string>& filename, const std::vector<toff_t>& directoryOffsets);
 
     glm::vec3 getImageResolution() const;
     glm::vec3 getVoxelSize() const;
@@ -48,19 +60,103 @@ struct TIFFReaderLibtiff {
 
     int readScanline(tdata_t buf, uint32 row) const;
 
+    //! @brief Buffer where a whole strip or tile is decoded when it is only partially needed. Kept between calls to avoid a malloc per slice.
+    std::vector<unsigned char> blockBuffer;
+    //! @brief Buffer containing the rows returned by readRows(), laid out contiguously with getScanLineSize() bytes per row.
+    std::vector<unsigned char> rowBuffer;
+
+    bool isTiled() const;
+
+    //! @brief Check if the current image can be decoded by whole strips or tiles.
+    //! Images with separated planes or with samples smaller than a byte have to be read scanline per scanline.
+    bool canReadByBlock() const;
+
+    bool isCompressed() const;
+
+    //! @brief Decode the rows [firstRow, lastRow[ of the current image.
+    //! Whole encoded strips or tiles are decoded at once, the scanline API is used only when canReadByBlock() is false.
+    //! When the image is compressed and readRows() is not called from a parallel region, the blocks are decoded in parallel, see setNbDecoders().
+    //! @param rowStep Only used by the scanline fallback, rows that are not a multiple of rowStep from firstRow are not read.
+    //! @return A pointer to the first byte of firstRow, valid until the next call.
+    const unsigned char * readRows(uint32 firstRow, uint32 lastRow, uint32 rowStep = 1);
+
+    //! @brief Set how many threads decode the compressed blocks of an image, 1 decodes them on the calling thread.
+    //! The raw blocks are read by this handle, then each thread decodes them with its own handle opened on the same files.
+    //! These handles are only opened the first time a compressed image is read. Default to the number of OpenMP threads.
+    void setNbDecoders(int nbDecoders);
+    int getNbDecoders() const { return this->nbDecoders; }
+
     //! @brief The TIFFReader class can handle multiple tiff images, this function set which image has to be read.
     void openImage(int imageIdx);
 
+    //! @brief File index and directory of each image, used when the images are neither one per file nor one per directory, see OMETIFFReader.
+    //! Empty for a regular stack.
+    std::vector<std::pair<int, int>> planes;
+
+    //! @brief Index in filenames of the file containing the image imageIdx.
+    int getFileIdx(int imageIdx) const;
+
     //! @brief A single tiff image file can contain an entire stack of images, this function set which image has to be read in the current tiff image.
+    //! @param sliceIdx Index of the image, which is a plane index when planes is set.
     void setImageToRead(int sliceIdx);
 
+    //! @brief Close the image and the decoding handles.
     void closeImage();
+
+private:
+    //! @brief Index of the image selected by setImageToRead(), used to select the same image in the decoders.
+    int currentImage;
+    int nbDecoders;
+    std::vector<TIFFReaderLibtiff*> decoders;
+    //! @brief Encoded blocks read by readRowsParallel(), kept between calls to avoid a malloc per slice.
+    std::vector<std::vector<unsigned char>> rawBlocks;
+
+    //! @brief Walk the whole IFD chain once to fill directoryOffsets.
+    void buildDirectoryOffsets();
+
+    //! @brief Read the encoded blocks of the rows [firstRow, lastRow[ on this thread then decode them in parallel into out.
+    //! @return false if the rows are in a single block, nothing is read then.
+    bool readRowsParallel(uint32 firstRow, uint32 lastRow, unsigned char * out);
+};
+
+//! @brief Read uncompressed native uint16 tiff images directly from memory mapped files.
+//!
+//! The strips positions are resolved once at opening. As the data are already stored in the type used by the Cache,
+//! a slice can be exposed as a view on the mapping instead of being decoded and copied by libtiff.
+struct TIFFMappedReader {
+
+    std::vector<MappedFile*> files;
+    //! @brief For each image the index of the file containing it and the position of its first byte in this file.
+    std::vector<std::pair<int, std::size_t>> slicePositions;
+    glm::vec3 imgResolution;
+    //! @brief Number of images, which is the number of slices times the number of channels.
+    int nbPlanes;
+
+    //! @brief Check if the image currently opened by tiffReader can be mapped.
+    static bool isCompatible(TIFF * tif);
+
+    //! @brief Resolve the strip offsets of all the images. Use isValid() to know if every image can be mapped.
+    TIFFMappedReader(TIFFReaderLibtiff * tiffReader, const glm::vec3& imgResolution, int nbPlanes);
+    //! @brief Map the files using image positions already resolved, see MetadataCache.
+    TIFFMappedReader(const std::vector<std::string>& filenames, const glm::vec3& imgResolution, int nbPlanes, const std::vector<std::pair<int, std::size_t>>& slicePositions);
+    ~TIFFMappedReader();
+
+    bool isValid() const;
+
+    //! @brief Values of a whole image, imgResolution[0] values per row.
+    const uint16_t * getSliceView(int sliceIdx) const;
+
+    //! @brief Values of the whole volume if it has a single channel and if all the slices are stored contiguously in a single file, nullptr otherwise.
+    uint16_t * getVolumeView() const;
 };
 
 enum class ImageFormat {
     TIFF,
     OME_TIFF,
-    DIM_IMA
+    DIM_IMA,
+    BRICK_VOLUME,
+    NIFTI,
+    NRRD
 };
 
 //! @brief Get a single value from a buffer casted from imgDataType type to DataType type
@@ -144,105 +240,90 @@ DataType getImageToLowPrecision(Image::ImageDataType imgDataType, const tdata_t&
         //return data;
     }
 }
-//
-//Function to cast and insert for the get slice
-// Important: a cast do not change a value, so if we want to cast from an int we need to make a conversion, this is the usage of needInversion
-template <typename data_t, typename out_data_t>
-void castToUintAndInsert2(data_t * values, std::vector<out_data_t>& res, int duplicate, int offset, std::pair<glm::vec3, glm::vec3> bboxes, bool needInversion = false) {
-    for(int i = bboxes.first[0]; i < bboxes.second[0]; i+=offset) {
-        for(int j = 0; j < duplicate; ++j)
-            if(needInversion)
-                res.push_back(static_cast<out_data_t>((std::bitset<sizeof(data_t) * CHAR_BIT>(values[i]).flip(std::bitset<sizeof(data_t)*CHAR_BIT>().size()-1)).to_ulong())); 
-            else
-                res.push_back(static_cast<out_data_t>(values[i])); 
-    }
-}
-
-//Function to cast and insert for the get slice
-template <typename data_t>
-void castToLowPrecision2(Image::ImageDataType imgDataType, const tdata_t& buf, std::vector<data_t>& res, int duplicate, int offset, std::pair<glm::vec3, glm::vec3> bboxes) {
-    if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
-        uint8_t * data = static_cast<uint8_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16)) {
-        uint16_t * data = static_cast<uint16_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32)) {
-        uint32_t * data = static_cast<uint32_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64)) {
-        uint64_t * data = static_cast<uint64_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_8)) {
-        int8_t * data = static_cast<int8_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_16)) {
-        int16_t * data = static_cast<int16_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_32)) {
-        int32_t * data = static_cast<int32_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_64)) {
-        int64_t * data = static_cast<int64_t*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes, true);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
-        float * data = static_cast<float*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } else if(imgDataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_64)) {
-        double * data = static_cast<double*>(buf);
-        castToUintAndInsert2(data, res, duplicate, offset, bboxes);
-    } 
-}
-
 
 struct TIFFReader {
 
     glm::vec3 voxelSize; // Read from the image, not necessarily the one used in the software
     glm::vec3 imgResolution;
     Image::ImageDataType imgDataType;
+    //! @brief Each channel of a slice is a separate image, the image of the channel c of the slice z is z*nbChannels+c.
+    int nbChannels;
 
     TIFFReaderLibtiff * tiffReader;
+    //! @brief Used instead of tiffReader when the image is uncompressed native uint16, nullptr otherwise.
+    TIFFMappedReader * mappedReader;
+    //! @brief One libtiff handle per reading thread, the first one is tiffReader. See setNbThreads().
+    std::vector<TIFFReaderLibtiff*> threadReaders;
 
     TIFFReader(const std::vector<std::string>& filename);
+    //! @brief Open the image described by a valid metadata cache without probing the files again.
+    TIFFReader(const MetadataCache::Metadata& metadata);
 
     ~TIFFReader() {
+        delete this->mappedReader;
+        this->setNbThreads(1);
         this->tiffReader->closeImage();
     }
 
+    //! @brief Open enough libtiff handles to allow nbThreads threads to call getSlice() at the same time.
+    void setNbThreads(int nbThreads);
+
+    //! @brief Try to map the files listed by tiffReader in memory, it needs to be called again if the files list changes.
+    void openMappedReader();
+
+    //! @brief Store the layout of the image, found when it was opened, into metadata.
+    void fillMetadata(MetadataCache::Metadata& metadata) const;
+
+    //! @brief Print the decoding throughput of the nbSlices first slices, decoded on a single thread then with the parallel decoders.
+    //! The slices are read once before, so that both are measured from the system file cache.
+    //! The number of decoders is restored afterwards. Run with --bench-decoding, see main().
+    void benchmarkDecoding(int nbSlices);
+
+    uint16_t * getVolumeView() const {
+        return this->mappedReader ? this->mappedReader->getVolumeView() : nullptr;
+    }
+
     uint16_t getValue(const glm::vec3& coord) const;
 
+    //! @brief Value of the first channel using nearest neighbor interpolation, the coordinates are clamped to the image.
+    //! The row is decoded into the buffer of tiffReader, the voxels read in bulk go through Sampler::getGridSlice() instead.
     template<typename DataType>
     DataType getValue(const glm::vec3& coord) const {
-        // If we read directly from the raw image we use Nearest Neighbor interpolation
-        const glm::ivec3 newCoord{std::floor(coord[0]), std::floor(coord[1]), std::floor(coord[2])};
-        int imageIdx = newCoord[2];
+        glm::ivec3 p;
+        for(int i = 0; i < 3; ++i)
+            p[i] = std::min(std::max(static_cast<int>(std::floor(coord[i])), 0), static_cast<int>(this->imgResolution[i]) - 1);
+        const int imageIdx = p.z * this->nbChannels;
+        if(this->mappedReader)
+            return static_cast<DataType>(this->mappedReader->getSliceView(imageIdx)[static_cast<std::size_t>(p.y) * static_cast<std::size_t>(this->imgResolution[0]) + p.x]);
         this->tiffReader->setImageToRead(imageIdx);
-        tdata_t buf = _TIFFmalloc(this->tiffReader->getScanLineSize());
-        this->tiffReader->readScanline(buf, newCoord[1]);
-        DataType res = getToLowPrecision<DataType>(this->getInternalDataType(), buf, newCoord[0]);
-        _TIFFfree(buf);
-        return res;
+        tdata_t row = const_cast<unsigned char*>(this->tiffReader->readRows(p.y, p.y + 1));
+        return getToLowPrecision<DataType>(this->getInternalDataType(), row, p.x);
     }
 
     template <typename data_t>
     void getImage(int sliceIdx, std::vector<data_t>& result, std::pair<glm::vec3, glm::vec3> bboxes) const {
-        this->tiffReader->setImageToRead(sliceIdx);
+        this->tiffReader->setImageToRead(sliceIdx * this->nbChannels);
 
-        tdata_t buf;
-        buf = _TIFFmalloc(this->tiffReader->getScanLineSize());
+        const uint32 firstRow = bboxes.first[1];
+        const uint32 lastRow = bboxes.second[1];
+        const tsize_t scanLineSize = this->tiffReader->getScanLineSize();
+        const unsigned char * rows = this->tiffReader->readRows(firstRow, lastRow);
 
-        uint32 row;
-        for (row = bboxes.first[1]; row < bboxes.second[1]; row+=1) {
-            this->tiffReader->readScanline(buf, row);
-            castToLowPrecision2(this->getInternalDataType(), buf, result, 1, 1, bboxes);
-        }
-        _TIFFfree(buf);
+        Convert::RowKernel<data_t> convertRow = Convert::getRowKernel<data_t>(this->getInternalDataType());
+        const int rowSize = Convert::getNbValues(bboxes.first[0], bboxes.second[0], 1);
+        std::size_t insertIdx = result.size();
+        result.resize(insertIdx + static_cast<std::size_t>(rowSize) * (lastRow - firstRow));
+
+        for (uint32 row = firstRow; row < lastRow; row+=1)
+            insertIdx += convertRow(rows + (row - firstRow) * scanLineSize, result.data() + insertIdx, bboxes.first[0], bboxes.second[0], 1, 1);
     }
 
     Image::ImageDataType getInternalDataType() const;
 
     //! @brief See ImageReader::getSlice() .
-    void getSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes) const;
+    //! Instantiated for uint8_t, uint16_t and float, the types used by Cache.
+    template<typename out_t>
+    void getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx = 0) const;
 };
 
 inline bool fileExist (const std::string& name) {
@@ -254,39 +335,54 @@ inline bool fileExist (const std::string& name) {
   }
 }
 
+//! @brief Maximum number of channels loaded from an image, the GPU textures have at most 4 channels.
+#define MAX_NB_CHANNELS 4
+
+//! @brief Layout of the planes of an OME-TIFF image, as described by the Pixels and TiffData elements of its XML.
+namespace OMETIFF {
+
+    //! @brief PlaneCount consecutive planes, starting at (FirstZ, FirstC, FirstT) in the DimensionOrder, stored in consecutive directories from IFD.
+    struct TiffData {
+        int ifd;
+        int firstZ;
+        int firstC;
+        int firstT;
+        //! @brief -1 for all the remaining planes.
+        int planeCount;
+        //! @brief Empty if the planes are in the file containing the XML.
+        std::string filename;
+
+        TiffData(): ifd(0), firstZ(0), firstC(0), firstT(0), planeCount(-1) {}
+    };
+
+    struct Pixels {
+        glm::ivec3 size;
+        int sizeC;
+        int sizeT;
+        //! @brief For example "XYZCT", the first dimension after XY is the fastest varying one.
+        std::string dimensionOrder;
+        std::vector<TiffData> tiffData;
+
+        Pixels(): size(0, 0, 0), sizeC(1), sizeT(1), dimensionOrder("XYZCT") {}
+    };
+
+    //! @brief Find the file and the directory of each plane of the first time point.
+    //! @param xmlFilename File containing the XML, used by the TiffData without filename.
+    //! @param filenames Files containing the planes.
+    //! @param planes For each plane, sorted by z then by channel, its file index in filenames and its directory.
+    //! @return false if a plane is missing.
+    bool getPlanes(const Pixels& pixels, int nbChannels, const std::string& xmlFilename, std::vector<std::string>& filenames, std::vector<std::pair<int, int>>& planes);
+}
+
+//! @brief Read an OME-TIFF image, which can be split in multiple files and contain multiple channels.
+//! The channels are read from the planes listed by the XML, a slice of nbChannels values per voxel is then returned by getSlice().
+//! Only the first time point is read.
 struct OMETIFFReader : public TIFFReader {
-    OMETIFFReader(const std::vector<std::string>& filename) : TIFFReader(filename) {
-        std::cout << "Start of the OME-TIFF format parsing..." << std::endl;
-        QDir path = QDir(QFileInfo(filename[0].c_str()).absolutePath());
-        this->tiffReader->filenames.clear();
-        char * xmlData; 
-        TIFFGetField(this->tiffReader->tif, TIFFTAG_IMAGEDESCRIPTION, &xmlData);
-        std::string strData(xmlData);
-        if(!strData.empty()) {
-            QXmlStreamReader xmlReader(xmlData); 
-            while (!xmlReader.atEnd()) {
-                xmlReader.readNextStartElement();
-                std::cout << xmlReader.name().toString().toStdString() << std::endl;
-                if(xmlReader.name().toString() == QString("UUID")) {
-                    if(xmlReader.attributes().hasAttribute("FileName")) {
-                        QString finalFileName = path.filePath(xmlReader.attributes().value("FileName").toString());
-                        if(fileExist(finalFileName.toStdString())) {
-                            this->tiffReader->filenames.push_back(finalFileName.toStdString());
-                        } else {
-                            //std::cout << "WARNING: [" << finalFileName.toStdString() << "] file doesn't exist but is present in the XML." << std::endl;
-                        }
-                    }
-                }
-            }
-            std::cout << "[" << this->tiffReader->filenames.size() << "] files found" << std::endl;
-            if (xmlReader.hasError()) {
-                std::cout << "WARNING: the XML file contained in the first ome tiff file's comment has errors." << std::endl;
-            }
-            this->imgResolution[2] = this->tiffReader->filenames.size();
-        } else {
-            std::cout << "WARNING: no XML data has been found in the first ome.tiff file. Those files will be parse as regular tiff files." << std::endl;
-        }
-    }
+    //! @brief The planes are read from the metadata cache instead of the XML.
+    OMETIFFReader(const MetadataCache::Metadata& metadata) : TIFFReader(metadata) {}
+
+    //! @brief When the XML doesn't describe the planes, each file it lists is read as a single slice.
+    OMETIFFReader(const std::vector<std::string>& filename);
 };
 
 
@@ -296,17 +392,23 @@ struct DIMReader {
     glm::vec3 imgResolution;
     Image::ImageDataType imgDataType;
 
+    //! @brief The .ima file, mapped in memory.
+    MappedFile imaFile;
+    //! @brief Only used if the .ima values aren't stored as uint16.
     std::vector<uint16_t> data;
+    //! @brief Points either on the mapped file or on data.
+    uint16_t * values;
 
-    DIMReader(const std::vector<std::string>& filename) {
+    DIMReader(const std::vector<std::string>& filename): values(nullptr) {
         QString imaName = QString(filename[0].c_str());
+        QString dimName = QString(filename[0].c_str());
 
         imaName.replace(".dim", ".ima" );
-        std::ifstream imaFile (imaName.toUtf8());
-        if (!imaFile.is_open())
+        dimName.replace(".ima", ".dim" );
+        if (!this->imaFile.open(imaName.toStdString()))
             return;
 
-        std::ifstream dimFile (imaName.toUtf8());
+        std::ifstream dimFile (dimName.toUtf8());
         if (!dimFile.is_open())
             return;
 
@@ -321,7 +423,7 @@ struct DIMReader {
         while (dummy.find("-type")==std::string::npos)
             dimFile >> dummy;
 
-        //dimFile >> type;
+        dimFile >> type;
 
         while (dummy.find("-dx")==std::string::npos)
             dimFile >> dummy;
@@ -345,33 +447,40 @@ struct DIMReader {
         std::cout << "(ny,dy) = ( " << n[1] << " ; " << d[1] << " ) "<< std::endl;
         std::cout << "(nz,dz) = ( " << n[2] << " ; " << d[2] << " ) "<< std::endl;
 
-        unsigned int size = n[0]*n[1]*n[2];
-        unsigned int sizeIn = size;
+        std::size_t size = static_cast<std::size_t>(n[0])*n[1]*n[2];
+        std::size_t sizeIn = size;
 
-        if( type.find("S16")!=std::string::npos )
+        if( type.find("S16")!=std::string::npos || type.find("U16")!=std::string::npos )
             sizeIn = size*2;
         if( type.find("FLOAT")!=std::string::npos )
             sizeIn = size*4;
 
-        unsigned char * data = new unsigned char[sizeIn];
-
-        imaFile.read((char*)data, sizeIn);
-
-        std::vector<uint16_t> _data(size);
-
-        if( type.find("S16")!=std::string::npos ){
-            for(unsigned int i = 0, j=0 ; i < size ; i ++, j+=2)
-                _data[i] = (uint16_t)data[j];
-        } else if( type.find("FLOAT")!=std::string::npos ){
-            float * floatArray = (float*) data;
+        if (this->imaFile.size < sizeIn) {
+            std::cerr << "ERROR: the file [" << imaName.toStdString() << "] is smaller than the size given in the .dim file" << std::endl;
+            this->imaFile.close();
+            return;
+        }
 
-            for(unsigned int i = 0 ; i < size ; i ++)
-                _data[i] = (uint16_t)floatArray[i];
+        unsigned char * rawData = this->imaFile.data;
 
-            delete [] floatArray;
+        if( type.find("U16")!=std::string::npos ){
+            // Already in the cache format, the values are used directly from the mapping
+            this->values = reinterpret_cast<uint16_t*>(rawData);
         } else {
-            for(unsigned int i = 0 ; i < size ; i ++)
-                _data[i] = (uint16_t)data[i];
+            this->data.resize(size);
+            if( type.find("S16")!=std::string::npos ){
+                for(std::size_t i = 0, j=0 ; i < size ; i ++, j+=2)
+                    this->data[i] = (uint16_t)rawData[j];
+            } else if( type.find("FLOAT")!=std::string::npos ){
+                float * floatArray = (float*) rawData;
+                for(std::size_t i = 0 ; i < size ; i ++)
+                    this->data[i] = (uint16_t)floatArray[i];
+            } else {
+                for(std::size_t i = 0 ; i < size ; i ++)
+                    this->data[i] = (uint16_t)rawData[i];
+            }
+            this->values = this->data.data();
+            this->imaFile.close();
         }
 
         this->imgResolution[0] = n[0];
@@ -381,45 +490,46 @@ struct DIMReader {
         this->voxelSize[1] = d[1];
         this->voxelSize[2] = d[2];
         this->imgDataType = (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16);
-
-        delete [] data;
-        this->data = _data;
     }
 
     ~DIMReader() {
     }
 
-    int from3DTo1D(const glm::vec3& p) const {
-        return p[0] + this->imgResolution[0] * p[1] + this->imgResolution[0] * this->imgResolution[1] * p[2]; 
+    std::size_t from3DTo1D(const glm::vec3& p) const {
+        return static_cast<std::size_t>(p[0]) + this->imgResolution[0] * static_cast<std::size_t>(p[1]) + static_cast<std::size_t>(this->imgResolution[0] * this->imgResolution[1]) * static_cast<std::size_t>(p[2]);
     }
 
     uint16_t getValue(const glm::vec3& coord) const {
-        return this->data[this->from3DTo1D(coord)];
+        return this->values[this->from3DTo1D(coord)];
     }
 
     Image::ImageDataType getInternalDataType() const {
         return this->imgDataType;
     }
 
+    uint16_t * getVolumeView() const {
+        return this->imaFile.isOpen() ? this->values : nullptr;
+    }
+
     //! @brief See ImageReader::getSlice() .
-    void getSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes) const {
+    template<typename out_t>
+    void getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx = 0) const {
         float k = sliceIdx;
-        result.clear();
         for(int j = bboxes.first[1]; j < bboxes.second[1]; j+=offsets.second) {
             for(int i = bboxes.first[0]; i < bboxes.second[0]; i+=offsets.first) {
                 for(int l = 0; l < nbChannel; ++l) {
-                    result.push_back(this->from3DTo1D(glm::vec3(i, j, k)));
+                    result.push_back(static_cast<out_t>(this->getValue(glm::vec3(i, j, k))));
                 }
             }
         }
     }
 };
 
-//! @brief Provides functions to read values from a TIFF, OME-TIFF or DIM-IMA image.
+//! @brief Provides functions to read values from a TIFF, OME-TIFF, DIM-IMA, NIfTI, NRRD or bricked volume (see BrickVolume) image.
 //! \warning DIM-IMA reader has not been maintained from a long time and is not available for the user.
 //! \note
 //! This class do not implement any writing functions.
-//! The only functions to write images are Scene::writeDeformedImageTemplated() and Scene::writeGreyscaleTIFFImage() .
+//! The NIfTI and NRRD images are written by RawVolumeWriter, the TIFF images by Scene::writeDeformedImageTemplated() and Scene::writeGreyscaleTIFFImage() .
 struct ImageReader {
 
     ImageFormat imageFormat;
@@ -427,34 +537,91 @@ struct ImageReader {
     TIFFReader * tiffImageReader;
     OMETIFFReader * omeTiffImageReader;
     DIMReader * dimImageReader;
+    BrickVolumeReader * brickVolumeReader;
+    RawVolumeReader * rawVolumeReader;
 
     glm::vec3 voxelSize; // Read from the image, not necessarily the one used in the software
     glm::vec3 imgResolution;
     Image::ImageDataType imgDataType;
 
+    //! @brief Number of channels of the image, see getSlice().
+    int nbChannels;
+
     uint16_t maxValue;
     uint16_t minValue;
 
-    ImageReader(const std::vector<std::string>& filename) {
+    //! @brief Files given to open the image, the metadata cache is written next to the first one.
+    std::vector<std::string> filenames;
+    //! @brief Informations found when the image was opened, or read from the metadata cache. See MetadataCache.
+    MetadataCache::Metadata metadata;
+
+    ImageReader(const std::vector<std::string>& filename): tiffImageReader(nullptr), omeTiffImageReader(nullptr), dimImageReader(nullptr), brickVolumeReader(nullptr), rawVolumeReader(nullptr), nbChannels(1), filenames(filename) {
         std::string extension = filename[0].substr(filename[0].find_last_of(".") + 1);
+        if(extension == "bvol") {
+            this->imageFormat = ImageFormat::BRICK_VOLUME;
+            this->brickVolumeReader = new BrickVolumeReader(filename[0]);
+            this->voxelSize = this->brickVolumeReader->voxelSize;
+            this->imgResolution = this->brickVolumeReader->imgResolution;
+            this->imgDataType = this->brickVolumeReader->imgDataType;
+            // The header is quickly read, only the statistics are worth caching
+            if(!this->loadMetadata())
+                this->initMetadata();
+            return;
+        }
+        RawVolume::Format rawFormat;
+        if(RawVolume::getFormat(filename[0], rawFormat)) {
+            this->imageFormat = (rawFormat == RawVolume::Format::NIfTI) ? ImageFormat::NIFTI : ImageFormat::NRRD;
+            this->rawVolumeReader = new RawVolumeReader(filename[0]);
+            this->voxelSize = this->rawVolumeReader->voxelSize;
+            this->imgResolution = this->rawVolumeReader->imgResolution;
+            this->imgDataType = this->rawVolumeReader->imgDataType;
+            this->nbChannels = std::min(this->rawVolumeReader->nbChannels, MAX_NB_CHANNELS);
+            // As for the bricked volumes, only the statistics are worth caching
+            if(!this->loadMetadata())
+                this->initMetadata();
+            return;
+        }
         if(filename.size() > 0 || extension == "tif" || extension == "tiff") {
             if(filename[0].substr(filename[0].find_first_of(".") + 1).find("ome")!=std::string::npos) {
                 this->imageFormat = ImageFormat::OME_TIFF;
-                this->omeTiffImageReader = new OMETIFFReader(filename);
+                const bool isMetadataCached = this->loadMetadata();
+                if(isMetadataCached) {
+                    std::cout << "Use the metadata cache [" << MetadataCache::getSidecarFilename(filename[0]) << "]" << std::endl;
+                    this->omeTiffImageReader = new OMETIFFReader(this->metadata);
+                } else {
+                    this->omeTiffImageReader = new OMETIFFReader(filename);
+                }
                 this->tiffImageReader = nullptr;
                 this->dimImageReader = nullptr;
                 this->voxelSize = this->omeTiffImageReader->voxelSize;
                 this->imgResolution = this->omeTiffImageReader->imgResolution;
                 this->imgDataType = this->omeTiffImageReader->imgDataType;
+                this->nbChannels = this->omeTiffImageReader->nbChannels;
+                if(!isMetadataCached) {
+                    this->initMetadata();
+                    this->omeTiffImageReader->fillMetadata(this->metadata);
+                    this->saveMetadata();
+                }
                 return;
             } else {
                 this->imageFormat = ImageFormat::TIFF;
-                this->tiffImageReader = new TIFFReader(filename);
+                const bool isMetadataCached = this->loadMetadata();
+                if(isMetadataCached) {
+                    std::cout << "Use the metadata cache [" << MetadataCache::getSidecarFilename(filename[0]) << "]" << std::endl;
+                    this->tiffImageReader = new TIFFReader(this->metadata);
+                } else {
+                    this->tiffImageReader = new TIFFReader(filename);
+                }
                 this->omeTiffImageReader = nullptr;
                 this->dimImageReader = nullptr;
                 this->voxelSize = this->tiffImageReader->voxelSize;
                 this->imgResolution = this->tiffImageReader->imgResolution;
                 this->imgDataType = this->tiffImageReader->imgDataType;
+                if(!isMetadataCached) {
+                    this->initMetadata();
+                    this->tiffImageReader->fillMetadata(this->metadata);
+                    this->saveMetadata();
+                }
                 return;
             }
         }
@@ -467,15 +634,47 @@ struct ImageReader {
             this->voxelSize = this->dimImageReader->voxelSize;
             this->imgResolution = this->dimImageReader->imgResolution;
             this->imgDataType = this->dimImageReader->imgDataType;
+            if(!this->loadMetadata())
+                this->initMetadata();
             return;
         }
     }
 
+    //! @brief Read the metadata cache, it is ignored if it was written for another format.
+    bool loadMetadata() {
+        MetadataCache::Metadata metadata;
+        if(!MetadataCache::read(this->filenames, metadata) || metadata.imageFormat != static_cast<int>(this->imageFormat))
+            return false;
+        const bool isTIFF = (this->imageFormat == ImageFormat::TIFF || this->imageFormat == ImageFormat::OME_TIFF);
+        if(isTIFF && metadata.filenames.empty())
+            return false;
+        this->metadata = std::move(metadata);
+        return true;
+    }
+
+    //! @brief Reset the metadata to the informations of the opened image.
+    void initMetadata() {
+        this->metadata = MetadataCache::Metadata();
+        this->metadata.imageFormat = static_cast<int>(this->imageFormat);
+        this->metadata.imgResolution = this->imgResolution;
+        this->metadata.voxelSize = this->voxelSize;
+        this->metadata.imgDataType = this->imgDataType;
+        this->metadata.nbChannels = this->nbChannels;
+    }
+
+    //! @brief Write the metadata cache, to be called when metadata is updated.
+    void saveMetadata() const {
+        MetadataCache::write(this->filenames, this->metadata);
+    }
+
     ~ImageReader() {
         delete this->dimImageReader;
         delete this->tiffImageReader;
+        delete this->brickVolumeReader;
+        delete this->rawVolumeReader;
     }
 
+    //! @brief Value of the first channel at coord using nearest neighbor interpolation.
     uint16_t getValue(const glm::vec3& coord) const {
         switch(this->imageFormat) {
             case ImageFormat::TIFF :
@@ -487,6 +686,13 @@ struct ImageReader {
             case ImageFormat::OME_TIFF :
                 return this->omeTiffImageReader->getValue(coord);
                 break;
+            case ImageFormat::BRICK_VOLUME :
+                return this->brickVolumeReader->getValue(coord);
+                break;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                return this->rawVolumeReader->getValue(coord);
+                break;
         }
     }
 
@@ -500,7 +706,14 @@ struct ImageReader {
                 return 0.; 
                 break;
             case ImageFormat::OME_TIFF :
-                return 0.;
+                return this->omeTiffImageReader->getValue<DataType>(coord);
+                break;
+            case ImageFormat::BRICK_VOLUME :
+                return static_cast<DataType>(this->brickVolumeReader->getVoxel(glm::ivec3(glm::floor(coord)), 0));
+                break;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                return static_cast<DataType>(this->rawVolumeReader->getValue(coord));
                 break;
         }
     }
@@ -509,27 +722,122 @@ struct ImageReader {
         return this->imgDataType;
     }
 
+    int getNbChannels() const {
+        return this->nbChannels;
+    }
+
+    //! @brief Get the whole volume without any copy if the file is mapped in memory and its values are stored as contiguous native uint16.
+    //! @return nullptr if the volume can't be accessed directly.
+    uint16_t * getVolumeView() const {
+        switch(this->imageFormat) {
+            case ImageFormat::TIFF :
+                return this->tiffImageReader->getVolumeView();
+            case ImageFormat::DIM_IMA :
+                return this->dimImageReader->getVolumeView();
+            case ImageFormat::OME_TIFF :
+                return this->omeTiffImageReader->getVolumeView();
+            case ImageFormat::BRICK_VOLUME :
+                return nullptr;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                return this->rawVolumeReader->getVolumeView();
+        }
+        return nullptr;
+    }
+
+    //! @brief Allow nbThreads threads to call getSlice() at the same time, each one with its own threadIdx.
+    void setNbThreads(int nbThreads) {
+        switch(this->imageFormat) {
+            case ImageFormat::TIFF :
+                this->tiffImageReader->setNbThreads(nbThreads);
+                break;
+            case ImageFormat::DIM_IMA :
+                break;
+            case ImageFormat::OME_TIFF :
+                this->omeTiffImageReader->setNbThreads(nbThreads);
+                break;
+            case ImageFormat::BRICK_VOLUME :
+                break;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                this->rawVolumeReader->setNbThreads(nbThreads);
+                break;
+        }
+    }
+
     //! @brief Get one image of an image stack.
     //! @param sliceIdx Image index to get.
-    //! @param nbChannel WARNING: this parameter isn't fully supported yet, for now it just duplicate the data to simulate multiple channels.
+    //! @param nbChannel Number of values per voxel in result, the channels are interleaved.
+    //! If the image has less than nbChannel channels its last channel is duplicated, if it has more the last ones are skipped.
     //! @param offsets With offsets = {1, 1}, no pixel are skipped and a slice at the original image resolution is returned.
     //! With offsets = {2, 1}, all pixels with odd x coordinates will be skipped, which result with a slice with
     //! half the resolution on the x axis.
     //! With offsets = {3, 3}, the result image resolution will be divided per 3 on x and y axis.
     //! @param bboxes Allow to query only a subregion of the image using this bbox.
+    //! @param threadIdx Index of the calling thread, in [0, nbThreads[ with nbThreads the value given to setNbThreads().
     //! @note As the z axis is fixed (the sliceIdx parameter), you cannot change the z resolution
-    void getSlice(int sliceIdx, std::vector<std::uint16_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes) const {
+    //! @note The values are converted to out_t, which can be uint8_t, uint16_t or float.
+    template<typename out_t>
+    void getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx = 0) const {
         switch(this->imageFormat) {
             case ImageFormat::TIFF :
-                this->tiffImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes);
+                this->tiffImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes, threadIdx);
+                break;
+            case ImageFormat::DIM_IMA :
+                this->dimImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes, threadIdx);
+                break;
+            case ImageFormat::OME_TIFF :
+                this->omeTiffImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes, threadIdx);
+                break;
+            case ImageFormat::BRICK_VOLUME :
+                this->brickVolumeReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes, threadIdx);
+                break;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                this->rawVolumeReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes, threadIdx);
                 break;
+        }
+    }
+
+    //! @brief Whether the slices can be read by getImage(), to check once before reading the whole image.
+    bool canGetImage() const {
+        switch(this->imageFormat) {
             case ImageFormat::DIM_IMA :
-                this->dimImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes);
+                return this->dimImageReader->values != nullptr;
+            case ImageFormat::BRICK_VOLUME :
+                return this->brickVolumeReader->isValid();
+            default :
+                return true;
+        }
+    }
+
+    //! @brief Get the first channel of a whole slice at the original resolution, converted to data_t.
+    //! @return false if the slices can't be read, see canGetImage().
+    template<typename data_t>
+    bool getImage(int sliceIdx, std::vector<data_t>& result) const {
+        const std::pair<glm::vec3, glm::vec3> bboxes(glm::vec3(0., 0., 0.), this->imgResolution);
+        result.clear();
+        if(!this->canGetImage())
+            return false;
+        switch(this->imageFormat) {
+            case ImageFormat::TIFF :
+                this->tiffImageReader->getImage(sliceIdx, result, bboxes);
                 break;
             case ImageFormat::OME_TIFF :
-                this->omeTiffImageReader->getSlice(sliceIdx, result, nbChannel, offsets, bboxes);
+                this->omeTiffImageReader->getImage(sliceIdx, result, bboxes);
+                break;
+            case ImageFormat::DIM_IMA :
+                this->dimImageReader->getSlice(sliceIdx, result, 1, {1, 1}, bboxes);
+                break;
+            case ImageFormat::BRICK_VOLUME :
+                this->brickVolumeReader->getSlice(sliceIdx, result, 1, {1, 1}, bboxes);
+                break;
+            case ImageFormat::NIFTI :
+            case ImageFormat::NRRD :
+                this->rawVolumeReader->getSlice(sliceIdx, result, 1, {1, 1}, bboxes);
                 break;
         }
+        return true;
     }
 };
 
@@ -0,0 +1,266 @@
+#ifndef INTERPOLATION_HPP_
+#define INTERPOLATION_HPP_
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Interpolation of the values of a volume at arbitrary coordinates.
+//!
+//! The kernels are specialized at compile time for each method, the method is only dispatched once per batch of
+//! coordinates, see sample(). They follow the Dirichlet boundary conditions of CImg: the coordinates outside of the
+//! volume return 0 and the voxels outside of the volume are read as 0.
+namespace Interpolation {
+
+    //! @brief Cubic is a Catmull-Rom spline on the values.
+    //! CubicBSpline is an interpolating cubic B-spline, smoother, which samples a volume of coefficients prefiltered once, see prefilterBSpline().
+    enum class Method {
+        NearestNeighbor,
+        Linear,
+        Cubic,
+        CubicBSpline
+    };
+
+    Method fromString(const std::string& method);
+    std::string toString(const Interpolation::Method& method);
+    std::vector<std::string> toStringList();
+
+    //! @brief View on the values of a volume, stored either x fastest or by cubic bricks.
+    //! The offset of a voxel is separable: getOffset(x, y, z) = getOffset(0, x) + getOffset(1, y) + getOffset(2, z),
+    //! so the offsets along each axis can be computed once and combined.
+    template<typename voxel_t>
+    struct Volume {
+        const voxel_t * data;
+        int width;
+        int height;
+        int depth;
+        //! @brief The coordinate i along an axis is in the brick i >> brickShift, at the position i & brickMask in this brick.
+        int brickShift;
+        int brickMask;
+        std::ptrdiff_t brickStrides[3];
+        std::ptrdiff_t voxelStrides[3];
+
+        //! @brief Plain layout, the voxel (x, y, z) is data[x + y * width + z * width * height].
+        Volume(const voxel_t * data, int width, int height, int depth): data(data), width(width), height(height), depth(depth),
+            brickShift(30), brickMask((1 << 30) - 1), brickStrides{0, 0, 0}, voxelStrides{1, width, static_cast<std::ptrdiff_t>(width) * height} {}
+
+        //! @brief Bricked layout, the bricks of brickSize^3 voxels are stored x fastest and so are the voxels inside a brick.
+        //! @param brickSize Has to be a power of 2, the bricks on the border are padded.
+        Volume(const voxel_t * data, int width, int height, int depth, int brickSize): data(data), width(width), height(height), depth(depth) {
+            this->brickShift = 0;
+            while((1 << this->brickShift) < brickSize)
+                this->brickShift += 1;
+            this->brickMask = brickSize - 1;
+            const std::ptrdiff_t brickVolume = static_cast<std::ptrdiff_t>(brickSize) * brickSize * brickSize;
+            const glm::ivec3 nbBricks = getNbBricks(glm::ivec3(width, height, depth), brickSize);
+            this->brickStrides[0] = brickVolume;
+            this->brickStrides[1] = brickVolume * nbBricks.x;
+            this->brickStrides[2] = brickVolume * nbBricks.x * nbBricks.y;
+            this->voxelStrides[0] = 1;
+            this->voxelStrides[1] = brickSize;
+            this->voxelStrides[2] = static_cast<std::ptrdiff_t>(brickSize) * brickSize;
+        }
+
+        static glm::ivec3 getNbBricks(const glm::ivec3& dimension, int brickSize) {
+            return (dimension + glm::ivec3(brickSize - 1)) / brickSize;
+        }
+
+        std::ptrdiff_t getOffset(int axis, int i) const {
+            return (i >> this->brickShift) * this->brickStrides[axis] + (i & this->brickMask) * this->voxelStrides[axis];
+        }
+
+        std::ptrdiff_t getOffset(int x, int y, int z) const {
+            return this->getOffset(0, x) + this->getOffset(1, y) + this->getOffset(2, z);
+        }
+    };
+
+    //! @brief 1D kernel of a method, the sample at x + d, with 0 <= d < 1, reads the voxels [x+firstTap, x+firstTap+nbTaps[ .
+    template<Method method>
+    struct Kernel;
+
+    template<>
+    struct Kernel<Method::NearestNeighbor> {
+        static constexpr int firstTap = 0;
+        static constexpr int nbTaps = 1;
+        static void getWeights(float, float * weights) {
+            weights[0] = 1.f;
+        }
+    };
+
+    template<>
+    struct Kernel<Method::Linear> {
+        static constexpr int firstTap = 0;
+        static constexpr int nbTaps = 2;
+        static void getWeights(float d, float * weights) {
+            weights[0] = 1.f - d;
+            weights[1] = d;
+        }
+    };
+
+    //! @brief Catmull-Rom spline, as CImg::cubic_atXYZ().
+    template<>
+    struct Kernel<Method::Cubic> {
+        static constexpr int firstTap = -1;
+        static constexpr int nbTaps = 4;
+        static void getWeights(float d, float * weights) {
+            const float d2 = d * d;
+            const float d3 = d2 * d;
+            weights[0] = .5f * (-d + 2.f * d2 - d3);
+            weights[1] = 1.f + .5f * (-5.f * d2 + 3.f * d3);
+            weights[2] = .5f * (d + 4.f * d2 - 3.f * d3);
+            weights[3] = .5f * (-d2 + d3);
+        }
+    };
+
+    //! @brief Cubic B-spline, which has to be applied to the coefficients computed by prefilterBSpline().
+    //! The coefficients are mirrored on the borders, as they were computed.
+    template<>
+    struct Kernel<Method::CubicBSpline> {
+        static constexpr int firstTap = -1;
+        static constexpr int nbTaps = 4;
+        static constexpr bool isMirrored = true;
+        static void getWeights(float d, float * weights) {
+            const float e = 1.f - d;
+            const float d2 = d * d;
+            weights[0] = e * e * e / 6.f;
+            weights[1] = (4.f - 6.f * d2 + 3.f * d2 * d) / 6.f;
+            weights[2] = (1.f + 3.f * d + 3.f * d2 - 3.f * d2 * d) / 6.f;
+            weights[3] = d2 * d / 6.f;
+        }
+    };
+
+    template<class K, typename = void>
+    struct IsMirrored : std::false_type {};
+    template<class K>
+    struct IsMirrored<K, typename std::enable_if<K::isMirrored>::type> : std::true_type {};
+
+    //! @brief Indices and weights of the taps along an axis of size voxels.
+    //! The taps outside of the volume read a clamped voxel with a weight of 0, so the kernels don't branch on the border.
+    //! The taps of the mirrored kernels read the voxel mirrored on the border instead.
+    template<Method method>
+    inline void getTaps(float coord, int size, int * indices, float * weights) {
+        typedef Kernel<method> K;
+        const int first = static_cast<int>(std::floor(coord));
+        K::getWeights(coord - static_cast<float>(first), weights);
+        for(int t = 0; t < K::nbTaps; ++t) {
+            const int x = first + K::firstTap + t;
+            if constexpr (IsMirrored<K>::value) {
+                const int mirrored = (x < 0) ? -x : ((x >= size) ? 2 * size - 2 - x : x);
+                indices[t] = std::min(std::max(mirrored, 0), size - 1);
+            } else {
+                indices[t] = std::min(std::max(x, 0), size - 1);
+                weights[t] = (x >= 0 && x < size) ? weights[t] : 0.f;
+            }
+        }
+    }
+
+    //! @brief Offsets in the volume and weights of the taps along an axis.
+    template<Method method, typename voxel_t>
+    inline void getTaps(const Volume<voxel_t>& volume, int axis, float coord, int size, std::ptrdiff_t * offsets, float * weights) {
+        int indices[Kernel<method>::nbTaps];
+        getTaps<method>(coord, size, indices, weights);
+        for(int t = 0; t < Kernel<method>::nbTaps; ++t)
+            offsets[t] = volume.getOffset(axis, indices[t]);
+    }
+
+    //! @brief As CImg::cubic_atXYZ_c(), the cubic overshoots are clamped to the range of integral types.
+    template<Method method, typename voxel_t>
+    inline float clampToType(float value) {
+        if constexpr (method == Method::Cubic && std::is_integral<voxel_t>::value)
+            return static_cast<float>(static_cast<voxel_t>(std::min(std::max(value, static_cast<float>(std::numeric_limits<voxel_t>::min())), static_cast<float>(std::numeric_limits<voxel_t>::max()))));
+        return value;
+    }
+
+    template<Method method, typename voxel_t>
+    inline float sample(const Volume<voxel_t>& volume, const glm::vec3& coord) {
+        if(coord.x < 0.f || coord.y < 0.f || coord.z < 0.f || coord.x >= volume.width || coord.y >= volume.height || coord.z >= volume.depth)
+            return 0.f;
+        constexpr int nbTaps = Kernel<method>::nbTaps;
+        std::ptrdiff_t offsetsX[nbTaps], offsetsY[nbTaps], offsetsZ[nbTaps];
+        float weightsX[nbTaps], weightsY[nbTaps], weightsZ[nbTaps];
+        getTaps<method>(volume, 0, coord.x, volume.width, offsetsX, weightsX);
+        getTaps<method>(volume, 1, coord.y, volume.height, offsetsY, weightsY);
+        getTaps<method>(volume, 2, coord.z, volume.depth, offsetsZ, weightsZ);
+        float value = 0.f;
+        for(int k = 0; k < nbTaps; ++k) {
+            float valueY = 0.f;
+            for(int j = 0; j < nbTaps; ++j) {
+                const voxel_t * row = volume.data + offsetsZ[k] + offsetsY[j];
+                float valueX = 0.f;
+                for(int i = 0; i < nbTaps; ++i)
+                    valueX += weightsX[i] * static_cast<float>(row[offsetsX[i]]);
+                valueY += weightsY[j] * valueX;
+            }
+            value += weightsZ[k] * valueY;
+        }
+        return clampToType<method, voxel_t>(value);
+    }
+
+    //! @brief Same kernels for the volumes which are not addressable by offsets, as the compressed ones.
+    //! @param fetch Called as fetch(x, y, z) for voxels inside of dimension only, returns a voxel_t.
+    template<Method method, typename voxel_t, class Fetch>
+    inline float sample(const glm::ivec3& dimension, const glm::vec3& coord, const Fetch& fetch) {
+        if(coord.x < 0.f || coord.y < 0.f || coord.z < 0.f || coord.x >= dimension.x || coord.y >= dimension.y || coord.z >= dimension.z)
+            return 0.f;
+        constexpr int nbTaps = Kernel<method>::nbTaps;
+        int indicesX[nbTaps], indicesY[nbTaps], indicesZ[nbTaps];
+        float weightsX[nbTaps], weightsY[nbTaps], weightsZ[nbTaps];
+        getTaps<method>(coord.x, dimension.x, indicesX, weightsX);
+        getTaps<method>(coord.y, dimension.y, indicesY, weightsY);
+        getTaps<method>(coord.z, dimension.z, indicesZ, weightsZ);
+        float value = 0.f;
+        for(int k = 0; k < nbTaps; ++k) {
+            float valueY = 0.f;
+            for(int j = 0; j < nbTaps; ++j) {
+                float valueX = 0.f;
+                for(int i = 0; i < nbTaps; ++i)
+                    valueX += weightsX[i] * static_cast<float>(fetch(indicesX[i], indicesY[j], indicesZ[k]));
+                valueY += weightsY[j] * valueX;
+            }
+            value += weightsZ[k] * valueY;
+        }
+        return clampToType<method, voxel_t>(value);
+    }
+
+    //! @brief Sample nbValues coordinates with the same method.
+    template<Method method, typename voxel_t>
+    void sample(const Volume<voxel_t>& volume, const glm::vec3 * coords, std::size_t nbValues, float * result) {
+        #pragma omp simd
+        for(std::size_t i = 0; i < nbValues; ++i)
+            result[i] = sample<method>(volume, coords[i]);
+    }
+
+    template<typename voxel_t>
+    void sample(const Volume<voxel_t>& volume, const glm::vec3 * coords, std::size_t nbValues, float * result, Method method) {
+        switch(method) {
+            case Method::Linear:
+                sample<Method::Linear>(volume, coords, nbValues, result);
+                break;
+            case Method::Cubic:
+                sample<Method::Cubic>(volume, coords, nbValues, result);
+                break;
+            case Method::CubicBSpline:
+                sample<Method::CubicBSpline>(volume, coords, nbValues, result);
+                break;
+            default:
+                sample<Method::NearestNeighbor>(volume, coords, nbValues, result);
+                break;
+        }
+    }
+
+    //! @brief Replace the values of a volume, stored in its own layout, by the coefficients of the cubic B-spline interpolating them.
+    //! The recursive filter of Unser is applied along each axis with mirror boundaries, the lines are filtered in parallel.
+    void prefilterBSpline(float * data, const Volume<float>& volume);
+}
+
+//! @}
+
+#endif
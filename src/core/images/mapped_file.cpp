@@ -0,0 +1,72 @@
+#include "mapped_file.hpp"
+#include <iostream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(): data(nullptr), size(0) {}
+
+MappedFile::~MappedFile() {
+    this->close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+    this->close();
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if(mapping == nullptr)
+        return false;
+    void * view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if(view == nullptr)
+        return false;
+    this->data = static_cast<unsigned char*>(view);
+    this->size = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void * view = mmap(nullptr, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file descriptor is closed
+    ::close(fd);
+    if(view == MAP_FAILED) {
+        std::cerr << "WARNING: unable to map the file [" << filename << "] in memory" << std::endl;
+        return false;
+    }
+    this->data = static_cast<unsigned char*>(view);
+    this->size = static_cast<std::size_t>(fileStat.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if(!this->data)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(this->data);
+#else
+    munmap(this->data, this->size);
+#endif
+    this->data = nullptr;
+    this->size = 0;
+}
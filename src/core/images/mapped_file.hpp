@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_HPP_
+#define MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Map a whole file in memory, pages are loaded by the OS only when they are accessed.
+//! The mapping is private: a write into the data modifies the memory only, never the file on disk.
+struct MappedFile {
+    unsigned char * data;
+    std::size_t size;
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const { return this->data != nullptr; }
+};
+
+//! @}
+
+#endif
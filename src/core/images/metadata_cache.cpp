@@ -0,0 +1,236 @@
+#include "metadata_cache.hpp"
+#include <QFileInfo>
+#include <QDateTime>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+    const char MAGIC[4] = {'V', 'M', 'E', 'T'};
+
+    //! @brief What makes the sidecar of a file outdated.
+    struct FileKey {
+        uint64_t size;
+        int64_t modificationTime;
+
+        bool operator==(const FileKey& other) const {
+            return this->size == other.size && this->modificationTime == other.modificationTime;
+        }
+    };
+
+    FileKey getFileKey(const std::string& filename) {
+        QFileInfo info(QString::fromStdString(filename));
+        return FileKey{static_cast<uint64_t>(info.size()), info.lastModified().toMSecsSinceEpoch()};
+    }
+
+    std::vector<FileKey> getFileKeys(const std::vector<std::string>& filenames) {
+        std::vector<FileKey> keys;
+        for(const std::string& filename : filenames)
+            keys.push_back(getFileKey(filename));
+        return keys;
+    }
+
+    template<typename T>
+    void writeValue(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    void writeVector(std::ofstream& file, const std::vector<T>& values) {
+        writeValue(file, static_cast<uint64_t>(values.size()));
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    void writeString(std::ofstream& file, const std::string& value) {
+        writeValue(file, static_cast<uint64_t>(value.size()));
+        file.write(value.data(), value.size());
+    }
+
+    //! @brief Number of bytes left in file, used to reject the sizes of a corrupted sidecar before allocating them.
+    uint64_t getRemainingSize(std::ifstream& file) {
+        const std::streampos position = file.tellg();
+        if(position < 0)
+            return 0;
+        file.seekg(0, std::ios::end);
+        const std::streampos end = file.tellg();
+        file.seekg(position);
+        return (end < position) ? 0 : static_cast<uint64_t>(end - position);
+    }
+
+    template<typename T>
+    bool readValue(std::ifstream& file, T& value) {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    template<typename T>
+    bool readVector(std::ifstream& file, std::vector<T>& values) {
+        uint64_t size = 0;
+        if(!readValue(file, size) || size > getRemainingSize(file) / sizeof(T))
+            return false;
+        values.resize(size);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()), size * sizeof(T)));
+    }
+
+    bool readString(std::ifstream& file, std::string& value) {
+        uint64_t size = 0;
+        if(!readValue(file, size) || size > getRemainingSize(file))
+            return false;
+        value.resize(size);
+        return static_cast<bool>(file.read(&value[0], size));
+    }
+
+    // Only the non empty bins of the histogram are stored
+    void writeStatistics(std::ofstream& file, const Statistics& statistics) {
+        writeValue(file, static_cast<uint64_t>(statistics.nbValues));
+        writeValue(file, statistics.minValue);
+        writeValue(file, statistics.maxValue);
+        writeValue(file, statistics.sum);
+        writeValue(file, statistics.mapping.offset);
+        writeValue(file, statistics.mapping.scale);
+        std::vector<std::pair<uint32_t, uint64_t>> bins;
+        for(int i = 0; i < Statistics::NB_BINS; ++i) {
+            if(statistics.histogram[i] > 0)
+                bins.push_back(std::make_pair(static_cast<uint32_t>(i), statistics.histogram[i]));
+        }
+        writeVector(file, bins);
+    }
+
+    bool readStatistics(std::ifstream& file, Statistics& statistics) {
+        uint64_t nbValues = 0;
+        std::vector<std::pair<uint32_t, uint64_t>> bins;
+        if(!readValue(file, nbValues) || !readValue(file, statistics.minValue) || !readValue(file, statistics.maxValue) || !readValue(file, statistics.sum) || !readValue(file, statistics.mapping.offset) || !readValue(file, statistics.mapping.scale) || !readVector(file, bins))
+            return false;
+        statistics.nbValues = nbValues;
+        for(const auto& bin : bins) {
+            if(bin.first >= Statistics::NB_BINS)
+                return false;
+            statistics.histogram[bin.first] = bin.second;
+        }
+        return true;
+    }
+}
+
+namespace MetadataCache {
+
+    const Statistics * Metadata::findStatistics(const glm::ivec3& resolutionRatio, int filter) const {
+        for(const StatisticsEntry& entry : this->statistics) {
+            if(entry.resolutionRatio == resolutionRatio && entry.filter == filter)
+                return &entry.statistics;
+        }
+        return nullptr;
+    }
+
+    void Metadata::setStatistics(const glm::ivec3& resolutionRatio, int filter, const Statistics& statistics) {
+        for(StatisticsEntry& entry : this->statistics) {
+            if(entry.resolutionRatio == resolutionRatio && entry.filter == filter) {
+                entry.statistics = statistics;
+                return;
+            }
+        }
+        this->statistics.push_back(StatisticsEntry{resolutionRatio, filter, statistics});
+    }
+
+    std::string getSidecarFilename(const std::string& filename) {
+        return filename + ".meta";
+    }
+
+    bool read(const std::vector<std::string>& filenames, Metadata& metadata) {
+        if(filenames.empty())
+            return false;
+        std::ifstream file(getSidecarFilename(filenames[0]), std::ios::binary);
+        if(!file.is_open())
+            return false;
+
+        char magic[4];
+        uint32_t version = 0;
+        if(!file.read(magic, 4) || std::memcmp(magic, MAGIC, 4) != 0 || !readValue(file, version) || version != VERSION)
+            return false;
+
+        std::vector<FileKey> keys;
+        if(!readVector(file, keys) || keys.size() != filenames.size() || !(keys == getFileKeys(filenames)))
+            return false;
+
+        Metadata result;
+        uint32_t imgDataType = 0;
+        uint64_t nbFiles = 0;
+        uint64_t nbStatistics = 0;
+        if(!readValue(file, result.imageFormat) || !readValue(file, result.imgResolution) || !readValue(file, result.voxelSize) || !readValue(file, imgDataType) || !readValue(file, result.nbChannels) || !readValue(file, nbFiles))
+            return false;
+        result.imgDataType = static_cast<Image::ImageDataType>(imgDataType);
+        // Each file name is stored with its size
+        if(nbFiles > getRemainingSize(file) / sizeof(uint64_t))
+            return false;
+        result.filenames.resize(nbFiles);
+        for(std::string& filename : result.filenames) {
+            if(!readString(file, filename))
+                return false;
+        }
+        // The offsets and positions are only valid if none of the files containing the slices changed
+        std::vector<FileKey> imageKeys;
+        if(!readVector(file, imageKeys) || imageKeys.size() != result.filenames.size() || !(imageKeys == getFileKeys(result.filenames)))
+            return false;
+        if(!readVector(file, result.directoryOffsets) || !readVector(file, result.planes) || !readVector(file, result.slicePositions) || !readValue(file, nbStatistics))
+            return false;
+        if(nbStatistics > getRemainingSize(file) / sizeof(StatisticsEntry::resolutionRatio))
+            return false;
+        result.statistics.resize(nbStatistics);
+        for(StatisticsEntry& entry : result.statistics) {
+            if(!readValue(file, entry.resolutionRatio) || !readValue(file, entry.filter) || !readStatistics(file, entry.statistics))
+                return false;
+        }
+
+        metadata = std::move(result);
+        return true;
+    }
+
+    bool write(const std::vector<std::string>& filenames, const Metadata& metadata) {
+        if(filenames.empty())
+            return false;
+        const std::string sidecarFilename = getSidecarFilename(filenames[0]);
+        const std::string temporaryFilename = sidecarFilename + ".tmp";
+        std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+            return false;
+
+        file.write(MAGIC, 4);
+        writeValue(file, VERSION);
+        writeVector(file, getFileKeys(filenames));
+        writeValue(file, metadata.imageFormat);
+        writeValue(file, metadata.imgResolution);
+        writeValue(file, metadata.voxelSize);
+        writeValue(file, static_cast<uint32_t>(metadata.imgDataType));
+        writeValue(file, metadata.nbChannels);
+        writeValue(file, static_cast<uint64_t>(metadata.filenames.size()));
+        for(const std::string& filename : metadata.filenames)
+            writeString(file, filename);
+        writeVector(file, getFileKeys(metadata.filenames));
+        writeVector(file, metadata.directoryOffsets);
+        writeVector(file, metadata.planes);
+        writeVector(file, metadata.slicePositions);
+        writeValue(file, static_cast<uint64_t>(metadata.statistics.size()));
+        for(const StatisticsEntry& entry : metadata.statistics) {
+            writeValue(file, entry.resolutionRatio);
+            writeValue(file, entry.filter);
+            writeStatistics(file, entry.statistics);
+        }
+
+        file.close();
+        if(!file) {
+            std::cerr << "WARNING: failed to write the metadata cache [" << sidecarFilename << "]" << std::endl;
+            std::remove(temporaryFilename.c_str());
+            return false;
+        }
+        // The sidecar is replaced only once it is complete, rename can't replace an existing file on Windows
+        if(std::rename(temporaryFilename.c_str(), sidecarFilename.c_str()) != 0) {
+            std::remove(sidecarFilename.c_str());
+            if(std::rename(temporaryFilename.c_str(), sidecarFilename.c_str()) != 0) {
+                std::cerr << "WARNING: failed to write the metadata cache [" << sidecarFilename << "]" << std::endl;
+                std::remove(temporaryFilename.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef METADATA_CACHE_HPP_
+#define METADATA_CACHE_HPP_
+
+#include "../../legacy/image/utils/include/image_api_common.hpp"
+#include "statistics.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Sidecar file storing the informations that are slow to find when an image is opened, to reopen it instantly.
+//!
+//! For a TIFF stack it avoids to walk all the directories, to parse the OME-TIFF XML and to check the files it lists,
+//! to resolve the strips of the memory mapped slices and to scan the values to compute their statistics.
+//! The sidecar is named getSidecarFilename() and is only used if the size and the modification time of the opened
+//! files and of the files listed in Metadata::filenames did not change since it was written, and if it was written with the current VERSION.
+//! It is written to a temporary file first, so an interrupted write never leaves a truncated sidecar.
+namespace MetadataCache {
+
+    const uint32_t VERSION = 4;
+
+    //! @brief Statistics of the values of a Sampler, see Sampler::statistics.
+    struct StatisticsEntry {
+        glm::ivec3 resolutionRatio;
+        //! @brief Pyramid::Filter used to downsample the image.
+        int filter;
+        Statistics statistics;
+    };
+
+    struct Metadata {
+        //! @brief ImageFormat of the image.
+        int imageFormat;
+        glm::vec3 imgResolution;
+        glm::vec3 voxelSize;
+        Image::ImageDataType imgDataType;
+        int nbChannels;
+        //! @brief Files containing the slices, for an OME-TIFF image the files found in the XML.
+        //! The offsets and positions below point inside these files, so each of them invalidates the sidecar when it changes.
+        std::vector<std::string> filenames;
+        //! @brief See TIFFReaderLibtiff::directoryOffsets.
+        std::vector<uint64_t> directoryOffsets;
+        //! @brief See TIFFReaderLibtiff::planes.
+        std::vector<std::pair<int, int>> planes;
+        //! @brief See TIFFMappedReader::slicePositions, empty if the image can't be memory mapped.
+        std::vector<std::pair<int, uint64_t>> slicePositions;
+        std::vector<StatisticsEntry> statistics;
+
+        Metadata(): imageFormat(-1), imgDataType(Image::ImageDataType::Unknown), nbChannels(1) {}
+
+        //! @return nullptr if the statistics of this sampler are not known.
+        const Statistics * findStatistics(const glm::ivec3& resolutionRatio, int filter) const;
+        void setStatistics(const glm::ivec3& resolutionRatio, int filter, const Statistics& statistics);
+    };
+
+    std::string getSidecarFilename(const std::string& filename);
+
+    //! @brief Read the sidecar of the image made of filenames.
+    //! @return false if there is no sidecar or if it is outdated, metadata is then left unchanged.
+    bool read(const std::vector<std::string>& filenames, Metadata& metadata);
+
+    //! @brief Write the sidecar of the image made of filenames, failures are silent as the sidecar is optional.
+    bool write(const std::vector<std::string>& filenames, const Metadata& metadata);
+}
+
+//! @}
+
+#endif
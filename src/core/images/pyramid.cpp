@@ -0,0 +1,118 @@
+#include "pyramid.hpp"
+#include <cmath>
+#include <memory>
+
+Pyramid::Filter Pyramid::fromString(const std::string& filter) {
+    if(filter == "Gaussian")
+        return Filter::Gaussian;
+    return Filter::Box;
+}
+
+std::string Pyramid::toString(const Pyramid::Filter& filter) {
+    if(filter == Filter::Gaussian)
+        return "Gaussian";
+    return "Box";
+}
+
+Pyramid::Kernel::Kernel(int factor, Filter filter) {
+    if(factor <= 1) {
+        this->firstTap = 0;
+        this->weights = {1.f};
+        return;
+    }
+    if(filter == Filter::Box) {
+        this->firstTap = 0;
+        this->weights = std::vector<float>(factor, 1.f / static_cast<float>(factor));
+        return;
+    }
+    // Gaussian centered on the block of source samples, with the sigma used by most image pyramids
+    const float sigma = 2.f * factor / 6.f;
+    const float center = (factor - 1) / 2.f;
+    this->firstTap = static_cast<int>(std::ceil(center - 3.f * sigma));
+    const int lastTap = static_cast<int>(std::floor(center + 3.f * sigma));
+    float sum = 0.f;
+    for(int t = this->firstTap; t <= lastTap; ++t) {
+        const float d = t - center;
+        this->weights.push_back(std::exp(-d * d / (2.f * sigma * sigma)));
+        sum += this->weights.back();
+    }
+    for(float& weight : this->weights)
+        weight /= sum;
+}
+
+glm::ivec3 Pyramid::getResolution(const glm::ivec3& resolution, const glm::ivec3& factor) {
+    return glm::max(resolution / factor, glm::ivec3(1, 1, 1));
+}
+
+std::string Pyramid::getLevelFilename(const std::string& filename, int factor) {
+    const std::size_t extension = filename.find_last_of(".");
+    const std::string base = (extension == std::string::npos) ? filename : filename.substr(0, extension);
+    return base + "_x" + std::to_string(factor) + ".tif";
+}
+
+ImageReader * Pyramid::openLevel(const std::string& filename, const glm::ivec3& resolution, const glm::ivec3& factor, int& levelFactor) {
+    // Levels are downsampled the same way on each axis
+    if(factor.x != factor.y || factor.y != factor.z)
+        return nullptr;
+    for(levelFactor = factor.x; levelFactor > 1; --levelFactor) {
+        if(factor.x % levelFactor != 0)
+            continue;
+        const std::string levelFilename = getLevelFilename(filename, levelFactor);
+        if(!fileExist(levelFilename))
+            continue;
+        ImageReader * level = new ImageReader({levelFilename});
+        if(glm::ivec3(level->imgResolution) == getResolution(resolution, glm::ivec3(levelFactor))) {
+            std::cout << "Use the downsampled level [" << levelFilename << "]" << std::endl;
+            return level;
+        }
+        std::cout << "Warning: ignore the downsampled level [" << levelFilename << "] as its resolution does not match the image" << std::endl;
+        delete level;
+    }
+    return nullptr;
+}
+
+namespace {
+    template<typename voxel_t>
+    bool writeLevelsTemplated(ImageReader& image, const std::string& filename, int nbLevels, Pyramid::Filter filter, int bit, int format) {
+        std::vector<std::unique_ptr<Pyramid::Downsampler<voxel_t>>> levels;
+        std::vector<TinyTIFFWriterFile*> files;
+        glm::ivec3 resolution = image.imgResolution;
+        for(int level = 0; level < nbLevels; ++level) {
+            const int factor = 1 << (level + 1);
+            const glm::ivec3 levelResolution = Pyramid::getResolution(resolution, glm::ivec3(2));
+            TinyTIFFWriterFile * file = TinyTIFFWriter_open(Pyramid::getLevelFilename(filename, factor).c_str(), bit, format, 1, levelResolution.x, levelResolution.y, TinyTIFFWriter_Greyscale);
+            if(!file) {
+                std::cerr << "Error: unable to open [" << Pyramid::getLevelFilename(filename, factor) << "] for writing" << std::endl;
+                for(TinyTIFFWriterFile * opened : files)
+                    TinyTIFFWriter_close(opened);
+                return false;
+            }
+            files.push_back(file);
+            // Each level writes its slices and forwards them to the next level
+            levels.push_back(std::make_unique<Pyramid::Downsampler<voxel_t>>(resolution, glm::ivec3(2), filter, [&levels, &files, level, nbLevels](int sliceIdx, const std::vector<voxel_t>& slice) {
+                TinyTIFFWriter_writeImage(files[level], slice.data());
+                if(level + 1 < nbLevels)
+                    levels[level + 1]->pushSlice(slice.data());
+            }));
+            resolution = levelResolution;
+        }
+
+        Pyramid::streamImage(image, *levels.front(), omp_get_max_threads());
+
+        for(TinyTIFFWriterFile * file : files)
+            TinyTIFFWriter_close(file);
+        return true;
+    }
+}
+
+bool Pyramid::writeLevels(ImageReader& image, const std::string& filename, int nbLevels, Filter filter) {
+    std::cout << "Write [" << nbLevels << "] downsampled levels of [" << filename << "] using the " << toString(filter) << " filter" << std::endl;
+    const Image::ImageDataType storageType = Cache::getStorageType(image.getInternalDataType());
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+        return writeLevelsTemplated<uint8_t>(image, filename, nbLevels, filter, 8, TinyTIFFWriter_UInt);
+    } else if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+        return writeLevelsTemplated<float>(image, filename, nbLevels, filter, 32, TinyTIFFWriter_Float);
+    } else {
+        return writeLevelsTemplated<uint16_t>(image, filename, nbLevels, filter, 16, TinyTIFFWriter_UInt);
+    }
+}
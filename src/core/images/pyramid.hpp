@@ -0,0 +1,189 @@
+#ifndef PYRAMID_HPP_
+#define PYRAMID_HPP_
+
+#include "image.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Downsampling of images by integer factors, filtering the values before decimation to avoid aliasing.
+//!
+//! A Downsampler receives the slices of the source one after the other and outputs each downsampled slice as soon
+//! as all the source slices it depends on are known, so only a few slices are kept in memory.
+//! Downsamplers can be chained to build a whole pyramid in a single pass over the source, see writeLevels().
+namespace Pyramid {
+
+    enum class Filter {
+        Box,
+        Gaussian
+    };
+
+    Filter fromString(const std::string& filter);
+    std::string toString(const Filter& filter);
+
+    //! @brief Weights of the source samples used to compute a downsampled sample.
+    //! The sample i uses the source samples [i*factor+firstTap, i*factor+firstTap+weights.size()[ .
+    struct Kernel {
+        int firstTap;
+        std::vector<float> weights;
+
+        Kernel(int factor, Filter filter);
+    };
+
+    //! @brief Resolution of an image downsampled by factor, each axis is at least 1 voxel.
+    glm::ivec3 getResolution(const glm::ivec3& resolution, const glm::ivec3& factor);
+
+    //! @brief Filename of the level downsampled by factor written by writeLevels() next to filename.
+    std::string getLevelFilename(const std::string& filename, int factor);
+
+    //! @brief Open the coarsest level written by writeLevels() next to filename whose factor divides factor.
+    //! @param levelFactor Factor of the returned level.
+    //! @return nullptr if there is no such level.
+    ImageReader * openLevel(const std::string& filename, const glm::ivec3& resolution, const glm::ivec3& factor, int& levelFactor);
+
+    //! @brief Write nbLevels levels, each one downsampled by 2 from the previous one, with a single read of image.
+    //! Each level is a TIFF stack named getLevelFilename(filename, factor).
+    bool writeLevels(ImageReader& image, const std::string& filename, int nbLevels, Filter filter);
+
+    //! @brief The slices can have multiple interleaved channels, each channel is filtered independently.
+    template<typename voxel_t>
+    struct Downsampler {
+        typedef std::function<void(int sliceIdx, const std::vector<voxel_t>& slice)> Output;
+
+        glm::ivec3 inputResolution;
+        glm::ivec3 factor;
+        glm::ivec3 resolution;
+        int nbChannels;
+
+        Downsampler(const glm::ivec3& inputResolution, const glm::ivec3& factor, Filter filter, Output output, int nbChannels = 1):
+            inputResolution(inputResolution), factor(factor), resolution(getResolution(inputResolution, factor)), nbChannels(nbChannels),
+            kernels{Kernel(factor.x, filter), Kernel(factor.y, filter), Kernel(factor.z, filter)},
+            nbPushedSlices(0), nextSlice(0), output(output) {}
+
+        //! @brief The source slices have to be pushed in order, the output is called from this function.
+        void pushSlice(const voxel_t * slice) {
+            this->window.emplace_back(static_cast<std::size_t>(this->resolution.x) * this->resolution.y * this->nbChannels);
+            this->filterSlice(slice, this->window.back());
+            this->nbPushedSlices += 1;
+
+            const bool isComplete = (this->nbPushedSlices == this->inputResolution.z);
+            while(this->nextSlice < this->resolution.z && (isComplete || this->getLastSourceSlice(this->nextSlice) < this->nbPushedSlices)) {
+                this->outputSlice(this->nextSlice);
+                this->nextSlice += 1;
+                // Source slices are only needed by the next output slices
+                const int firstNeeded = std::max(0, std::min(this->nbPushedSlices - 1, this->nextSlice * this->factor.z + this->kernels[2].firstTap));
+                while(this->nbPushedSlices - static_cast<int>(this->window.size()) < firstNeeded)
+                    this->window.pop_front();
+            }
+        }
+
+    private:
+        Kernel kernels[3];
+        int nbPushedSlices;
+        int nextSlice;
+        Output output;
+        //! @brief Last source slices downsampled on x and y, the last one is the slice nbPushedSlices-1.
+        std::deque<std::vector<float>> window;
+        std::vector<float> rows;
+        std::vector<voxel_t> result;
+
+        int getLastSourceSlice(int sliceIdx) const {
+            return std::min(this->inputResolution.z - 1, sliceIdx * this->factor.z + this->kernels[2].firstTap + static_cast<int>(this->kernels[2].weights.size()) - 1);
+        }
+
+        //! @brief Filter along x then y, both passes only compute the kept samples.
+        void filterSlice(const voxel_t * slice, std::vector<float>& filtered) {
+            const Kernel& kx = this->kernels[0];
+            const Kernel& ky = this->kernels[1];
+            const int inWidth = this->inputResolution.x;
+            const int inHeight = this->inputResolution.y;
+            const int nbChannels = this->nbChannels;
+            // Number of values in an output row, the channels are interleaved
+            const int rowSize = this->resolution.x * nbChannels;
+            this->rows.resize(static_cast<std::size_t>(inHeight) * rowSize);
+            #pragma omp parallel for schedule(static)
+            for(int y = 0; y < inHeight; ++y) {
+                const voxel_t * in = slice + static_cast<std::size_t>(y) * inWidth * nbChannels;
+                float * out = this->rows.data() + static_cast<std::size_t>(y) * rowSize;
+                for(int i = 0; i < this->resolution.x; ++i) {
+                    const int first = i * this->factor.x + kx.firstTap;
+                    for(int c = 0; c < nbChannels; ++c) {
+                        float value = 0.f;
+                        for(int t = 0; t < kx.weights.size(); ++t)
+                            value += kx.weights[t] * static_cast<float>(in[std::min(std::max(first + t, 0), inWidth - 1) * nbChannels + c]);
+                        out[i * nbChannels + c] = value;
+                    }
+                }
+            }
+            #pragma omp parallel for schedule(static)
+            for(int j = 0; j < this->resolution.y; ++j) {
+                float * out = filtered.data() + static_cast<std::size_t>(j) * rowSize;
+                std::fill(out, out + rowSize, 0.f);
+                const int first = j * this->factor.y + ky.firstTap;
+                for(int t = 0; t < ky.weights.size(); ++t) {
+                    const float * in = this->rows.data() + static_cast<std::size_t>(std::min(std::max(first + t, 0), inHeight - 1)) * rowSize;
+                    #pragma omp simd
+                    for(int i = 0; i < rowSize; ++i)
+                        out[i] += ky.weights[t] * in[i];
+                }
+            }
+        }
+
+        void outputSlice(int sliceIdx) {
+            const Kernel& kz = this->kernels[2];
+            const int firstInWindow = this->nbPushedSlices - static_cast<int>(this->window.size());
+            const int first = sliceIdx * this->factor.z + kz.firstTap;
+            const std::size_t size = static_cast<std::size_t>(this->resolution.x) * this->resolution.y * this->nbChannels;
+            this->result.resize(size);
+            #pragma omp parallel for schedule(static)
+            for(std::size_t i = 0; i < size; ++i) {
+                float value = 0.f;
+                for(int t = 0; t < kz.weights.size(); ++t) {
+                    const int z = std::min(std::max(first + t, 0), this->inputResolution.z - 1);
+                    value += kz.weights[t] * this->window[z - firstInWindow][i];
+                }
+                if constexpr (std::is_integral<voxel_t>::value) {
+                    value = std::min(std::max(value + .5f, 0.f), static_cast<float>(std::numeric_limits<voxel_t>::max()));
+                }
+                this->result[i] = static_cast<voxel_t>(value);
+            }
+            this->output(sliceIdx, this->result);
+        }
+    };
+
+    //! @brief Push all the slices of image to downsampler, several slices are decoded at the same time.
+    //! @param isCancelled Checked before each group of slices, the streaming stops when it returns true.
+    template<typename voxel_t>
+    void streamImage(ImageReader& image, Downsampler<voxel_t>& downsampler, int nbThreads, const std::function<bool()>& isCancelled = nullptr) {
+        const glm::ivec3 resolution = downsampler.inputResolution;
+        const std::pair<glm::vec3, glm::vec3> bboxes{glm::vec3(0., 0., 0.), glm::vec3(resolution)};
+        nbThreads = std::max(1, std::min(nbThreads, resolution.z));
+        std::vector<std::vector<voxel_t>> slices(nbThreads);
+        image.setNbThreads(nbThreads);
+        for(int firstSlice = 0; firstSlice < resolution.z; firstSlice += nbThreads) {
+            if(isCancelled && isCancelled())
+                break;
+            const int nbSlices = std::min(nbThreads, resolution.z - firstSlice);
+            #pragma omp parallel for num_threads(nbThreads) schedule(static, 1)
+            for(int k = 0; k < nbSlices; ++k) {
+                slices[k].clear();
+                image.getSlice(firstSlice + k, slices[k], downsampler.nbChannels, {1, 1}, bboxes, omp_get_thread_num());
+            }
+            for(int k = 0; k < nbSlices; ++k)
+                downsampler.pushSlice(slices[k].data());
+        }
+        image.setNbThreads(1);
+    }
+}
+
+//! @}
+
+#endif
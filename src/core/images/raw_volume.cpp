@@ -0,0 +1,796 @@
+#include "raw_volume.hpp"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace {
+
+    bool isHostBigEndian() {
+        const uint16_t value = 1;
+        return *reinterpret_cast<const unsigned char*>(&value) == 0;
+    }
+
+    bool endsWith(const std::string& value, const std::string& suffix) {
+        return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    std::string toLower(std::string value) {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+        return value;
+    }
+
+    std::string trim(const std::string& value) {
+        const std::size_t first = value.find_first_not_of(" \t\r\n");
+        if(first == std::string::npos)
+            return std::string();
+        return value.substr(first, value.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+    void swapValues(unsigned char * values, std::size_t nbValues, std::size_t valueBytes) {
+        for(std::size_t i = 0; i < nbValues; ++i)
+            std::reverse(values + i * valueBytes, values + (i + 1) * valueBytes);
+    }
+
+    bool isGzipFile(const std::string& filename, std::size_t offset) {
+        std::ifstream file(filename, std::ios::binary);
+        unsigned char magic[2] = {0, 0};
+        file.seekg(offset);
+        file.read(reinterpret_cast<char*>(magic), 2);
+        return file && magic[0] == 0x1f && magic[1] == 0x8b;
+    }
+
+    template<typename T>
+    T getField(const unsigned char * header, std::size_t offset, bool swap) {
+        T value;
+        std::memcpy(&value, header + offset, sizeof(T));
+        if(swap)
+            swapValues(reinterpret_cast<unsigned char*>(&value), 1, sizeof(T));
+        return value;
+    }
+
+    template<typename T>
+    void setField(unsigned char * header, std::size_t offset, T value) {
+        std::memcpy(header + offset, &value, sizeof(T));
+    }
+
+    /***/
+
+    //! @brief Datatype codes of the NIfTI header, the RGB and RGBA codes store interleaved uint8 channels.
+    struct NIfTIType {
+        int16_t code;
+        Image::ImageDataType dataType;
+        int nbChannels;
+    };
+
+    const NIfTIType niftiTypes[] = {
+        {2, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8, 1},
+        {4, Image::ImageDataType::Signed | Image::ImageDataType::Bit_16, 1},
+        {8, Image::ImageDataType::Signed | Image::ImageDataType::Bit_32, 1},
+        {16, Image::ImageDataType::Floating | Image::ImageDataType::Bit_32, 1},
+        {64, Image::ImageDataType::Floating | Image::ImageDataType::Bit_64, 1},
+        {128, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8, 3},
+        {256, Image::ImageDataType::Signed | Image::ImageDataType::Bit_8, 1},
+        {512, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16, 1},
+        {768, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32, 1},
+        {1024, Image::ImageDataType::Signed | Image::ImageDataType::Bit_64, 1},
+        {1280, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64, 1},
+        {2304, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8, 4}
+    };
+
+    const std::size_t NIFTI1_HEADER_SIZE = 348;
+    const std::size_t NIFTI2_HEADER_SIZE = 540;
+
+    bool readNIfTIHeader(const std::string& filename, RawVolume::Layout& layout) {
+        layout.isCompressed = isGzipFile(filename, 0);
+        unsigned char header[NIFTI2_HEADER_SIZE] = {0};
+        if(layout.isCompressed) {
+            RawVolume::GzipStream stream(filename, 0);
+            if(!stream.read(0, header, NIFTI1_HEADER_SIZE)) {
+                std::cerr << "ERROR: unable to read the NIfTI header of [" << filename << "]" << std::endl;
+                return false;
+            }
+            // A NIfTI-2 header is longer, it is read again from the beginning of the stream
+            if(getField<int32_t>(header, 0, false) == NIFTI2_HEADER_SIZE || getField<int32_t>(header, 0, true) == NIFTI2_HEADER_SIZE)
+                stream.read(0, header, NIFTI2_HEADER_SIZE);
+        } else {
+            std::ifstream file(filename, std::ios::binary);
+            file.read(reinterpret_cast<char*>(header), NIFTI2_HEADER_SIZE);
+            if(file.gcount() < static_cast<std::streamsize>(NIFTI1_HEADER_SIZE)) {
+                std::cerr << "ERROR: unable to read the NIfTI header of [" << filename << "]" << std::endl;
+                return false;
+            }
+        }
+
+        // The size of the header gives the version and the byte order of the file
+        bool swap = false;
+        int32_t headerSize = getField<int32_t>(header, 0, false);
+        if(headerSize != NIFTI1_HEADER_SIZE && headerSize != NIFTI2_HEADER_SIZE) {
+            swap = true;
+            headerSize = getField<int32_t>(header, 0, true);
+        }
+        if(headerSize != NIFTI1_HEADER_SIZE && headerSize != NIFTI2_HEADER_SIZE) {
+            std::cerr << "ERROR: [" << filename << "] is not a NIfTI image" << std::endl;
+            return false;
+        }
+        layout.isBigEndian = (isHostBigEndian() != swap);
+
+        int64_t dim[8];
+        double pixdim[8];
+        int16_t datatype = 0;
+        double voxOffset = 0.;
+        const char * magic = nullptr;
+        if(headerSize == NIFTI1_HEADER_SIZE) {
+            magic = reinterpret_cast<const char*>(header + 344);
+            datatype = getField<int16_t>(header, 70, swap);
+            for(int i = 0; i < 8; ++i) {
+                dim[i] = getField<int16_t>(header, 40 + 2 * i, swap);
+                pixdim[i] = getField<float>(header, 76 + 4 * i, swap);
+            }
+            voxOffset = getField<float>(header, 108, swap);
+            layout.slope = getField<float>(header, 112, swap);
+            layout.intercept = getField<float>(header, 116, swap);
+        } else {
+            magic = reinterpret_cast<const char*>(header + 4);
+            datatype = getField<int16_t>(header, 12, swap);
+            for(int i = 0; i < 8; ++i) {
+                dim[i] = getField<int64_t>(header, 16 + 8 * i, swap);
+                pixdim[i] = getField<double>(header, 104 + 8 * i, swap);
+            }
+            voxOffset = static_cast<double>(getField<int64_t>(header, 168, swap));
+            layout.slope = getField<double>(header, 176, swap);
+            layout.intercept = getField<double>(header, 184, swap);
+        }
+        if(magic[0] != 'n' || magic[1] != '+') {
+            std::cerr << "ERROR: [" << filename << "] is a NIfTI header without its values, the .hdr/.img pairs are not supported" << std::endl;
+            return false;
+        }
+
+        const NIfTIType * type = std::find_if(std::begin(niftiTypes), std::end(niftiTypes), [datatype](const NIfTIType& type) { return type.code == datatype; });
+        if(type == std::end(niftiTypes)) {
+            std::cerr << "ERROR: the NIfTI datatype [" << datatype << "] of [" << filename << "] is not supported" << std::endl;
+            return false;
+        }
+        layout.dataType = type->dataType;
+
+        const int nbDimensions = static_cast<int>(dim[0]);
+        if(nbDimensions < 1 || nbDimensions > 7) {
+            std::cerr << "ERROR: invalid number of dimensions [" << nbDimensions << "] in [" << filename << "]" << std::endl;
+            return false;
+        }
+        auto getSize = [&](int axis) { return (axis <= nbDimensions) ? std::max<int64_t>(dim[axis], 1) : 1; };
+        for(int i = 0; i < 3; ++i) {
+            layout.resolution[i] = static_cast<int>(getSize(i + 1));
+            layout.voxelSize[i] = (pixdim[i + 1] != 0. && std::isfinite(pixdim[i + 1])) ? static_cast<float>(std::fabs(pixdim[i + 1])) : 1.f;
+        }
+        const std::size_t volumeSize = static_cast<std::size_t>(layout.resolution.x) * layout.resolution.y * layout.resolution.z;
+        if(type->nbChannels > 1) {
+            layout.nbChannels = type->nbChannels;
+            layout.voxelStride = type->nbChannels;
+            layout.channelStride = 1;
+        } else {
+            // The 5th dimension holds the components of vector images, the 4th one is the time, only its first point is read
+            layout.nbChannels = static_cast<int>(getSize(5));
+            layout.voxelStride = 1;
+            layout.channelStride = volumeSize * getSize(4);
+        }
+
+        layout.dataFilename = filename;
+        if(layout.isCompressed) {
+            layout.fileOffset = 0;
+            layout.streamOffset = static_cast<std::size_t>(voxOffset);
+        } else {
+            layout.fileOffset = static_cast<std::size_t>(voxOffset);
+            layout.streamOffset = 0;
+        }
+        return true;
+    }
+
+    /***/
+
+    bool getNRRDType(const std::string& name, Image::ImageDataType& dataType) {
+        static const std::map<std::string, Image::ImageDataType> types = {
+            {"signed char", Image::ImageDataType::Signed | Image::ImageDataType::Bit_8},
+            {"int8", Image::ImageDataType::Signed | Image::ImageDataType::Bit_8},
+            {"int8_t", Image::ImageDataType::Signed | Image::ImageDataType::Bit_8},
+            {"uchar", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8},
+            {"unsigned char", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8},
+            {"uint8", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8},
+            {"uint8_t", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8},
+            {"short", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"short int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"signed short", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"signed short int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"int16", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"int16_t", Image::ImageDataType::Signed | Image::ImageDataType::Bit_16},
+            {"ushort", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16},
+            {"unsigned short", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16},
+            {"unsigned short int", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16},
+            {"uint16", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16},
+            {"uint16_t", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16},
+            {"int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_32},
+            {"signed int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_32},
+            {"int32", Image::ImageDataType::Signed | Image::ImageDataType::Bit_32},
+            {"int32_t", Image::ImageDataType::Signed | Image::ImageDataType::Bit_32},
+            {"uint", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32},
+            {"unsigned int", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32},
+            {"uint32", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32},
+            {"uint32_t", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32},
+            {"longlong", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"long long", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"long long int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"signed long long", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"signed long long int", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"int64", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"int64_t", Image::ImageDataType::Signed | Image::ImageDataType::Bit_64},
+            {"ulonglong", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64},
+            {"unsigned long long", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64},
+            {"unsigned long long int", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64},
+            {"uint64", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64},
+            {"uint64_t", Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64},
+            {"float", Image::ImageDataType::Floating | Image::ImageDataType::Bit_32},
+            {"double", Image::ImageDataType::Floating | Image::ImageDataType::Bit_64}
+        };
+        auto it = types.find(name);
+        if(it == types.end())
+            return false;
+        dataType = it->second;
+        return true;
+    }
+
+    std::string getNRRDTypeName(Image::ImageDataType dataType) {
+        const std::string size = std::to_string(RawVolume::getNbBytes(dataType) * 8);
+        if(dataType & Image::ImageDataType::Floating)
+            return (dataType & Image::ImageDataType::Bit_32) ? "float" : "double";
+        return ((dataType & Image::ImageDataType::Signed) ? "int" : "uint") + size;
+    }
+
+    //! @brief Length of each vector of a "space directions" field, -1 for "none".
+    std::vector<double> getNRRDDirectionsNorm(const std::string& value) {
+        std::vector<double> norms;
+        std::istringstream stream(value);
+        std::string direction;
+        while(stream >> direction) {
+            if(direction == "none") {
+                norms.push_back(-1.);
+                continue;
+            }
+            // The vectors are written as (x,y,z), possibly with spaces after the commas
+            while(direction.back() != ')' && stream) {
+                std::string next;
+                stream >> next;
+                direction += next;
+            }
+            std::replace(direction.begin(), direction.end(), '(', ' ');
+            std::replace(direction.begin(), direction.end(), ')', ' ');
+            std::replace(direction.begin(), direction.end(), ',', ' ');
+            std::istringstream components(direction);
+            double component = 0.;
+            double norm = 0.;
+            while(components >> component)
+                norm += component * component;
+            norms.push_back(std::sqrt(norm));
+        }
+        return norms;
+    }
+
+    bool readNRRDHeader(const std::string& filename, RawVolume::Layout& layout) {
+        std::ifstream file(filename, std::ios::binary);
+        std::string line;
+        if(!std::getline(file, line) || line.compare(0, 4, "NRRD") != 0) {
+            std::cerr << "ERROR: [" << filename << "] is not a NRRD image" << std::endl;
+            return false;
+        }
+        // The header ends with an empty line, or with the end of a detached header
+        std::map<std::string, std::string> fields;
+        while(std::getline(file, line)) {
+            if(!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if(line.empty())
+                break;
+            if(line[0] == '#')
+                continue;
+            const std::size_t separator = line.find(": ");
+            // The key/value pairs use ":=" and are ignored
+            if(separator == std::string::npos || line.compare(separator - 1, 2, ":=") == 0)
+                continue;
+            fields[toLower(trim(line.substr(0, separator)))] = trim(line.substr(separator + 2));
+        }
+        const std::size_t headerEnd = file ? static_cast<std::size_t>(file.tellg()) : 0;
+        auto getField = [&](const std::string& key) {
+            auto it = fields.find(key);
+            return (it == fields.end()) ? std::string() : it->second;
+        };
+
+        if(!getNRRDType(getField("type"), layout.dataType)) {
+            std::cerr << "ERROR: the NRRD type [" << getField("type") << "] of [" << filename << "] is not supported" << std::endl;
+            return false;
+        }
+        const int nbDimensions = std::atoi(getField("dimension").c_str());
+        std::vector<int> sizes;
+        std::istringstream sizesStream(getField("sizes"));
+        int size = 0;
+        while(sizesStream >> size)
+            sizes.push_back(size);
+        if(nbDimensions < 1 || nbDimensions > 4 || static_cast<int>(sizes.size()) != nbDimensions) {
+            std::cerr << "ERROR: only the NRRD images with 1 to 4 dimensions are supported, [" << filename << "] has [" << getField("dimension") << "]" << std::endl;
+            return false;
+        }
+
+        // Length of each axis, -1 when it is not spatial
+        std::vector<double> spacings = getNRRDDirectionsNorm(getField("space directions"));
+        if(static_cast<int>(spacings.size()) != nbDimensions) {
+            spacings.assign(nbDimensions, 1.);
+            std::istringstream spacingsStream(getField("spacings"));
+            std::string spacing;
+            for(int axis = 0; axis < nbDimensions && spacingsStream >> spacing; ++axis)
+                spacings[axis] = (toLower(spacing) == "nan") ? -1. : std::atof(spacing.c_str());
+        }
+        std::vector<std::string> kinds;
+        std::istringstream kindsStream(getField("kinds"));
+        std::string kind;
+        while(kindsStream >> kind)
+            kinds.push_back(toLower(kind));
+
+        // A 4D image has an axis of channels, either the first one where they are interleaved or the last one
+        int channelAxis = -1;
+        if(nbDimensions == 4) {
+            auto isSpatial = [&](int axis) {
+                if(static_cast<int>(kinds.size()) == nbDimensions)
+                    return kinds[axis] == "domain" || kinds[axis] == "space";
+                return spacings[axis] > 0. && sizes[axis] > 4;
+            };
+            channelAxis = isSpatial(0) ? 3 : 0;
+            if(channelAxis == 3 && isSpatial(3) && !isSpatial(0)) {
+                std::cerr << "ERROR: unable to find the channels axis of [" << filename << "]" << std::endl;
+                return false;
+            }
+        }
+        layout.nbChannels = (channelAxis >= 0) ? sizes[channelAxis] : 1;
+        layout.resolution = glm::ivec3(1, 1, 1);
+        layout.voxelSize = glm::vec3(1., 1., 1.);
+        for(int axis = 0, i = 0; axis < nbDimensions; ++axis) {
+            if(axis == channelAxis)
+                continue;
+            layout.resolution[i] = std::max(sizes[axis], 1);
+            if(spacings[axis] > 0.)
+                layout.voxelSize[i] = static_cast<float>(spacings[axis]);
+            i += 1;
+        }
+        const std::size_t volumeSize = static_cast<std::size_t>(layout.resolution.x) * layout.resolution.y * layout.resolution.z;
+        layout.voxelStride = (channelAxis == 0) ? layout.nbChannels : 1;
+        layout.channelStride = (channelAxis == 0) ? 1 : volumeSize;
+
+        const std::string endian = getField("endian");
+        layout.isBigEndian = endian.empty() ? isHostBigEndian() : (endian == "big");
+        const std::string encoding = toLower(getField("encoding"));
+        if(encoding == "gzip" || encoding == "gz") {
+            layout.isCompressed = true;
+        } else if(encoding == "raw") {
+            layout.isCompressed = false;
+        } else {
+            std::cerr << "ERROR: the NRRD encoding [" << encoding << "] of [" << filename << "] is not supported" << std::endl;
+            return false;
+        }
+
+        std::string dataFilename = getField("data file");
+        if(dataFilename.empty())
+            dataFilename = getField("datafile");
+        if(dataFilename.empty()) {
+            layout.dataFilename = filename;
+            layout.fileOffset = headerEnd;
+        } else {
+            if(dataFilename.compare(0, 4, "LIST") == 0 || dataFilename.find(' ') != std::string::npos) {
+                std::cerr << "ERROR: the NRRD images split in multiple data files are not supported [" << filename << "]" << std::endl;
+                return false;
+            }
+            // A relative data file is next to the header
+            const std::size_t directoryEnd = filename.find_last_of("/\\");
+            const bool isAbsolute = dataFilename[0] == '/' || (dataFilename.size() > 1 && dataFilename[1] == ':');
+            layout.dataFilename = (isAbsolute || directoryEnd == std::string::npos) ? dataFilename : filename.substr(0, directoryEnd + 1) + dataFilename;
+            layout.fileOffset = 0;
+        }
+
+        const int lineSkip = std::atoi(getField("line skip").c_str());
+        if(lineSkip > 0) {
+            if(layout.isCompressed) {
+                std::cerr << "ERROR: the line skip of the compressed NRRD images is not supported [" << filename << "]" << std::endl;
+                return false;
+            }
+            std::ifstream dataFile(layout.dataFilename, std::ios::binary);
+            dataFile.seekg(layout.fileOffset);
+            for(int i = 0; i < lineSkip; ++i)
+                std::getline(dataFile, line);
+            layout.fileOffset = static_cast<std::size_t>(dataFile.tellg());
+        }
+        const std::string byteSkipField = getField("byte skip");
+        const long long byteSkip = byteSkipField.empty() ? 0 : std::atoll(byteSkipField.c_str());
+        if(layout.isCompressed) {
+            if(byteSkip < 0) {
+                std::cerr << "ERROR: the byte skip -1 of the compressed NRRD images is not supported [" << filename << "]" << std::endl;
+                return false;
+            }
+            layout.streamOffset = static_cast<std::size_t>(byteSkip);
+        } else if(byteSkip < 0) {
+            // The values are at the end of the data file
+            std::ifstream dataFile(layout.dataFilename, std::ios::binary | std::ios::ate);
+            const std::size_t fileSize = static_cast<std::size_t>(dataFile.tellg());
+            layout.fileOffset = fileSize - std::min(fileSize, layout.getDataNbBytes());
+        } else {
+            layout.fileOffset += static_cast<std::size_t>(byteSkip);
+        }
+        return true;
+    }
+
+    /***/
+
+    template<typename in_t>
+    void scaleValues(const unsigned char * in, float * out, std::size_t nbValues, double slope, double intercept) {
+        const in_t * values = reinterpret_cast<const in_t*>(in);
+        for(std::size_t i = 0; i < nbValues; ++i)
+            out[i] = static_cast<float>(slope * static_cast<double>(values[i]) + intercept);
+    }
+
+    //! @brief Apply the NIfTI scaling to values of the file, the signed values are not shifted before.
+    void scaleValues(Image::ImageDataType dataType, const unsigned char * in, float * out, std::size_t nbValues, double slope, double intercept) {
+        if(dataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8)) {
+            scaleValues<uint8_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16)) {
+            scaleValues<uint16_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_32)) {
+            scaleValues<uint32_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_64)) {
+            scaleValues<uint64_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_8)) {
+            scaleValues<int8_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_16)) {
+            scaleValues<int16_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_32)) {
+            scaleValues<int32_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Signed | Image::ImageDataType::Bit_64)) {
+            scaleValues<int64_t>(in, out, nbValues, slope, intercept);
+        } else if(dataType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32)) {
+            scaleValues<float>(in, out, nbValues, slope, intercept);
+        } else {
+            scaleValues<double>(in, out, nbValues, slope, intercept);
+        }
+    }
+}
+
+namespace RawVolume {
+
+    bool getFormat(const std::string& filename, Format& format) {
+        const std::string name = toLower(filename);
+        if(endsWith(name, ".nii") || endsWith(name, ".nii.gz")) {
+            format = Format::NIfTI;
+            return true;
+        }
+        if(endsWith(name, ".nrrd") || endsWith(name, ".nhdr")) {
+            format = Format::NRRD;
+            return true;
+        }
+        return false;
+    }
+
+    std::size_t getNbBytes(Image::ImageDataType dataType) {
+        if(dataType & Image::ImageDataType::Bit_64)
+            return 8;
+        if(dataType & Image::ImageDataType::Bit_32)
+            return 4;
+        if(dataType & Image::ImageDataType::Bit_16)
+            return 2;
+        return 1;
+    }
+
+    Layout::Layout(): resolution(0, 0, 0), voxelSize(1., 1., 1.), dataType(Image::ImageDataType::Unknown), nbChannels(1), voxelStride(1), channelStride(0),
+        fileOffset(0), streamOffset(0), isCompressed(false), isBigEndian(false), slope(0.), intercept(0.) {}
+
+    bool Layout::isScaled() const {
+        return this->slope != 0. && std::isfinite(this->slope) && std::isfinite(this->intercept) && (this->slope != 1. || this->intercept != 0.);
+    }
+
+    bool Layout::isInterleaved() const {
+        return this->nbChannels > 1 && this->voxelStride > 1;
+    }
+
+    std::size_t Layout::getSliceNbBytes() const {
+        return static_cast<std::size_t>(this->resolution.x) * this->resolution.y * this->voxelStride * getNbBytes(this->dataType);
+    }
+
+    std::size_t Layout::getDataNbBytes() const {
+        const std::size_t volumeNbBytes = this->getSliceNbBytes() * this->resolution.z;
+        if(this->isInterleaved())
+            return volumeNbBytes;
+        return volumeNbBytes + this->channelStride * (this->nbChannels - 1) * getNbBytes(this->dataType);
+    }
+
+    bool readHeader(const std::string& filename, Layout& layout) {
+        Format format;
+        if(!getFormat(filename, format))
+            return false;
+        layout = Layout();
+        if(format == Format::NIfTI)
+            return readNIfTIHeader(filename, layout);
+        return readNRRDHeader(filename, layout);
+    }
+
+    /***/
+
+    GzipStream::GzipStream(const std::string& filename, std::size_t fileOffset): file(filename, std::ios::binary), fileOffset(fileOffset), isInitialized(false), position(0), input(1 << 16) {
+        if(this->file.is_open())
+            this->restart();
+    }
+
+    GzipStream::~GzipStream() {
+        if(this->isInitialized)
+            inflateEnd(&this->stream);
+    }
+
+    bool GzipStream::isOpen() const {
+        return this->isInitialized;
+    }
+
+    bool GzipStream::restart() {
+        if(this->isInitialized)
+            inflateEnd(&this->stream);
+        std::memset(&this->stream, 0, sizeof(z_stream));
+        // 16 selects the gzip wrapper instead of the zlib one
+        this->isInitialized = (inflateInit2(&this->stream, 16 + MAX_WBITS) == Z_OK);
+        this->file.clear();
+        this->file.seekg(this->fileOffset);
+        this->position = 0;
+        return this->isInitialized;
+    }
+
+    bool GzipStream::inflateTo(unsigned char * out, std::size_t size) {
+        this->stream.next_out = out;
+        this->stream.avail_out = static_cast<uInt>(size);
+        while(this->stream.avail_out > 0) {
+            if(this->stream.avail_in == 0) {
+                this->file.read(reinterpret_cast<char*>(this->input.data()), this->input.size());
+                const std::streamsize nbRead = this->file.gcount();
+                if(nbRead <= 0)
+                    break;
+                this->stream.next_in = this->input.data();
+                this->stream.avail_in = static_cast<uInt>(nbRead);
+            }
+            const int status = inflate(&this->stream, Z_NO_FLUSH);
+            if(status == Z_STREAM_END) {
+                // The gzip files can be made of several concatenated members
+                inflateReset(&this->stream);
+            } else if(status != Z_OK && status != Z_BUF_ERROR) {
+                break;
+            }
+        }
+        this->position += size - this->stream.avail_out;
+        return this->stream.avail_out == 0;
+    }
+
+    bool GzipStream::read(std::size_t position, unsigned char * out, std::size_t size) {
+        if(position < this->position)
+            this->restart();
+        if(!this->isInitialized)
+            return false;
+        std::vector<unsigned char> skipped;
+        while(this->position < position) {
+            skipped.resize(std::min<std::size_t>(position - this->position, 1 << 20));
+            if(!this->inflateTo(skipped.data(), skipped.size()))
+                return false;
+        }
+        // avail_out is 32 bits, larger reads are split
+        const std::size_t chunkSize = std::size_t(1) << 30;
+        for(std::size_t first = 0; first < size; first += chunkSize) {
+            if(!this->inflateTo(out + first, std::min(chunkSize, size - first)))
+                return false;
+        }
+        return true;
+    }
+}
+
+/**************************/
+
+RawVolumeReader::RawVolumeReader(const std::string& filename): voxelSize(1., 1., 1.), imgResolution(0., 0., 0.), imgDataType(Image::ImageDataType::Unknown), nbChannels(1), valid(false) {
+    if(!RawVolume::readHeader(filename, this->layout))
+        return;
+    if(!this->layout.isCompressed) {
+        if(!this->file.open(this->layout.dataFilename)) {
+            std::cerr << "ERROR: unable to open [" << this->layout.dataFilename << "]" << std::endl;
+            return;
+        }
+        if(this->file.size < this->layout.fileOffset + this->layout.getDataNbBytes()) {
+            std::cerr << "ERROR: the file [" << this->layout.dataFilename << "] is smaller than the size given in its header" << std::endl;
+            this->file.close();
+            return;
+        }
+    }
+    this->voxelSize = this->layout.voxelSize;
+    this->imgResolution = this->layout.resolution;
+    this->imgDataType = this->layout.isScaled() ? (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32) : this->layout.dataType;
+    this->nbChannels = this->layout.nbChannels;
+    this->decoders.resize(1);
+    this->valid = true;
+    std::cout << "Open [" << filename << "]: " << this->layout.resolution.x << "x" << this->layout.resolution.y << "x" << this->layout.resolution.z;
+    std::cout << " voxels of " << this->layout.voxelSize.x << "x" << this->layout.voxelSize.y << "x" << this->layout.voxelSize.z << ", " << this->nbChannels << " channel(s)";
+    std::cout << (this->layout.isCompressed ? ", gzip compressed" : ", memory mapped") << (this->layout.isScaled() ? ", scaled values" : "") << std::endl;
+}
+
+void RawVolumeReader::setNbThreads(int nbThreads) {
+    this->decoders.resize(std::max(nbThreads, 1));
+}
+
+uint16_t * RawVolumeReader::getVolumeView() const {
+    const bool isNative = (this->layout.isBigEndian == isHostBigEndian());
+    if(!this->valid || this->layout.isCompressed || this->layout.isScaled() || !isNative || this->nbChannels != 1 || this->layout.fileOffset % sizeof(uint16_t) != 0 ||
+       this->layout.dataType != (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16))
+        return nullptr;
+    return reinterpret_cast<uint16_t*>(this->file.data + this->layout.fileOffset);
+}
+
+uint16_t RawVolumeReader::getValue(const glm::vec3& coord) const {
+    glm::ivec3 p;
+    for(int i = 0; i < 3; ++i)
+        p[i] = std::min(std::max(static_cast<int>(std::floor(coord[i])), 0), this->layout.resolution[i] - 1);
+    const unsigned char * plane = this->getPlane(p.z, 0, 0);
+    const std::size_t rowNbBytes = static_cast<std::size_t>(this->layout.resolution.x) * this->layout.voxelStride * RawVolume::getNbBytes(this->imgDataType);
+    uint16_t value = 0;
+    const int x = p.x * this->layout.voxelStride;
+    Convert::getRowKernel<uint16_t>(this->imgDataType)(plane + p.y * rowNbBytes, &value, x, x + 1, 1, 1);
+    return value;
+}
+
+const unsigned char * RawVolumeReader::getPlane(int sliceIdx, int channel, int threadIdx) const {
+    const RawVolume::Layout& layout = this->layout;
+    const std::size_t valueBytes = RawVolume::getNbBytes(layout.dataType);
+    const std::size_t planeBytes = layout.getSliceNbBytes();
+    const bool isInterleaved = layout.isInterleaved();
+    const std::size_t offset = sliceIdx * planeBytes + (isInterleaved ? 0 : channel * layout.channelStride * valueBytes);
+    // Offset of the channel in a plane of interleaved values, once decoded
+    const std::size_t channelOffset = isInterleaved ? channel * RawVolume::getNbBytes(this->imgDataType) : 0;
+    const bool needsSwap = (layout.isBigEndian != isHostBigEndian()) && valueBytes > 1;
+    if(!layout.isCompressed && !needsSwap && !layout.isScaled())
+        return this->file.data + layout.fileOffset + offset + channelOffset;
+
+    Decoder& decoder = this->decoders[threadIdx];
+    const int planeIdx = isInterleaved ? sliceIdx : sliceIdx * this->nbChannels + channel;
+    if(decoder.planeIdx != planeIdx) {
+        decoder.plane.resize(planeBytes);
+        if(layout.isCompressed) {
+            if(!decoder.stream)
+                decoder.stream.reset(new RawVolume::GzipStream(layout.dataFilename, layout.fileOffset));
+            if(!decoder.stream->read(layout.streamOffset + offset, decoder.plane.data(), planeBytes)) {
+                std::cerr << "ERROR: unable to decompress the slice [" << sliceIdx << "] of [" << layout.dataFilename << "]" << std::endl;
+                std::fill(decoder.plane.begin(), decoder.plane.end(), 0);
+            }
+        } else {
+            std::copy(this->file.data + layout.fileOffset + offset, this->file.data + layout.fileOffset + offset + planeBytes, decoder.plane.begin());
+        }
+        const std::size_t nbValues = planeBytes / valueBytes;
+        if(needsSwap)
+            swapValues(decoder.plane.data(), nbValues, valueBytes);
+        if(layout.isScaled()) {
+            decoder.scaledPlane.resize(nbValues);
+            scaleValues(layout.dataType, decoder.plane.data(), decoder.scaledPlane.data(), nbValues, layout.slope, layout.intercept);
+        }
+        decoder.planeIdx = planeIdx;
+    }
+    const unsigned char * plane = layout.isScaled() ? reinterpret_cast<const unsigned char*>(decoder.scaledPlane.data()) : decoder.plane.data();
+    return plane + channelOffset;
+}
+
+/**************************/
+
+RawVolumeWriter::RawVolumeWriter(const std::string& filename, const glm::ivec3& resolution, const glm::vec3& voxelSize, Image::ImageDataType dataType, int nbChannels):
+    compressedFile(nullptr), sliceNbBytes(static_cast<std::size_t>(resolution.x) * resolution.y * nbChannels * RawVolume::getNbBytes(dataType)), nbSlices(resolution.z), nbWrittenSlices(0) {
+    RawVolume::Format format;
+    if(!RawVolume::getFormat(filename, format)) {
+        std::cerr << "ERROR: [" << filename << "] is neither a NIfTI nor a NRRD filename" << std::endl;
+        return;
+    }
+
+    std::string header;
+    if(format == RawVolume::Format::NIfTI) {
+        const NIfTIType * type = std::find_if(std::begin(niftiTypes), std::end(niftiTypes), [&](const NIfTIType& type) { return type.dataType == dataType && type.nbChannels == nbChannels; });
+        if(type == std::end(niftiTypes)) {
+            std::cerr << "ERROR: a NIfTI image can't store " << nbChannels << " channel(s) of " << dataType << std::endl;
+            return;
+        }
+        // NIfTI-2 is only used when the dimensions don't fit in the 16 bits of NIfTI-1
+        const bool isNIfTI2 = glm::any(glm::greaterThan(resolution, glm::ivec3(std::numeric_limits<int16_t>::max())));
+        // The header is followed by 4 bytes telling there is no extension
+        header.assign((isNIfTI2 ? NIFTI2_HEADER_SIZE : NIFTI1_HEADER_SIZE) + 4, '\0');
+        unsigned char * data = reinterpret_cast<unsigned char*>(&header[0]);
+        const int16_t bitpix = static_cast<int16_t>(RawVolume::getNbBytes(dataType) * 8 * nbChannels);
+        if(isNIfTI2) {
+            setField<int32_t>(data, 0, NIFTI2_HEADER_SIZE);
+            std::memcpy(data + 4, "n+2\0\r\n\032\n", 8);
+            setField<int16_t>(data, 12, type->code);
+            setField<int16_t>(data, 14, bitpix);
+            for(int i = 0; i < 8; ++i) {
+                setField<int64_t>(data, 16 + 8 * i, (i == 0) ? 3 : ((i <= 3) ? resolution[i - 1] : 1));
+                setField<double>(data, 104 + 8 * i, (i == 0) ? 1. : ((i <= 3) ? voxelSize[i - 1] : 1.));
+            }
+            setField<int64_t>(data, 168, header.size());
+        } else {
+            setField<int32_t>(data, 0, NIFTI1_HEADER_SIZE);
+            for(int i = 0; i < 8; ++i) {
+                setField<int16_t>(data, 40 + 2 * i, (i == 0) ? 3 : ((i <= 3) ? resolution[i - 1] : 1));
+                setField<float>(data, 76 + 4 * i, (i == 0) ? 1.f : ((i <= 3) ? voxelSize[i - 1] : 1.f));
+            }
+            setField<int16_t>(data, 70, type->code);
+            setField<int16_t>(data, 72, bitpix);
+            setField<float>(data, 108, static_cast<float>(header.size()));
+            std::memcpy(data + 344, "n+1\0", 4);
+        }
+    } else {
+        // The channels are the first axis, so they stay interleaved
+        std::ostringstream stream;
+        stream << "NRRD0004\n";
+        stream << "type: " << getNRRDTypeName(dataType) << "\n";
+        stream << "dimension: " << ((nbChannels > 1) ? 4 : 3) << "\n";
+        stream << "sizes: " << ((nbChannels > 1) ? std::to_string(nbChannels) + " " : "") << resolution.x << " " << resolution.y << " " << resolution.z << "\n";
+        stream << "spacings: " << ((nbChannels > 1) ? "nan " : "") << voxelSize.x << " " << voxelSize.y << " " << voxelSize.z << "\n";
+        stream << "kinds: " << ((nbChannels > 1) ? "vector " : "") << "domain domain domain\n";
+        stream << "endian: " << (isHostBigEndian() ? "big" : "little") << "\n";
+        stream << "encoding: raw\n\n";
+        header = stream.str();
+    }
+
+    if(format == RawVolume::Format::NIfTI && endsWith(toLower(filename), ".gz")) {
+        this->compressedFile = gzopen(filename.c_str(), "wb1");
+    } else {
+        this->file.open(filename, std::ios::binary | std::ios::trunc);
+    }
+    if(!this->isOpen()) {
+        std::cerr << "ERROR: unable to write [" << filename << "]" << std::endl;
+        return;
+    }
+    this->write(header.data(), header.size());
+}
+
+RawVolumeWriter::~RawVolumeWriter() {
+    this->close();
+}
+
+bool RawVolumeWriter::isOpen() const {
+    return this->compressedFile != nullptr || this->file.is_open();
+}
+
+bool RawVolumeWriter::write(const void * data, std::size_t size) {
+    if(this->compressedFile) {
+        // gzwrite takes a 32 bits size
+        const std::size_t chunkSize = std::size_t(1) << 30;
+        for(std::size_t first = 0; first < size; first += chunkSize) {
+            const unsigned int chunk = static_cast<unsigned int>(std::min(chunkSize, size - first));
+            if(gzwrite(this->compressedFile, static_cast<const char*>(data) + first, chunk) != static_cast<int>(chunk))
+                return false;
+        }
+        return true;
+    }
+    this->file.write(static_cast<const char*>(data), size);
+    return static_cast<bool>(this->file);
+}
+
+bool RawVolumeWriter::writeSlice(const void * values) {
+    if(!this->isOpen())
+        return false;
+    this->nbWrittenSlices += 1;
+    return this->write(values, this->sliceNbBytes);
+}
+
+bool RawVolumeWriter::close() {
+    if(!this->isOpen())
+        return false;
+    if(this->nbWrittenSlices < this->nbSlices)
+        std::cerr << "WARNING: only [" << this->nbWrittenSlices << "] slices written out of [" << this->nbSlices << "]" << std::endl;
+    bool isWritten = true;
+    if(this->compressedFile) {
+        isWritten = (gzclose(this->compressedFile) == Z_OK);
+        this->compressedFile = nullptr;
+    } else {
+        this->file.close();
+        isWritten = !this->file.fail();
+    }
+    return isWritten;
+}
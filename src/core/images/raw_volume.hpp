@@ -0,0 +1,232 @@
+#ifndef RAW_VOLUME_HPP_
+#define RAW_VOLUME_HPP_
+
+#include "convert.hpp"
+#include "mapped_file.hpp"
+#include <glm/glm.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Formats storing a volume as a header followed by its values: NIfTI-1 and NIfTI-2 (.nii, .nii.gz) and NRRD (.nrrd, .nhdr).
+//!
+//! The headers are parsed here, without nifticlib or teem. Only the first time point of the 4D images is read.
+//! The values are read by RawVolumeReader and written by RawVolumeWriter.
+namespace RawVolume {
+
+    enum class Format {
+        NIfTI,
+        NRRD
+    };
+
+    //! @brief Format of a file from its extension: .nii and .nii.gz for NIfTI, .nrrd and .nhdr for NRRD.
+    //! @return false if the file is not a raw volume.
+    bool getFormat(const std::string& filename, Format& format);
+
+    //! @brief Number of bytes of a value of type dataType.
+    std::size_t getNbBytes(Image::ImageDataType dataType);
+
+    //! @brief Position and type of the values of a volume, read from its header.
+    struct Layout {
+        glm::ivec3 resolution;
+        glm::vec3 voxelSize;
+        //! @brief Type of the values in the file.
+        Image::ImageDataType dataType;
+        int nbChannels;
+        //! @brief Distance in values between two consecutive voxels of a row and between two channels.
+        //! The channels are either interleaved, then voxelStride is nbChannels and channelStride 1,
+        //! or stored one volume after the other, then voxelStride is 1.
+        std::size_t voxelStride;
+        std::size_t channelStride;
+        //! @brief File containing the values, the header file itself except for the detached NRRD headers.
+        std::string dataFilename;
+        //! @brief Position in dataFilename of the values, or of the gzip stream containing them.
+        std::size_t fileOffset;
+        //! @brief Number of bytes to skip in the gzip stream before the values.
+        std::size_t streamOffset;
+        bool isCompressed;
+        bool isBigEndian;
+        //! @brief The values v are read as slope * v + intercept, as the NIfTI scl_slope and scl_inter. Not used if slope is 0 or 1 and intercept 0.
+        double slope;
+        double intercept;
+
+        Layout();
+
+        bool isScaled() const;
+        bool isInterleaved() const;
+        //! @brief Number of bytes of a slice holding all its interleaved channels, or one of its channels.
+        std::size_t getSliceNbBytes() const;
+        //! @brief Number of bytes from the first value to the end of the last one.
+        std::size_t getDataNbBytes() const;
+    };
+
+    //! @brief Read the header of a .nii, .nii.gz, .nrrd or .nhdr file.
+    //! @return false, with an error message, if the header is invalid or describes values which can't be read.
+    bool readHeader(const std::string& filename, Layout& layout);
+
+    //! @brief Sequential reader of a gzip stream starting at an offset of a file, as the NRRD attached compressed data.
+    //! Seeking forward decompresses and drops the values, seeking backward restarts from the beginning of the stream.
+    class GzipStream {
+    public:
+        GzipStream(const std::string& filename, std::size_t fileOffset);
+        ~GzipStream();
+
+        GzipStream(const GzipStream&) = delete;
+        GzipStream& operator=(const GzipStream&) = delete;
+
+        bool isOpen() const;
+        //! @brief Read size bytes from the position of the decompressed stream.
+        //! @return false if the stream ends before or is corrupted.
+        bool read(std::size_t position, unsigned char * out, std::size_t size);
+
+    private:
+        std::ifstream file;
+        std::size_t fileOffset;
+        z_stream stream;
+        bool isInitialized;
+        //! @brief Position in the decompressed stream of the next decompressed byte.
+        std::size_t position;
+        std::vector<unsigned char> input;
+
+        bool restart();
+        bool inflateTo(unsigned char * out, std::size_t size);
+    };
+}
+
+//! @brief Read a NIfTI or NRRD image, see RawVolume.
+//!
+//! The uncompressed values are accessed through a memory mapping, so the native uint16 volumes are used directly as cache,
+//! see getVolumeView(). The compressed values are decompressed as a stream, each reading thread has its own stream and
+//! reading the slices in order never decompresses a value twice.
+//! The signed values are shifted to the unsigned range as for the TIFF images, see Convert::convertValue().
+struct RawVolumeReader {
+
+    glm::vec3 voxelSize;
+    glm::vec3 imgResolution;
+    //! @brief Type of the values returned, float for the scaled NIfTI values.
+    Image::ImageDataType imgDataType;
+    int nbChannels;
+
+    RawVolumeReader(const std::string& filename);
+
+    bool isValid() const { return this->valid; }
+
+    //! @brief Allow nbThreads threads to call getSlice() at the same time, each compressed stream is only opened when first read.
+    void setNbThreads(int nbThreads);
+
+    Image::ImageDataType getInternalDataType() const { return this->imgDataType; }
+
+    //! @brief Values of the whole volume if it is uncompressed native uint16 with a single channel, nullptr otherwise.
+    uint16_t * getVolumeView() const;
+
+    //! @brief Value of the first channel using nearest neighbor interpolation, read with the thread 0.
+    uint16_t getValue(const glm::vec3& coord) const;
+
+    //! @brief See ImageReader::getSlice(), out_t can be any of the types of Image::ImageDataType.
+    template<typename out_t>
+    void getSlice(int sliceIdx, std::vector<out_t>& result, int nbChannel, std::pair<int, int>  offsets, std::pair<glm::vec3, glm::vec3> bboxes, int threadIdx = 0) const {
+        const int firstRow = bboxes.first[1];
+        const int lastRow = bboxes.second[1];
+        const int width = this->layout.resolution.x;
+        const std::size_t voxelStride = this->layout.voxelStride;
+
+        Convert::RowKernel<out_t> convertRow = Convert::getRowKernel<out_t>(this->imgDataType);
+        const std::size_t valueBytes = RawVolume::getNbBytes(this->imgDataType);
+        const int nbValues = Convert::getNbValues(bboxes.first[0], bboxes.second[0], offsets.first);
+        const int nbRows = Convert::getNbValues(firstRow, lastRow, offsets.second);
+        std::size_t insertIdx = result.size();
+        result.resize(insertIdx + static_cast<std::size_t>(nbValues) * nbChannel * nbRows);
+
+        // The x stride is scaled by the voxel stride, so the rows of interleaved channels are converted as the other ones
+        const int begin = bboxes.first[0] * voxelStride;
+        const int end = bboxes.second[0] * voxelStride;
+        const int stride = offsets.first * voxelStride;
+        if(this->nbChannels == 1) {
+            const unsigned char * plane = this->getPlane(sliceIdx, 0, threadIdx);
+            for(int row = firstRow; row < lastRow; row += offsets.second)
+                insertIdx += convertRow(plane + static_cast<std::size_t>(row) * width * voxelStride * valueBytes, result.data() + insertIdx, begin, end, stride, nbChannel);
+            return;
+        }
+
+        const int nbReadChannels = std::min(nbChannel, this->nbChannels);
+        std::vector<out_t> channelRow(nbValues);
+        for(int channel = 0; channel < nbReadChannels; ++channel) {
+            // The last channel read also fills the channels missing in the image
+            const int nbCopies = (channel == nbReadChannels - 1) ? nbChannel - channel : 1;
+            const unsigned char * plane = this->getPlane(sliceIdx, channel, threadIdx);
+            out_t * out = result.data() + insertIdx + channel;
+            for(int row = firstRow; row < lastRow; row += offsets.second) {
+                convertRow(plane + static_cast<std::size_t>(row) * width * voxelStride * valueBytes, channelRow.data(), begin, end, stride, 1);
+                for(int i = 0; i < nbValues; ++i) {
+                    for(int copy = 0; copy < nbCopies; ++copy)
+                        out[i * nbChannel + copy] = channelRow[i];
+                }
+                out += static_cast<std::size_t>(nbValues) * nbChannel;
+            }
+        }
+    }
+
+private:
+    //! @brief Decoding state of a reading thread.
+    struct Decoder {
+        std::unique_ptr<RawVolume::GzipStream> stream;
+        //! @brief Last plane decoded, see getPlane().
+        int planeIdx;
+        std::vector<unsigned char> plane;
+        std::vector<float> scaledPlane;
+
+        Decoder(): planeIdx(-1) {}
+    };
+
+    bool valid;
+    RawVolume::Layout layout;
+    //! @brief Only opened for the uncompressed values.
+    MappedFile file;
+    mutable std::vector<Decoder> decoders;
+
+    //! @brief Values of imgDataType of a channel of a slice, a row of the slice is width * voxelStride values.
+    //! Points in the mapping when the values don't need to be decoded, otherwise in the buffer of the decoder of the thread.
+    const unsigned char * getPlane(int sliceIdx, int channel, int threadIdx) const;
+};
+
+//! @brief Write a volume slice per slice as NIfTI-1 or NRRD, the format is chosen from the extension of the filename, see RawVolume::getFormat().
+//! A .nii.gz file is compressed with gzip. The slices are written as soon as they are given, with the native byte order.
+//! A NIfTI image can only have multiple channels as RGB or RGBA uint8 values, a NRRD image can have any number of channels.
+struct RawVolumeWriter {
+
+    //! @param nbChannels The channels are interleaved in the slices given to writeSlice().
+    RawVolumeWriter(const std::string& filename, const glm::ivec3& resolution, const glm::vec3& voxelSize, Image::ImageDataType dataType, int nbChannels = 1);
+    ~RawVolumeWriter();
+
+    RawVolumeWriter(const RawVolumeWriter&) = delete;
+    RawVolumeWriter& operator=(const RawVolumeWriter&) = delete;
+
+    bool isOpen() const;
+
+    //! @brief Append a slice of resolution.x * resolution.y * nbChannels values of dataType.
+    bool writeSlice(const void * values);
+
+    //! @brief Called by the destructor, the image is incomplete if less than resolution.z slices were written.
+    bool close();
+
+private:
+    std::ofstream file;
+    gzFile compressedFile;
+    std::size_t sliceNbBytes;
+    int nbSlices;
+    int nbWrittenSlices;
+
+    bool write(const void * data, std::size_t size);
+};
+
+//! @}
+
+#endif
@@ -0,0 +1,67 @@
+#include "slice_cache.hpp"
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+std::size_t getDefaultSliceCacheBudget() {
+    static const std::size_t budget = [] {
+        std::size_t megabytes = SLICE_CACHE_BUDGET_MB;
+        if(const char * value = std::getenv("SLICE_CACHE_BUDGET_MB")) {
+            try {
+                megabytes = std::stoul(value);
+            } catch(const std::exception&) {
+                std::cerr << "WARNING: invalid SLICE_CACHE_BUDGET_MB [" << value << "], use " << megabytes << " MB" << std::endl;
+            }
+        }
+        return megabytes * 1024 * 1024;
+    }();
+    return budget;
+}
+
+const std::shared_ptr<SliceCacheBudget>& SliceCacheBudget::getDefault() {
+    static const std::shared_ptr<SliceCacheBudget> budget = std::make_shared<SliceCacheBudget>(getDefaultSliceCacheBudget());
+    return budget;
+}
+
+void SliceCacheBudget::setBudget(std::size_t budget) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->budget = budget;
+    }
+    this->evict();
+}
+
+std::size_t SliceCacheBudget::getBudget() const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->budget;
+}
+
+void SliceCacheBudget::add(Evictable * cache) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->caches.push_back(cache);
+}
+
+void SliceCacheBudget::remove(Evictable * cache) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->caches.erase(std::remove(this->caches.begin(), this->caches.end(), cache), this->caches.end());
+}
+
+void SliceCacheBudget::evict() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    while(this->size.load() > static_cast<std::ptrdiff_t>(this->budget)) {
+        // The entries of a cache are sorted by use, so its oldest entry is the only candidate
+        Evictable * oldestCache = nullptr;
+        uint64_t oldestUse = UINT64_MAX;
+        for(Evictable * cache : this->caches) {
+            const uint64_t lastUse = cache->getOldestUse();
+            if(lastUse < oldestUse) {
+                oldestUse = lastUse;
+                oldestCache = cache;
+            }
+        }
+        if(!oldestCache)
+            return;
+        this->size -= static_cast<std::ptrdiff_t>(oldestCache->evictOldest());
+    }
+}
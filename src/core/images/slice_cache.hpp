@@ -0,0 +1,254 @@
+#ifndef SLICE_CACHE_HPP_
+#define SLICE_CACHE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Memory budget in megabytes shared by all the SliceCache, see SliceCacheBudget::getDefault().
+//! Can be changed for a machine with the SLICE_CACHE_BUDGET_MB environment variable, see getDefaultSliceCacheBudget().
+#define SLICE_CACHE_BUDGET_MB 1024
+
+//! @brief Budget in bytes shared by the SliceCache created without an explicit budget.
+std::size_t getDefaultSliceCacheBudget();
+
+//! @brief Memory used by a slice or a brick stored in a SliceCache.
+template<typename T>
+std::size_t getNbBytes(const std::vector<T>& values) {
+    return values.size() * sizeof(T);
+}
+
+//! @brief Memory budget in bytes shared by several SliceCache, so that the memory they use together is bounded.
+//! When the budget is exceeded, the least recently used entry among all the caches sharing it is evicted first.
+//! The caches are only locked one at a time, after the budget lock, so two caches never wait for each other.
+class SliceCacheBudget {
+public:
+    //! @brief Entries of a SliceCache, as seen by the budget.
+    struct Evictable {
+        virtual ~Evictable() {}
+        //! @return Last use of the least recently used entry, or UINT64_MAX if the cache is empty.
+        virtual uint64_t getOldestUse() const = 0;
+        //! @return The number of bytes released by the eviction of the least recently used entry.
+        virtual std::size_t evictOldest() = 0;
+    };
+
+    explicit SliceCacheBudget(std::size_t budget): budget(budget), size(0), clock(0) {}
+
+    SliceCacheBudget(const SliceCacheBudget&) = delete;
+    SliceCacheBudget& operator=(const SliceCacheBudget&) = delete;
+
+    //! @brief Budget of getDefaultSliceCacheBudget() bytes, shared by the whole application.
+    static const std::shared_ptr<SliceCacheBudget>& getDefault();
+
+    void setBudget(std::size_t budget);
+    std::size_t getBudget() const;
+
+    //! @brief Number of bytes stored by all the caches.
+    std::size_t getSize() const { return this->size.load(); }
+
+    //! @brief Time of an use of an entry, comparable between the caches sharing the budget.
+    uint64_t tick() { return ++this->clock; }
+
+    void add(Evictable * cache);
+    void remove(Evictable * cache);
+
+    //! @brief Account for nbBytes more bytes, negative when entries are removed.
+    void resize(std::ptrdiff_t nbBytes) { this->size += nbBytes; }
+
+    //! @brief Evict the least recently used entries of all the caches until the budget is respected.
+    //! Must not be called while holding the lock of a cache.
+    void evict();
+
+private:
+    std::size_t budget;
+    std::atomic<std::ptrdiff_t> size;
+    std::atomic<uint64_t> clock;
+    std::vector<Evictable*> caches;
+    mutable std::mutex mutex;
+};
+
+//! @brief Store parts of an image, like slices or bricks, under a memory budget in bytes.
+//! The entries are found with a hash lookup and the least recently used ones are evicted when the budget is exceeded.
+//! All the functions are thread-safe. An entry is returned as a shared pointer, so it stays valid for the thread
+//! reading it even if it is evicted meanwhile.
+//! By default all the caches share SliceCacheBudget::getDefault(), so the memory used by the slices doesn't grow with
+//! the number of images and viewers.
+template<typename value_t>
+class SliceCache : private SliceCacheBudget::Evictable {
+public:
+    typedef int64_t Key;
+    typedef std::shared_ptr<const value_t> Entry;
+
+    //! @param budget Maximum number of bytes stored by this cache alone, 0 to share SliceCacheBudget::getDefault().
+    SliceCache(std::size_t budget = 0): SliceCache(budget > 0 ? std::make_shared<SliceCacheBudget>(budget) : SliceCacheBudget::getDefault()) {}
+
+    //! @param budget Budget shared with the other caches using it.
+    SliceCache(const std::shared_ptr<SliceCacheBudget>& budget): budget(budget), size(0) {
+        this->budget->add(this);
+    }
+
+    ~SliceCache() {
+        // No eviction can be running on this cache once it is removed from the budget
+        this->budget->remove(this);
+        this->budget->resize(-static_cast<std::ptrdiff_t>(this->size));
+    }
+
+    SliceCache(const SliceCache&) = delete;
+    SliceCache& operator=(const SliceCache&) = delete;
+
+    //! @return nullptr if the entry is not in the cache.
+    Entry get(Key key) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto it = this->index.find(key);
+        if(it == this->index.end())
+            return nullptr;
+        this->touch(it->second);
+        return it->second->value;
+    }
+
+    bool contains(Key key) const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->index.find(key) != this->index.end();
+    }
+
+    //! @brief Replace the entry if it is already stored.
+    //! @param nbBytes Memory used by the value, accounted in the budget.
+    Entry insert(Key key, value_t&& value, std::size_t nbBytes) {
+        Entry entry = std::make_shared<const value_t>(std::move(value));
+        std::ptrdiff_t addedBytes = static_cast<std::ptrdiff_t>(nbBytes);
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto it = this->index.find(key);
+            if(it != this->index.end()) {
+                addedBytes -= static_cast<std::ptrdiff_t>(it->second->nbBytes);
+                it->second->value = entry;
+                it->second->nbBytes = nbBytes;
+                this->touch(it->second);
+            } else {
+                this->entries.push_front(Node{key, entry, nbBytes, this->budget->tick()});
+                this->index[key] = this->entries.begin();
+            }
+            this->size += addedBytes;
+        }
+        this->budget->resize(addedBytes);
+        this->budget->evict();
+        return entry;
+    }
+
+    //! @brief The memory used by the value is computed by getNbBytes().
+    Entry insert(Key key, value_t&& value) {
+        const std::size_t nbBytes = getNbBytes(value);
+        return this->insert(key, std::move(value), nbBytes);
+    }
+
+    //! @brief Return the entry, calling load to compute it when it is not in the cache.
+    //! load is called without holding the cache lock, so two threads can load the same entry at the same time,
+    //! the first inserted value is then kept. Loaders sharing a non thread-safe reader have to serialize themselves.
+    Entry getOrLoad(Key key, const std::function<value_t()>& load) {
+        Entry entry = this->get(key);
+        if(entry)
+            return entry;
+        value_t value = load();
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto it = this->index.find(key);
+            if(it != this->index.end()) {
+                this->touch(it->second);
+                return it->second->value;
+            }
+        }
+        return this->insert(key, std::move(value));
+    }
+
+    void erase(Key key) {
+        std::size_t erasedBytes = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto it = this->index.find(key);
+            if(it == this->index.end())
+                return;
+            erasedBytes = it->second->nbBytes;
+            this->size -= erasedBytes;
+            this->entries.erase(it->second);
+            this->index.erase(it);
+        }
+        this->budget->resize(-static_cast<std::ptrdiff_t>(erasedBytes));
+    }
+
+    void clear() {
+        std::size_t erasedBytes = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            erasedBytes = this->size;
+            this->entries.clear();
+            this->index.clear();
+            this->size = 0;
+        }
+        this->budget->resize(-static_cast<std::ptrdiff_t>(erasedBytes));
+    }
+
+    const std::shared_ptr<SliceCacheBudget>& getBudget() const {
+        return this->budget;
+    }
+
+    //! @brief Number of bytes stored by this cache.
+    std::size_t getSize() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->size;
+    }
+
+    std::size_t getNbEntries() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->entries.size();
+    }
+
+private:
+    struct Node {
+        Key key;
+        Entry value;
+        std::size_t nbBytes;
+        uint64_t lastUse;
+    };
+
+    std::shared_ptr<SliceCacheBudget> budget;
+    std::size_t size;
+    //! @brief The most recently used entries first.
+    std::list<Node> entries;
+    std::unordered_map<Key, typename std::list<Node>::iterator> index;
+    mutable std::mutex mutex;
+
+    void touch(typename std::list<Node>::iterator it) {
+        it->lastUse = this->budget->tick();
+        this->entries.splice(this->entries.begin(), this->entries, it);
+    }
+
+    uint64_t getOldestUse() const override {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->entries.empty() ? UINT64_MAX : this->entries.back().lastUse;
+    }
+
+    std::size_t evictOldest() override {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if(this->entries.empty())
+            return 0;
+        const Node& oldest = this->entries.back();
+        const std::size_t nbBytes = oldest.nbBytes;
+        this->size -= nbBytes;
+        this->index.erase(oldest.key);
+        this->entries.pop_back();
+        return nbBytes;
+    }
+};
+
+//! @}
+
+#endif
@@ -0,0 +1,64 @@
+#include "sparse_cache.hpp"
+#include <cmath>
+#include <iostream>
+
+Occupancy::Occupancy(const glm::ivec3& dimension, int brickSize): brickShift(0) {
+    while((1 << this->brickShift) < brickSize)
+        this->brickShift += 1;
+    this->nbBricks = (dimension + glm::ivec3(brickSize - 1)) / brickSize;
+    this->isOccupied.assign(static_cast<std::size_t>(this->nbBricks.x) * this->nbBricks.y * this->nbBricks.z, 0);
+}
+
+bool Occupancy::isEmpty(const glm::vec3& bbMin, const glm::vec3& bbMax) const {
+    glm::ivec3 first;
+    glm::ivec3 last;
+    for(int i = 0; i < 3; ++i) {
+        const int dimension = this->nbBricks[i] << this->brickShift;
+        if(bbMax[i] < 0.f || bbMin[i] >= dimension || bbMin[i] > bbMax[i])
+            return true;
+        first[i] = std::max(static_cast<int>(std::floor(bbMin[i])), 0) >> this->brickShift;
+        last[i] = std::min(static_cast<int>(std::floor(bbMax[i])), dimension - 1) >> this->brickShift;
+    }
+    for(int z = first.z; z <= last.z; ++z)
+        for(int y = first.y; y <= last.y; ++y)
+            for(int x = first.x; x <= last.x; ++x)
+                if(this->isOccupied[x + static_cast<std::size_t>(this->nbBricks.x) * (y + static_cast<std::size_t>(this->nbBricks.y) * z)])
+                    return false;
+    return true;
+}
+
+float Occupancy::getOccupancyRatio() const {
+    if(this->isOccupied.empty())
+        return 0.f;
+    return static_cast<float>(std::count(this->isOccupied.begin(), this->isOccupied.end(), 1)) / this->isOccupied.size();
+}
+
+namespace {
+    template<typename voxel_t>
+    Cache * compressTypedCache(TypedCache<voxel_t> * cache, int brickSize, float minSaving) {
+        SparseCache<voxel_t> * sparseCache = new SparseCache<voxel_t>(*cache, brickSize);
+        const std::size_t nbBytes = sparseCache->getNbBytes();
+        const std::size_t denseNbBytes = sparseCache->getDenseNbBytes();
+        const float saving = 1.f - static_cast<float>(nbBytes) / static_cast<float>(denseNbBytes);
+        const float megabytes = 1024.f * 1024.f;
+        std::cout << "Sparse cache: " << nbBytes / megabytes << " MB instead of " << denseNbBytes / megabytes << " MB (" << 100.f * saving << "% saved), bricks uniform/dictionary/dense: ";
+        std::cout << sparseCache->getNbBricks(SparseCache<voxel_t>::Encoding::Uniform) << "/" << sparseCache->getNbBricks(SparseCache<voxel_t>::Encoding::Dictionary) << "/" << sparseCache->getNbBricks(SparseCache<voxel_t>::Encoding::Dense);
+        std::cout << ", occupancy: " << 100.f * sparseCache->occupancy.getOccupancyRatio() << "%" << std::endl;
+        if(saving < minSaving) {
+            std::cout << "Keep the dense cache" << std::endl;
+            delete sparseCache;
+            return cache;
+        }
+        delete cache;
+        return sparseCache;
+    }
+}
+
+Cache * compressCache(Cache * cache, int brickSize, float minSaving) {
+    const Image::ImageDataType storageType = cache->getStorageType();
+    if(storageType == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8))
+        return compressTypedCache(static_cast<TypedCache<uint8_t>*>(cache), brickSize, minSaving);
+    if(storageType == (Image::ImageDataType::Floating | Image::ImageDataType::Bit_32))
+        return compressTypedCache(static_cast<TypedCache<float>*>(cache), brickSize, minSaving);
+    return compressTypedCache(static_cast<TypedCache<uint16_t>*>(cache), brickSize, minSaving);
+}
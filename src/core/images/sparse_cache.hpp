@@ -0,0 +1,406 @@
+#ifndef SPARSE_CACHE_HPP_
+#define SPARSE_CACHE_HPP_
+
+#include "cache.hpp"
+#include <omp.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Bricks of a volume which hold at least one non-zero value, 0 being the background of the images.
+//! Used to skip the empty space, for example the tetrahedra whose every sample would be 0.
+struct Occupancy {
+    int brickShift;
+    glm::ivec3 nbBricks;
+    //! @brief One flag per brick, the bricks are stored x fastest.
+    std::vector<uint8_t> isOccupied;
+
+    Occupancy(): brickShift(0), nbBricks(0, 0, 0) {}
+    Occupancy(const glm::ivec3& dimension, int brickSize);
+
+    //! @brief True if all the voxels overlapping the box [bbMin, bbMax], in voxel coordinates, are 0.
+    //! The voxels outside of the volume are 0.
+    bool isEmpty(const glm::vec3& bbMin, const glm::vec3& bbMax) const;
+
+    //! @brief Ratio of the bricks which are not empty.
+    float getOccupancyRatio() const;
+};
+
+//! @brief Read-only cache which compresses the bricks of a volume, for the mostly empty volumes and the segmentation atlases.
+//!
+//! Each brick of brickSize^3 voxels of each channel is stored with the smallest of these encodings:
+//! - Uniform: the brick only holds one value, which is stored in the brick itself, as the empty bricks.
+//! - Dictionary: the brick holds at most 256 distinct values, as the labels of an atlas. They are stored once in a dictionary
+//!   and each voxel stores its index in 1, 2, 4 or 8 bits.
+//! - Dense: the values of the brick are stored as in a TypedCache.
+//!
+//! Every encoding is addressed directly, without decoding the brick, so getVoxel() stays a few operations and the
+//! interpolations are computed with the same kernels as TypedCache, see Interpolation::sample().
+//! The cache is built from a filled TypedCache, see the constructor, and can't be modified afterwards.
+//! The CubicBSpline interpolation would need a dense volume of coefficients, it falls back to the Cubic one with a warning,
+//! see Cache::getInterpolation().
+template<typename voxel_t>
+struct SparseCache : public Cache {
+    enum class Encoding : uint8_t {
+        Uniform,
+        Dictionary,
+        Dense
+    };
+
+    struct Brick {
+        Encoding encoding;
+        //! @brief Bits of the indices of a Dictionary brick.
+        uint8_t nbBits;
+        //! @brief Value of a Uniform brick.
+        voxel_t value;
+        //! @brief First value of a Dense brick, or first entry of the dictionary of a Dictionary brick, in values.
+        std::size_t valuesOffset;
+        //! @brief First byte of the indices of a Dictionary brick, in indices.
+        std::size_t indicesOffset;
+    };
+
+    glm::ivec3 dimension;
+    int brickSize;
+    int brickShift;
+    int brickMask;
+    glm::ivec3 nbBricks;
+    int nbChannels;
+    //! @brief The bricks of each channel are stored x fastest, the channels one after the other.
+    std::vector<Brick> bricks;
+    std::vector<voxel_t> values;
+    std::vector<uint8_t> indices;
+    //! @brief A brick is occupied if it holds a non-zero value in any channel.
+    Occupancy occupancy;
+
+    //! @brief Compress all the channels of cache, whatever its layout. The bricks are encoded in parallel.
+    //! @param brickSize Has to be a power of 2, smaller bricks are more often uniform but cost more to index.
+    SparseCache(const TypedCache<voxel_t>& cache, int brickSize): dimension(cache.dimension), brickSize(brickSize), nbChannels(cache.getNbChannels()) {
+        this->brickShift = 0;
+        while((1 << this->brickShift) < brickSize)
+            this->brickShift += 1;
+        this->brickMask = brickSize - 1;
+        this->nbBricks = Interpolation::Volume<voxel_t>::getNbBricks(this->dimension, brickSize);
+        this->occupancy = Occupancy(this->dimension, brickSize);
+        this->bricks.resize(this->getNbBricksPerChannel() * this->nbChannels);
+
+        // The encoding of each brick is chosen first, its data are then written at offsets known in advance
+        const int nbBricksTotal = static_cast<int>(this->bricks.size());
+        std::vector<int> nbDistinctValues(nbBricksTotal);
+        #pragma omp parallel
+        {
+            std::vector<voxel_t> brickValues;
+            std::vector<voxel_t> dictionary;
+            #pragma omp for schedule(dynamic)
+            for(int brickIdx = 0; brickIdx < nbBricksTotal; ++brickIdx) {
+                this->readBrick(cache, brickIdx, brickValues);
+                nbDistinctValues[brickIdx] = getDictionary(brickValues, dictionary);
+                Brick& brick = this->bricks[brickIdx];
+                brick.value = brickValues[0];
+                brick.nbBits = 0;
+                if(nbDistinctValues[brickIdx] == 1) {
+                    brick.encoding = Encoding::Uniform;
+                } else if(nbDistinctValues[brickIdx] <= 256 && this->getDictionaryNbBytes(nbDistinctValues[brickIdx]) < this->getBrickVolume() * sizeof(voxel_t)) {
+                    brick.encoding = Encoding::Dictionary;
+                    brick.nbBits = getNbBits(nbDistinctValues[brickIdx]);
+                } else {
+                    brick.encoding = Encoding::Dense;
+                }
+            }
+        }
+
+        std::size_t nbValues = 0;
+        std::size_t nbIndices = 0;
+        for(int brickIdx = 0; brickIdx < nbBricksTotal; ++brickIdx) {
+            Brick& brick = this->bricks[brickIdx];
+            brick.valuesOffset = nbValues;
+            brick.indicesOffset = nbIndices;
+            if(brick.encoding == Encoding::Dictionary) {
+                nbValues += nbDistinctValues[brickIdx];
+                nbIndices += this->getBrickVolume() * brick.nbBits / 8;
+            } else if(brick.encoding == Encoding::Dense) {
+                nbValues += this->getBrickVolume();
+            }
+            if(brick.encoding != Encoding::Uniform || brick.value != voxel_t(0))
+                this->occupancy.isOccupied[brickIdx % this->getNbBricksPerChannel()] = 1;
+        }
+        this->values.resize(nbValues);
+        this->indices.resize(nbIndices, 0);
+
+        #pragma omp parallel
+        {
+            std::vector<voxel_t> brickValues;
+            std::vector<voxel_t> dictionary;
+            #pragma omp for schedule(dynamic)
+            for(int brickIdx = 0; brickIdx < nbBricksTotal; ++brickIdx) {
+                const Brick& brick = this->bricks[brickIdx];
+                if(brick.encoding == Encoding::Uniform)
+                    continue;
+                this->readBrick(cache, brickIdx, brickValues);
+                if(brick.encoding == Encoding::Dense) {
+                    std::copy(brickValues.begin(), brickValues.end(), this->values.begin() + brick.valuesOffset);
+                    continue;
+                }
+                getDictionary(brickValues, dictionary);
+                std::copy(dictionary.begin(), dictionary.end(), this->values.begin() + brick.valuesOffset);
+                uint8_t * brickIndices = this->indices.data() + brick.indicesOffset;
+                int index = 0;
+                for(std::size_t local = 0; local < brickValues.size(); ++local) {
+                    // Neighbor voxels often have the same label
+                    if(dictionary[index] != brickValues[local])
+                        index = static_cast<int>(std::find(dictionary.begin(), dictionary.end(), brickValues[local]) - dictionary.begin());
+                    const std::size_t bit = local * brick.nbBits;
+                    brickIndices[bit >> 3] |= static_cast<uint8_t>(index << (bit & 7));
+                }
+            }
+        }
+    }
+
+    Image::ImageDataType getStorageType() const override;
+
+    int getNbChannels() const override {
+        return this->nbChannels;
+    }
+
+    //! @brief Value of a voxel inside of the volume.
+    voxel_t getVoxel(int x, int y, int z, int channel = 0) const {
+        const std::size_t brickIdx = static_cast<std::size_t>(channel) * this->getNbBricksPerChannel() + (x >> this->brickShift) + static_cast<std::size_t>(this->nbBricks.x) * ((y >> this->brickShift) + static_cast<std::size_t>(this->nbBricks.y) * (z >> this->brickShift));
+        const Brick& brick = this->bricks[brickIdx];
+        if(brick.encoding == Encoding::Uniform)
+            return brick.value;
+        const std::size_t local = (x & this->brickMask) | ((y & this->brickMask) << this->brickShift) | (static_cast<std::size_t>(z & this->brickMask) << (2 * this->brickShift));
+        return this->getVoxel(brick, local);
+    }
+
+    //! @brief Append the values of a slice to result, converted to out_t, with nbChannel interleaved channels.
+    //! The last channel is duplicated if the cache has less than nbChannel channels.
+    template<typename out_t>
+    void getSlice(int imageIdx, std::vector<out_t>& result, int nbChannel) const {
+        const std::size_t insertIdx = result.size();
+        result.resize(insertIdx + static_cast<std::size_t>(this->dimension.x) * this->dimension.y * nbChannel);
+        for(int channel = 0; channel < nbChannel; ++channel)
+            this->extractSlice(2, imageIdx, std::min(channel, this->nbChannels - 1), result.data() + insertIdx + channel, nbChannel);
+    }
+
+    //! @brief Append the values of the slice sliceIdx orthogonal to axis of a channel to result, as TypedCache::getAxisSlice().
+    template<typename out_t>
+    void getAxisSlice(int axis, int sliceIdx, std::vector<out_t>& result, int channel = 0) const {
+        const int axisU = (axis == 0) ? 1 : 0;
+        const int axisV = (axis == 2) ? 1 : 2;
+        const std::size_t insertIdx = result.size();
+        result.resize(insertIdx + static_cast<std::size_t>(this->dimension[axisU]) * this->dimension[axisV]);
+        this->extractSlice(axis, sliceIdx, channel, result.data() + insertIdx, 1);
+    }
+
+    //! @brief Replace all the values by 0.
+    void reset() override {
+        for(Brick& brick : this->bricks) {
+            brick.encoding = Encoding::Uniform;
+            brick.value = voxel_t(0);
+        }
+        this->values.clear();
+        this->values.shrink_to_fit();
+        this->indices.clear();
+        this->indices.shrink_to_fit();
+        std::fill(this->occupancy.isOccupied.begin(), this->occupancy.isOccupied.end(), 0);
+    }
+
+    float getValue(const glm::vec3& coord, Interpolation::Method interpolationMethod) const override {
+        float value = 0.f;
+        this->getValues(&coord, 1, &value, interpolationMethod);
+        return value;
+    }
+
+    void getValues(const glm::vec3 * coords, std::size_t nbValues, float * result, Interpolation::Method interpolationMethod) const override {
+        switch(this->getInterpolation(interpolationMethod)) {
+            case Interpolation::Method::Linear:
+                this->sample<Interpolation::Method::Linear>(coords, nbValues, result);
+                break;
+            case Interpolation::Method::Cubic:
+                this->sample<Interpolation::Method::Cubic>(coords, nbValues, result);
+                break;
+            default:
+                this->sample<Interpolation::Method::NearestNeighbor>(coords, nbValues, result);
+                break;
+        }
+    }
+
+    //! @brief The uniform bricks are accumulated at once.
+    Statistics computeStatistics(const ValueMapping& mapping = ValueMapping()) const override {
+        Statistics statistics(mapping);
+        const int nbBricksTotal = static_cast<int>(this->bricks.size());
+        #pragma omp parallel
+        {
+            Statistics localStatistics(mapping);
+            std::vector<voxel_t> brickValues;
+            #pragma omp for schedule(dynamic)
+            for(int brickIdx = 0; brickIdx < nbBricksTotal; ++brickIdx) {
+                const Brick& brick = this->bricks[brickIdx];
+                const glm::ivec3 origin = this->getBrickOrigin(brickIdx);
+                const glm::ivec3 size = glm::min(glm::ivec3(this->brickSize), this->dimension - origin);
+                if(brick.encoding == Encoding::Uniform) {
+                    localStatistics.addRepeated(brick.value, static_cast<std::size_t>(size.x) * size.y * size.z);
+                    continue;
+                }
+                // The padding of the bricks is not part of the image
+                brickValues.clear();
+                for(int z = 0; z < size.z; ++z)
+                    for(int y = 0; y < size.y; ++y)
+                        for(int x = 0; x < size.x; ++x)
+                            brickValues.push_back(this->getVoxel(brick, x | (y << this->brickShift) | (static_cast<std::size_t>(z) << (2 * this->brickShift))));
+                localStatistics.add(brickValues);
+            }
+            #pragma omp critical
+            statistics.merge(localStatistics);
+        }
+        return statistics;
+    }
+
+    //! @brief Memory used by the compressed values and the description of the bricks.
+    std::size_t getNbBytes() const {
+        return this->bricks.size() * sizeof(Brick) + this->values.size() * sizeof(voxel_t) + this->indices.size() + this->occupancy.isOccupied.size();
+    }
+
+    //! @brief Memory used by the same values in a TypedCache.
+    std::size_t getDenseNbBytes() const {
+        return static_cast<std::size_t>(this->dimension.x) * this->dimension.y * this->dimension.z * this->nbChannels * sizeof(voxel_t);
+    }
+
+    std::size_t getNbBricks(Encoding encoding) const {
+        return std::count_if(this->bricks.begin(), this->bricks.end(), [encoding](const Brick& brick) { return brick.encoding == encoding; });
+    }
+
+private:
+    std::size_t getNbBricksPerChannel() const {
+        return static_cast<std::size_t>(this->nbBricks.x) * this->nbBricks.y * this->nbBricks.z;
+    }
+
+    std::size_t getBrickVolume() const {
+        return static_cast<std::size_t>(this->brickSize) * this->brickSize * this->brickSize;
+    }
+
+    std::size_t getDictionaryNbBytes(int nbEntries) const {
+        return nbEntries * sizeof(voxel_t) + this->getBrickVolume() * getNbBits(nbEntries) / 8;
+    }
+
+    static uint8_t getNbBits(int nbEntries) {
+        if(nbEntries <= 2)
+            return 1;
+        if(nbEntries <= 4)
+            return 2;
+        if(nbEntries <= 16)
+            return 4;
+        return 8;
+    }
+
+    glm::ivec3 getBrickOrigin(std::size_t brickIdx) const {
+        brickIdx %= this->getNbBricksPerChannel();
+        return glm::ivec3(brickIdx % this->nbBricks.x, (brickIdx / this->nbBricks.x) % this->nbBricks.y, brickIdx / (static_cast<std::size_t>(this->nbBricks.x) * this->nbBricks.y)) * this->brickSize;
+    }
+
+    //! @param local Position of the voxel in a non Uniform brick, x fastest.
+    voxel_t getVoxel(const Brick& brick, std::size_t local) const {
+        if(brick.encoding == Encoding::Dense)
+            return this->values[brick.valuesOffset + local];
+        if(brick.encoding == Encoding::Uniform)
+            return brick.value;
+        // The indices have 1, 2, 4 or 8 bits so they never cross a byte
+        const std::size_t bit = local * brick.nbBits;
+        const int index = (this->indices[brick.indicesOffset + (bit >> 3)] >> (bit & 7)) & ((1 << brick.nbBits) - 1);
+        return this->values[brick.valuesOffset + index];
+    }
+
+    //! @brief Copy the values of a brick of cache, x fastest, the voxels of the padding repeat the first voxel of the brick.
+    void readBrick(const TypedCache<voxel_t>& cache, std::size_t brickIdx, std::vector<voxel_t>& brickValues) const {
+        const Interpolation::Volume<voxel_t> volume = cache.getVolume(static_cast<int>(brickIdx / this->getNbBricksPerChannel()));
+        const glm::ivec3 origin = this->getBrickOrigin(brickIdx);
+        const glm::ivec3 size = glm::min(glm::ivec3(this->brickSize), this->dimension - origin);
+        brickValues.assign(this->getBrickVolume(), volume.data[volume.getOffset(origin.x, origin.y, origin.z)]);
+        for(int z = 0; z < size.z; ++z) {
+            for(int y = 0; y < size.y; ++y) {
+                voxel_t * out = brickValues.data() + (static_cast<std::size_t>(z) << (2 * this->brickShift)) + (y << this->brickShift);
+                const std::ptrdiff_t rowOffset = volume.getOffset(1, origin.y + y) + volume.getOffset(2, origin.z + z);
+                for(int x = 0; x < size.x; ++x)
+                    out[x] = volume.data[rowOffset + volume.getOffset(0, origin.x + x)];
+            }
+        }
+    }
+
+    //! @brief Distinct values of a brick in order of appearance, the counting stops after 257 values.
+    //! @return The number of distinct values, 257 if there are more.
+    static int getDictionary(const std::vector<voxel_t>& brickValues, std::vector<voxel_t>& dictionary) {
+        dictionary.clear();
+        dictionary.push_back(brickValues[0]);
+        voxel_t previous = brickValues[0];
+        for(const voxel_t& value : brickValues) {
+            if(value == previous)
+                continue;
+            previous = value;
+            if(std::find(dictionary.begin(), dictionary.end(), value) == dictionary.end()) {
+                dictionary.push_back(value);
+                if(dictionary.size() > 256)
+                    break;
+            }
+        }
+        return static_cast<int>(dictionary.size());
+    }
+
+    //! @brief Write the slice of a channel in out, the value (u, v) at out[(v * sizeU + u) * stride], as getAxisSlice().
+    //! The slice is written brick by brick, the Uniform bricks are filled without reading them voxel per voxel.
+    template<typename out_t>
+    void extractSlice(int axis, int sliceIdx, int channel, out_t * out, int stride) const {
+        const int axisU = (axis == 0) ? 1 : 0;
+        const int axisV = (axis == 2) ? 1 : 2;
+        const int sizeU = this->dimension[axisU];
+        const int sizeV = this->dimension[axisV];
+        const std::size_t brickStrides[3] = {1, static_cast<std::size_t>(this->nbBricks.x), static_cast<std::size_t>(this->nbBricks.x) * this->nbBricks.y};
+        const int localShifts[3] = {0, this->brickShift, 2 * this->brickShift};
+        const std::size_t firstBrick = static_cast<std::size_t>(channel) * this->getNbBricksPerChannel() + (sliceIdx >> this->brickShift) * brickStrides[axis];
+        const std::size_t localSlice = static_cast<std::size_t>(sliceIdx & this->brickMask) << localShifts[axis];
+        #pragma omp parallel for schedule(dynamic) if(sizeU * sizeV > 256 * 256)
+        for(int brickV = 0; brickV < this->nbBricks[axisV]; ++brickV) {
+            for(int brickU = 0; brickU < this->nbBricks[axisU]; ++brickU) {
+                const Brick& brick = this->bricks[firstBrick + brickU * brickStrides[axisU] + brickV * brickStrides[axisV]];
+                const int firstU = brickU * this->brickSize;
+                const int firstV = brickV * this->brickSize;
+                const int nbU = std::min(this->brickSize, sizeU - firstU);
+                const int nbV = std::min(this->brickSize, sizeV - firstV);
+                for(int v = 0; v < nbV; ++v) {
+                    out_t * row = out + (static_cast<std::size_t>(firstV + v) * sizeU + firstU) * stride;
+                    if(brick.encoding == Encoding::Uniform) {
+                        const out_t value = Convert::convertValue<voxel_t, out_t>(brick.value);
+                        for(int u = 0; u < nbU; ++u)
+                            row[static_cast<std::size_t>(u) * stride] = value;
+                        continue;
+                    }
+                    const std::size_t localRow = localSlice | (static_cast<std::size_t>(v) << localShifts[axisV]);
+                    for(int u = 0; u < nbU; ++u)
+                        row[static_cast<std::size_t>(u) * stride] = Convert::convertValue<voxel_t, out_t>(this->getVoxel(brick, localRow | (static_cast<std::size_t>(u) << localShifts[axisU])));
+                }
+            }
+        }
+    }
+
+    template<Interpolation::Method method>
+    void sample(const glm::vec3 * coords, std::size_t nbValues, float * result) const {
+        const auto fetch = [this](int x, int y, int z) { return this->getVoxel(x, y, z); };
+        for(std::size_t i = 0; i < nbValues; ++i)
+            result[i] = Interpolation::sample<method, voxel_t>(this->dimension, coords[i], fetch);
+    }
+};
+
+template<> inline Image::ImageDataType SparseCache<uint8_t>::getStorageType() const { return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8; }
+template<> inline Image::ImageDataType SparseCache<uint16_t>::getStorageType() const { return Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_16; }
+template<> inline Image::ImageDataType SparseCache<float>::getStorageType() const { return Image::ImageDataType::Floating | Image::ImageDataType::Bit_32; }
+
+//! @brief Compress cache into a SparseCache if it saves at least minSaving of its memory, cache is then deleted.
+//! The memory used by both is printed.
+//! @return The cache to use, cache itself if it is kept.
+Cache * compressCache(Cache * cache, int brickSize, float minSaving);
+
+//! @}
+
+#endif
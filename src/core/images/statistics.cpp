@@ -0,0 +1,52 @@
+#include "statistics.hpp"
+
+void Statistics::merge(const Statistics& other) {
+    if(other.isEmpty())
+        return;
+    this->nbValues += other.nbValues;
+    this->minValue = std::min(this->minValue, other.minValue);
+    this->maxValue = std::max(this->maxValue, other.maxValue);
+    this->sum += other.sum;
+    for(int i = 0; i < NB_BINS; ++i)
+        this->histogram[i] += other.histogram[i];
+}
+
+double Statistics::getMean() const {
+    return this->isEmpty() ? 0. : this->sum / static_cast<double>(this->nbValues);
+}
+
+uint16_t Statistics::getMinNonZeroValue() const {
+    for(int i = 1; i < NB_BINS; ++i) {
+        if(this->histogram[i] > 0)
+            return i;
+    }
+    return 0;
+}
+
+uint16_t Statistics::getMaxValue() const {
+    for(int i = NB_BINS - 1; i > 0; --i) {
+        if(this->histogram[i] > 0)
+            return i;
+    }
+    return 0;
+}
+
+uint16_t Statistics::getPercentile(float percentile) const {
+    if(this->isEmpty())
+        return 0;
+    const double rank = std::min(std::max(static_cast<double>(percentile), 0.), 100.) / 100. * static_cast<double>(this->nbValues);
+    uint64_t count = 0;
+    for(int i = 0; i < NB_BINS; ++i) {
+        count += this->histogram[i];
+        if(static_cast<double>(count) >= rank && count > 0)
+            return i;
+    }
+    return NB_BINS - 1;
+}
+
+std::vector<int> Statistics::getHistogram(uint16_t minValue, uint16_t maxValue) const {
+    std::vector<int> result(static_cast<std::size_t>(maxValue) + 1, 0);
+    for(int i = minValue; i <= maxValue; ++i)
+        result[i] = static_cast<int>(this->histogram[i]);
+    return result;
+}
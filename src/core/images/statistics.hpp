@@ -0,0 +1,142 @@
+#ifndef STATISTICS_HPP_
+#define STATISTICS_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+//! \addtogroup img
+//! @{
+
+//! @brief Linear map of the values into the uint16 range used to display the images, the identity for the integer images.
+//! The floating point images are mapped from [min(minValue, 0), maxValue] onto [0, 65535], so that 0 stays the background
+//! and the images in [0, 1] use the whole range, see fromRange() and Sampler::valueMapping.
+struct ValueMapping {
+    float offset;
+    float scale;
+
+    ValueMapping(): offset(0.f), scale(1.f) {}
+
+    static ValueMapping fromRange(float minValue, float maxValue) {
+        ValueMapping mapping;
+        mapping.offset = std::min(minValue, 0.f);
+        if(maxValue > mapping.offset)
+            mapping.scale = static_cast<float>(std::numeric_limits<uint16_t>::max()) / (maxValue - mapping.offset);
+        return mapping;
+    }
+
+    bool operator==(const ValueMapping& other) const {
+        return this->offset == other.offset && this->scale == other.scale;
+    }
+
+    //! @brief Mapped value clamped to the range of out_t, NaN is mapped to 0.
+    template<typename out_t>
+    out_t apply(float value) const {
+        const float mapped = (value - this->offset) * this->scale;
+        if(!(mapped > 0.f))
+            return out_t(0);
+        return static_cast<out_t>(std::min(mapped, static_cast<float>(std::numeric_limits<out_t>::max())));
+    }
+
+    //! @brief Append the mapped values to result.
+    template<typename out_t>
+    void apply(const std::vector<float>& values, std::vector<out_t>& result) const {
+        const std::size_t insertIdx = result.size();
+        result.resize(insertIdx + values.size());
+        for(std::size_t i = 0; i < values.size(); ++i)
+            result[insertIdx + i] = this->apply<out_t>(values[i]);
+    }
+};
+
+//! @brief Statistics of the values of an image, accumulated while the image is loaded so the volume never has to be read again.
+//!
+//! The histogram has one bin per integer value of the uint16 range, the type used to display the images. The values are binned
+//! after the mapping, so the histogram of a floating point image is the one of its displayed values once mapping is set from
+//! its value range. Each thread accumulates its own Statistics which are then merged, see Sampler::fillCache().
+struct Statistics {
+    static const int NB_BINS = 1 << 16;
+
+    std::size_t nbValues;
+    float minValue;
+    float maxValue;
+    double sum;
+    std::vector<uint64_t> histogram;
+    //! @brief Mapping applied to the values before binning them, minValue, maxValue and sum are not mapped.
+    ValueMapping mapping;
+
+    explicit Statistics(const ValueMapping& mapping = ValueMapping()): nbValues(0), minValue(std::numeric_limits<float>::max()), maxValue(std::numeric_limits<float>::lowest()), sum(0.), histogram(NB_BINS, 0), mapping(mapping) {}
+
+    bool isEmpty() const { return this->nbValues == 0; }
+
+    template<typename data_t>
+    void add(const data_t * values, std::size_t size) {
+        if(size == 0)
+            return;
+        data_t localMin = values[0];
+        data_t localMax = values[0];
+        double localSum = 0.;
+        for(std::size_t i = 0; i < size; ++i) {
+            const data_t value = values[i];
+            localMin = std::min(localMin, value);
+            localMax = std::max(localMax, value);
+            localSum += static_cast<double>(value);
+            this->histogram[getBin(value)] += 1;
+        }
+        this->minValue = std::min(this->minValue, static_cast<float>(localMin));
+        this->maxValue = std::max(this->maxValue, static_cast<float>(localMax));
+        this->sum += localSum;
+        this->nbValues += size;
+    }
+
+    template<typename data_t>
+    void add(const std::vector<data_t>& values) {
+        this->add(values.data(), values.size());
+    }
+
+    //! @brief Add count times the same value, as the uniform regions of a SparseCache.
+    template<typename data_t>
+    void addRepeated(data_t value, std::size_t count) {
+        if(count == 0)
+            return;
+        this->minValue = std::min(this->minValue, static_cast<float>(value));
+        this->maxValue = std::max(this->maxValue, static_cast<float>(value));
+        this->sum += static_cast<double>(value) * count;
+        this->histogram[getBin(value)] += count;
+        this->nbValues += count;
+    }
+
+    //! @brief Add the values accumulated by another thread, with the same mapping.
+    void merge(const Statistics& other);
+
+    double getMean() const;
+
+    //! @brief Smallest value greater than 0, 0 being the background of the images.
+    //! Computed from the histogram, so in the mapped range.
+    uint16_t getMinNonZeroValue() const;
+
+    //! @brief Largest value converted to uint16, computed from the histogram.
+    uint16_t getMaxValue() const;
+
+    //! @brief Value below which percentile percents of the values are, computed from the histogram.
+    //! Exact for integer images, approximated to the lower integer for floating point images.
+    uint16_t getPercentile(float percentile) const;
+
+    //! @brief Histogram with one bin per integer value in [0, maxValue], the values lower than minValue are not counted.
+    std::vector<int> getHistogram(uint16_t minValue, uint16_t maxValue) const;
+
+private:
+    template<typename data_t>
+    int getBin(data_t value) const {
+        if constexpr (std::numeric_limits<data_t>::is_integer && sizeof(data_t) <= 2 && !std::numeric_limits<data_t>::is_signed) {
+            return value;
+        } else {
+            return this->mapping.apply<uint16_t>(static_cast<float>(value));
+        }
+    }
+};
+
+//! @}
+
+#endif
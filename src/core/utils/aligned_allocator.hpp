@@ -0,0 +1,42 @@
+#ifndef ALIGNED_ALLOCATOR_HPP_
+#define ALIGNED_ALLOCATOR_HPP_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+//! @brief Allocator of std::vector whose storage starts on a multiple of Alignment bytes, typically a cache line.
+template<typename T, std::size_t Alignment>
+struct AlignedAllocator {
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two at least alignof(T)");
+
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() noexcept {}
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T * allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T * p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+template<typename T, std::size_t Alignment>
+using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+
+#endif
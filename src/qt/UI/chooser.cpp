@@ -51,7 +51,7 @@ void FileChooser::click() {
     switch(this->type) {
         case FileChooserType::SELECT:
             if(this->format == FileChooserFormat::TIFF)
-                filename = QFileDialog::getOpenFileName(nullptr, "Open TIFF images", QDir::currentPath(), "TIFF files (*.tiff *.tif)", 0, QFileDialog::DontUseNativeDialog);
+                filename = QFileDialog::getOpenFileName(nullptr, "Open images", QDir::currentPath(), "Images (*.tiff *.tif *.nii *.nii.gz *.nrrd *.nhdr *.bvol)", 0, QFileDialog::DontUseNativeDialog);
             else if(this->format == FileChooserFormat::MESH)
                 filename = QFileDialog::getOpenFileName(nullptr, "Open mesh file", QDir::currentPath(), "MESH files (*.mesh)", 0, QFileDialog::DontUseNativeDialog);
             else
@@ -60,7 +60,7 @@ void FileChooser::click() {
 
         case FileChooserType::SAVE:
             if(this->format == FileChooserFormat::TIFF)
-                filename = QFileDialog::getSaveFileName(nullptr, "Select the image to save", QDir::currentPath(), tr("TIFF Files (*.tiff)"), 0, QFileDialog::DontUseNativeDialog);
+                filename = QFileDialog::getSaveFileName(nullptr, "Select the image to save", QDir::currentPath(), tr("TIFF Files (*.tiff);;NIfTI Files (*.nii *.nii.gz);;NRRD Files (*.nrrd)"), 0, QFileDialog::DontUseNativeDialog);
             else if(this->format == FileChooserFormat::MESH)
                 filename = QFileDialog::getSaveFileName(nullptr, "Select the mesh to save", QDir::currentPath(), tr("MESH Files (*.mesh)"), 0, QFileDialog::DontUseNativeDialog);
             else if(this->format == FileChooserFormat::PATH)
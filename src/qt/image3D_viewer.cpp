@@ -4,60 +4,55 @@
 #include "scene.hpp"
 #include <ostream>
 
-Raw3DImage::Raw3DImage(const glm::ivec3 imgSize, DrawableGrid * grid, QImage::Format format) {
+Raw3DImage::Raw3DImage(const glm::ivec3 imgSize, DrawableGrid * grid, QImage::Format format): data(std::make_shared<SliceCache<std::vector<uint16_t>>>()), images(std::make_shared<SliceCache<QImage>>()) {
     this->grid = grid;
     this->imgSize = imgSize;
     max = 0;
     this->format = format;
-    for(int k = 0; k < imgSize[2]; ++k) {
-        this->data.push_back(std::vector<uint16_t>(this->imgSize.x*this->imgSize.y, 0));
-        this->images.push_back(QImage(this->imgSize.x, this->imgSize.y, format));
-        this->images.back().fill(QColor(0, 0, 0));
+}
 
-        this->upToDate.push_back(false);
-    }
+SliceCache<std::vector<uint16_t>>::Entry Raw3DImage::setSlice(const int& idx, std::vector<uint16_t>&& data) {
+    // The max is only increased, the slices already evicted can't be read again to lower it
+    if(!data.empty())
+        this->max = std::max(this->max, static_cast<int>(*std::max_element(data.begin(), data.end())));
+    this->images->erase(idx);
+    return this->data->insert(idx, std::move(data));
 }
 
-void Raw3DImage::setSlice(const int& idx, const std::vector<uint16_t>& data) {
-    this->data[idx] = data;
-    this->updateMaxValue();
-    this->upToDate[idx] = false;
+bool Raw3DImage::hasSlice(const int& idx) const {
+    return this->data->contains(idx);
 }
 
-void Raw3DImage::setImage(const std::vector<std::vector<uint16_t>>& data) {
-    this->data = data;
-    this->updateMaxValue();
-    this->images.clear();
-    this->upToDate.clear();
-    for(int k = 0; k < imgSize[2]; ++k) {
-        this->images.push_back(QImage(this->imgSize.x, this->imgSize.y, format));
-        this->upToDate.push_back(false);
-    }
+SliceCache<std::vector<uint16_t>>::Entry Raw3DImage::getSlice(const int& idx) const {
+    return this->data->get(idx);
 }
 
-QImage& Raw3DImage::getImage(const int& imageIdx) {
-    if(!this->upToDate[imageIdx]) {
-        this->convertDataToImg(imageIdx);
-        this->upToDate[imageIdx] = true;
+QImage Raw3DImage::getImage(const int& imageIdx) {
+    if(auto image = this->images->get(imageIdx))
+        return *image;
+    auto slice = this->data->get(imageIdx);
+    if(!slice) {
+        QImage image(this->imgSize.x, this->imgSize.y, this->format);
+        image.fill(QColor(0, 0, 0));
+        return image;
     }
-    return images[imageIdx];
+    QImage image = this->convertDataToImg(*slice);
+    this->images->insert(imageIdx, QImage(image), image.sizeInBytes());
+    return image;
 }
 
-void Raw3DImage::updateMaxValue() {
-    max = 0;
-    for(int i = 0; i < this->data.size(); ++i) {
-        uint16_t currentMax = *max_element(data[i].begin(), data[i].end());
-        if(currentMax > max)
-            max = currentMax;
-    }
+void Raw3DImage::clear() {
+    this->data->clear();
+    this->images->clear();
+    this->max = 0;
 }
 
-void Raw3DImage::convertDataToImg(const int& imageIdx) {
-    this->updateMaxValue();
+QImage Raw3DImage::convertDataToImg(const std::vector<uint16_t>& slice) const {
+    QImage image(this->imgSize.x, this->imgSize.y, this->format);
     for(int i = 0; i < imgSize[0]; ++i) {
         for(int j = 0; j < imgSize[1]; ++j) {
             QColor qColor;
-            uint16_t value = data[imageIdx][i + j * imgSize[0]];
+            uint16_t value = slice[i + j * imgSize[0]];
             if(grid->visu_map[value].r == 0.) {
                 qColor = QColor(0., 0., 0.);
             } else {
@@ -76,9 +71,10 @@ void Raw3DImage::convertDataToImg(const int& imageIdx) {
                             );
                 }
             }
-            this->images[imageIdx].setPixelColor(i, j, qColor);
+            image.setPixelColor(i, j, qColor);
         }
     }
+    return image;
 }
 
 /////////////////
@@ -249,9 +245,6 @@ void Image3DViewer::init(const glm::vec3& imageSize, const glm::vec3& voxelSize,
     this->colors = colors;
     this->interpolationMethod = interpolationMethod;
 
-    this->upToDate.clear();
-    this->upToDate = std::vector<std::vector<bool>>(gridNames.size(), std::vector<bool>(this->imageSize.z, false));
-
     imgData.clear();
     imgData.reserve(gridNames.size());
     for(auto name : gridNames)
@@ -271,17 +264,26 @@ void Image3DViewer::setSliceIdx(int newSliceIdx) {
 }
 
 void Image3DViewer::saveImagesSlices(const QString& fileName) {
-    this->fillAllImagesSlices();
-    this->scene->writeGreyscaleTIFFImage(fileName.toStdString(), this->imageSize, this->imgData[this->imagesToDraw[0]].data);
-    //for(int sliceIdx = 0; sliceIdx < this->upToDate[0].size(); ++sliceIdx) {
+    const int imageIdx = this->imagesToDraw[0];
+    std::vector<std::vector<uint16_t>> slices(this->imageSize.z);
+    for(int sliceIdx = 0; sliceIdx < this->imageSize.z; ++sliceIdx) {
+        auto slice = this->imgData[imageIdx].getSlice(sliceIdx);
+        if(!slice) {
+            std::cout << "Fill image " << sliceIdx << std::endl;
+            slice = this->fillImage(imageIdx, sliceIdx);
+        }
+        slices[sliceIdx] = *slice;
+    }
+    this->scene->writeGreyscaleTIFFImage(fileName.toStdString(), this->imageSize, slices);
+    //for(int sliceIdx = 0; sliceIdx < this->imageSize.z; ++sliceIdx) {
     //    QString fileName = path + QString("/slice") + QString(std::to_string(sliceIdx).c_str()) + QString(".png");
     //    this->getMergedImage(sliceIdx).save(fileName);
     //}
 }
 
 void Image3DViewer::reset() {
-    for(auto& line : this->upToDate)
-        std::fill(line.begin(), line.end(), false);
+    for(auto& image : this->imgData)
+        image.clear();
 }
 
 void Image3DViewer::initLayout() {
@@ -292,26 +294,12 @@ void Image3DViewer::initLayout() {
 
 void Image3DViewer::fillCurrentImages() {
     for(int i = 0; i < this->imagesToDraw.size(); ++i) {
-        if(!this->upToDate[this->imagesToDraw[i]][this->sliceIdx]) {
+        if(!this->imgData[this->imagesToDraw[i]].hasSlice(this->sliceIdx))
             this->fillImage(this->imagesToDraw[i], this->sliceIdx);
-            this->upToDate[this->imagesToDraw[i]][this->sliceIdx] = true;
-        }
-    }
-}
-
-void Image3DViewer::fillAllImagesSlices() {
-    for(int sliceIdx = 0; sliceIdx < this->upToDate[0].size(); ++sliceIdx) {
-        std::cout << "Fill image " << sliceIdx << std::endl;
-        for(int i = 0; i < this->imagesToDraw.size(); ++i) {
-            if(!this->upToDate[this->imagesToDraw[i]][sliceIdx]) {
-                this->fillImage(this->imagesToDraw[i], sliceIdx);
-                this->upToDate[this->imagesToDraw[i]][sliceIdx] = true;
-            }
-        }
     }
 }
 
-void Image3DViewer::fillImage(int imageIdx, int sliceIdx) {
+SliceCache<std::vector<uint16_t>>::Entry Image3DViewer::fillImage(int imageIdx, int sliceIdx) {
     std::vector<uint16_t> data;
     auto bbox = scene->getBbox(this->gridNames[0]);
     glm::vec3 slices(-1, -1, sliceIdx);
@@ -322,7 +310,7 @@ void Image3DViewer::fillImage(int imageIdx, int sliceIdx) {
     if(this->direction == glm::vec3(0., 0., 1.))
         std::swap(slices.z, slices.z);
     scene->getValues(this->gridNames[imageIdx], slices, bbox, this->imageSize, data, this->interpolationMethod);
-    this->imgData[imageIdx].setSlice(sliceIdx, data);
+    return this->imgData[imageIdx].setSlice(sliceIdx, std::move(data));
 }
 
 void Image3DViewer::getColor(int idx, glm::ivec3 position, QColor& color) {
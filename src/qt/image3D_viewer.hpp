@@ -10,9 +10,13 @@
 #include "UI/form.hpp"
 //#include "src/core/drawable/drawable_grid.hpp"
 #include "../core/geometry/grid.hpp"
+#include "../core/images/slice_cache.hpp"
+#include <memory>
 
 class Scene;
 
+//! @brief Slices of a grid sampled by an Image3DViewer and their conversion to QImage.
+//! Only the recently used slices are kept, under the memory budget shared by all the SliceCache.
 class Raw3DImage {
 
 public:
@@ -20,22 +24,26 @@ public:
 
     QImage::Format format;
     glm::ivec3 imgSize;
-    std::vector<std::vector<uint16_t>> data;
     DrawableGrid * grid;
 
 private:
-    std::vector<bool> upToDate;
-    std::vector<QImage> images;
+    // Shared by the copies of this image
+    std::shared_ptr<SliceCache<std::vector<uint16_t>>> data;
+    std::shared_ptr<SliceCache<QImage>> images;
 
 public:
     Raw3DImage(const glm::ivec3 imgSize, DrawableGrid * grid, QImage::Format format);
-    void setSlice(const int& idx, const std::vector<uint16_t>& data);
-    void setImage(const std::vector<std::vector<uint16_t>>& data);
-    QImage& getImage(const int& imageIdx);
+    SliceCache<std::vector<uint16_t>>::Entry setSlice(const int& idx, std::vector<uint16_t>&& data);
+    bool hasSlice(const int& idx) const;
+    //! @return nullptr if the slice was never set or was evicted.
+    SliceCache<std::vector<uint16_t>>::Entry getSlice(const int& idx) const;
+    //! @brief A slice which is not set is black.
+    QImage getImage(const int& imageIdx);
+    //! @brief Drop all the slices, they have to be set again.
+    void clear();
 
 private:
-    void updateMaxValue();
-    void convertDataToImg(const int& imageIdx);
+    QImage convertDataToImg(const std::vector<uint16_t>& slice) const;
 };
 
 class Image2DViewer : public QWidget {
@@ -112,7 +120,6 @@ public:
 
     Image2DViewer * viewer2D;
 
-    std::vector<std::vector<bool>> upToDate;
     std::vector<Raw3DImage> imgData;
 
     Scene * scene;
@@ -127,8 +134,7 @@ private:
     void reset();
     void initLayout();
     void fillCurrentImages();
-    void fillAllImagesSlices();
-    void fillImage(int imageIdx, int sliceIdx);
+    SliceCache<std::vector<uint16_t>>::Entry fillImage(int imageIdx, int sliceIdx);
     void getColor(int idx, glm::ivec3 position, QColor& color);
     QImage getCurrentMergedImage();
     QImage getMergedImage(int sliceIdx);
@@ -19,9 +19,13 @@
 #include <chrono>
 #include <utility>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "../core/geometry/grid.hpp"
+#include "../core/geometry/tet_rasterizer.hpp"
+#include "../core/images/slice_cache.hpp"
 //#include "../../core/deformation/mesh_deformer.hpp"
 
 #include "../core/utils/apss.hpp"
@@ -206,9 +210,11 @@ void Scene::createBuffers() {
     this->glSelection->setVboIndices(createVBO(GL_ELEMENT_ARRAY_BUFFER, "vboHandle_SelectionIndices"));
 }
 
-std::pair<uint16_t, uint16_t> Scene::sendGridValuesToGPU(int gridIdx) {
+TextureUpload Scene::getGridTextureUpload(int gridIdx) const {
 
-    glm::vec<4, std::size_t, glm::defaultp> dimensions{this->grids[gridIdx]->getResolution(), 2};
+    // Single channel images are uploaded twice to fill the red and green channels, images with real channels are uploaded as they are
+    const std::size_t nbChannels = std::max(2, std::min(this->grids[gridIdx]->getNbChannels(), MAX_NB_CHANNELS));
+    glm::vec<4, std::size_t, glm::defaultp> dimensions{this->grids[gridIdx]->getResolution(), nbChannels};
     TextureUpload _gridTex{};
     _gridTex.minmag.x  = GL_NEAREST;
     _gridTex.minmag.y  = GL_NEAREST;
@@ -232,79 +238,111 @@ std::pair<uint16_t, uint16_t> Scene::sendGridValuesToGPU(int gridIdx) {
     } else {
         _gridTex.swizzle.a = GL_ONE;
     }
+    // 8 bits images are uploaded as they are stored, other images as uint16 as the shaders use an unsigned integer sampler
+    const bool isByteTexture = (this->grids[gridIdx]->getStorageType() == (Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8));
     _gridTex.alignment.x = 1;
-    _gridTex.alignment.y = 2;
+    _gridTex.alignment.y = isByteTexture ? 1 : 2;
     switch (dimensions.a) {
         case 1:
             _gridTex.format			= GL_RED_INTEGER;
-            _gridTex.internalFormat = GL_R16UI;
+            _gridTex.internalFormat = isByteTexture ? GL_R8UI : GL_R16UI;
             break;
         case 2:
             _gridTex.format			= GL_RG_INTEGER;
-            _gridTex.internalFormat = GL_RG16UI;
+            _gridTex.internalFormat = isByteTexture ? GL_RG8UI : GL_RG16UI;
             break;
         case 3:
             _gridTex.format			= GL_RGB_INTEGER;
-            _gridTex.internalFormat = GL_RGB16UI;
+            _gridTex.internalFormat = isByteTexture ? GL_RGB8UI : GL_RGB16UI;
             break;
         case 4:
             _gridTex.format			= GL_RGBA_INTEGER;
-            _gridTex.internalFormat = GL_RGBA16UI;
+            _gridTex.internalFormat = isByteTexture ? GL_RGBA8UI : GL_RGBA16UI;
             break;
     }
-    _gridTex.type = GL_UNSIGNED_SHORT;
-    std::cerr << "Made the upload texture struct.\n";
+    _gridTex.type = isByteTexture ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
 
     _gridTex.size.x = dimensions.x;
     _gridTex.size.y = dimensions.y;
     _gridTex.size.z = dimensions.z;
+    return _gridTex;
+}
 
-    std::vector<std::uint16_t> slices;
+void Scene::sendGridValuesToGPU(int gridIdx) {
+    const TextureUpload _gridTex = this->getGridTextureUpload(gridIdx);
+    std::cerr << "Made the upload texture struct.\n";
     glDeleteTextures(1, &this->grids[gridIdx]->gridTexture);
     this->grids[gridIdx]->gridTexture = this->newAPI_uploadTexture3D_allocateonly(_gridTex);
 
-    int nbSlice = this->grids[gridIdx]->getResolution()[2];
+    std::vector<int> slicesIdx(this->grids[gridIdx]->getResolution()[2]);
+    for(int s = 0; s < slicesIdx.size(); ++s)
+        slicesIdx[s] = s;
+    this->sendGridSlicesToGPU(gridIdx, slicesIdx);
+    this->needUpdateMinMaxDisplayValues = true;
+}
 
-    //TODO: this computation do not belong here
-    uint16_t max = std::numeric_limits<uint16_t>::min();
-    uint16_t min = std::numeric_limits<uint16_t>::max();
+void Scene::sendGridSlicesToGPU(int gridIdx, const std::vector<int>& slicesIdx) {
+    const TextureUpload _gridTex = this->getGridTextureUpload(gridIdx);
+    const bool isByteTexture = (_gridTex.type == GL_UNSIGNED_BYTE);
+    glm::vec<4, std::size_t, glm::defaultp> dimensions{_gridTex.size.x, _gridTex.size.y, _gridTex.size.z, std::max(2, std::min(this->grids[gridIdx]->getNbChannels(), MAX_NB_CHANNELS))};
+    int nbSlice = dimensions.z;
 
     dimensions[0] = dimensions[0] * dimensions[3];// Because we have "a" value
 
     bool addArticialBoundaries = false;
 
-    int sliceI = 0;
-    for (std::size_t s = 0; s < nbSlice; ++s) {
-        this->grids[gridIdx]->getGridSlice(s, slices, dimensions.a);
-        if(addArticialBoundaries) {
-            if(s == 0 || s == nbSlice-1){
-                std::fill(slices.begin(), slices.end(), 0);
-            } else {
-                for(int i = 0; i < dimensions.x; ++i) {
-                    slices[i] = 0;
-                    slices[i+(dimensions.x*(dimensions.y-1))] = 0;
-                }
-                for(int i = 0; i < dimensions.y; ++i) {
-                    slices[i*dimensions.x] = 0;
-                    slices[i*dimensions.x+1] = 0;
-                    slices[i*dimensions.x+(dimensions.x-1)] = 0;
-                    slices[i*dimensions.x+(dimensions.x-2)] = 0;
+    auto uploadSlices = [&](auto& slices) {
+        for (int s : slicesIdx) {
+            this->grids[gridIdx]->getGridSlice(s, slices, dimensions.a);
+            if(addArticialBoundaries) {
+                if(s == 0 || s == nbSlice-1){
+                    std::fill(slices.begin(), slices.end(), 0);
+                } else {
+                    for(int i = 0; i < dimensions.x; ++i) {
+                        slices[i] = 0;
+                        slices[i+(dimensions.x*(dimensions.y-1))] = 0;
+                    }
+                    for(int i = 0; i < dimensions.y; ++i) {
+                        slices[i*dimensions.x] = 0;
+                        slices[i*dimensions.x+1] = 0;
+                        slices[i*dimensions.x+(dimensions.x-1)] = 0;
+                        slices[i*dimensions.x+(dimensions.x-2)] = 0;
+                    }
                 }
             }
+            this->newAPI_uploadTexture3D(this->grids[gridIdx]->gridTexture, _gridTex, s, slices.data());
+            slices.clear();
         }
-        this->newAPI_uploadTexture3D(this->grids[gridIdx]->gridTexture, _gridTex, sliceI, slices);
+    };
 
-        max = std::max(max, *std::max_element(slices.begin(), slices.end()));
-        //min = std::min(min, *std::min_element(slices.begin(), slices.end()));
-        for(uint16_t& val : slices) {
-            if(val > 0 && val < min)
-                min = val;
+    if(isByteTexture) {
+        std::vector<std::uint8_t> slices;
+        uploadSlices(slices);
+    } else {
+        std::vector<std::uint16_t> slices;
+        uploadSlices(slices);
+    }
+}
+
+void Scene::updateLoadingGrids() {
+    std::vector<int> loadedSlices;
+    for(int gridIdx = 0; gridIdx < this->grids.size(); ++gridIdx) {
+        Sampler& sampler = this->grids[gridIdx]->sampler;
+        if(!sampler.isLoading())
+            continue;
+        const bool isLoaded = sampler.updateLoading(loadedSlices);
+        if(!loadedSlices.empty())
+            this->sendGridSlicesToGPU(gridIdx, loadedSlices);
+        if(isLoaded) {
+            // The value range was computed from the preview until now
+            this->needUpdateMinMaxDisplayValues = true;
+            if(this->programStatusBar)
+                this->programStatusBar->clearMessage();
+        } else if(this->programStatusBar) {
+            const std::size_t nbSlices = this->grids[gridIdx]->getNbSlice();
+            this->programStatusBar->showMessage(QString("Loading [%1]: %2/%3 slices").arg(QString::fromStdString(this->grids_name[gridIdx])).arg(sampler.loadingTask->getAdvancement()).arg(nbSlices));
         }
-        slices.clear();
-        sliceI++;
     }
-    this->needUpdateMinMaxDisplayValues = true;
-    return std::make_pair(min, max);
 }
 
 void Scene::addGrid() {
@@ -314,12 +352,10 @@ void Scene::addGrid() {
 
     glm::vec<4, std::size_t, glm::defaultp> dimensions{gridView->getResolution(), 2};
 
-    std::pair<uint16_t, uint16_t> min_max = sendGridValuesToGPU(this->grids.size() -1);
+    sendGridValuesToGPU(this->grids.size() -1);
 
-    uint16_t min = min_max.first;
-    uint16_t max = min_max.second;
-    gridView->sampler.image->minValue = min;
-    gridView->sampler.image->maxValue = max;
+    // The value range is known since the image was loaded, see Sampler::statistics
+    uint16_t max = gridView->getMaxValue();
 
     if(this->activeGrid == 0) {
         QColor r = Qt::GlobalColor::red;
@@ -337,6 +373,13 @@ void Scene::addGrid() {
     drawable_gridView->colorChannelAttributes[0].setMinColorScale(1.);
     drawable_gridView->colorChannelAttributes[0].setMaxVisible(max);
     drawable_gridView->colorChannelAttributes[0].setMaxColorScale(max);
+    const bool isMultiChannel = gridView->getNbChannels() > 1;
+    if(isMultiChannel) {
+        drawable_gridView->colorChannelAttributes[1].setMinVisible(1.);
+        drawable_gridView->colorChannelAttributes[1].setMinColorScale(1.);
+        drawable_gridView->colorChannelAttributes[1].setMaxVisible(max);
+        drawable_gridView->colorChannelAttributes[1].setMaxColorScale(max);
+    }
 
     if(this->activeGrid == 1) {
         this->controlPanel->setMinTexValAlternate(1.);
@@ -349,7 +392,8 @@ void Scene::addGrid() {
         this->controlPanel->setMaxTexVal(max);
         this->controlPanel->updateMaxValue(max);
     }
-    this->setColorChannel(ColorChannel::RedOnly);
+    // The second channel of a multi channel image is displayed in green
+    this->setColorChannel(isMultiChannel ? ColorChannel::RedAndGreen : ColorChannel::RedOnly);
     this->setColorFunction_r(ColorFunction::ColorMagnitude);
     this->setColorFunction_g(ColorFunction::ColorMagnitude);
 
@@ -538,6 +582,10 @@ GLuint Scene::newAPI_uploadTexture3D_allocateonly(const TextureUpload& tex) {
 }
 
 GLuint Scene::newAPI_uploadTexture3D(const GLuint texHandle, const TextureUpload& tex, std::size_t s, std::vector<std::uint16_t>& data) {
+    return this->newAPI_uploadTexture3D(texHandle, tex, s, data.data());
+}
+
+GLuint Scene::newAPI_uploadTexture3D(const GLuint texHandle, const TextureUpload& tex, std::size_t s, const void * data) {
     if (this->context != nullptr) {
         if (this->context->isValid() == false) {
             throw std::runtime_error("No associated valid context");
@@ -549,7 +597,7 @@ GLuint Scene::newAPI_uploadTexture3D(const GLuint texHandle, const TextureUpload
     glEnable(GL_TEXTURE_3D);
     glBindTexture(GL_TEXTURE_3D, texHandle);
 
-    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, s, tex.size.x, tex.size.y, 1, tex.format, tex.type, data.data());
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, s, tex.size.x, tex.size.y, 1, tex.format, tex.type, data);
 
     return texHandle;
 }
@@ -626,6 +674,7 @@ void Scene::setUniformBufferData(GLuint uniform_buffer, std::size_t begin_bytes,
 
 void Scene::drawScene(GLfloat* mvMat, GLfloat* pMat, glm::vec3 camPos, float near, float far) {
     this->cameraPosition = camPos;
+    this->updateLoadingGrids();
     if (this->shouldUpdateUserColorScales) {
         this->updateUserColorScale();
     }
@@ -1843,13 +1892,18 @@ void Scene::writeDeformedImageGeneric(const std::string& filename, const std::st
 template<typename DataType>
 void Scene::writeDeformedImageTemplated(const std::string& filename, const std::string& gridName, const glm::vec3& bbMin, const glm::vec3& bbMax, int bit, Image::ImageDataType dataType, bool useColorMap, const glm::vec3& imageVoxelSize) {
     // To expose as parameters
-    bool smallFile = true;
-    int cacheSize = 2;
     bool useCustomColor = useColorMap;
     glm::ivec3 sceneImageSize = glm::vec3(0, 0, 0);
     //ResolutionMode resolution = ResolutionMode::FULL_RESOLUTION;
 
     Grid * fromGrid = this->grids[this->getGridIdx(gridName)];
+    // The image is read directly, which is only possible once the loading thread is done with it
+    fromGrid->sampler.waitLoading();
+    const ImageReader * reader = fromGrid->sampler.image;
+    if(!reader->canGetImage()) {
+        std::cerr << "ERROR: the slices of the image [" << gridName << "] can't be read, the deformed image is not written" << std::endl;
+        return;
+    }
     glm::vec3 worldSize = fromGrid->getDimensions();
     //glm::vec3 voxelSize = fromGrid->getVoxelSize(resolution);
 
@@ -1857,15 +1911,9 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
 
     glm::vec3 fromImageToCustomImage = glm::vec3(0., 0., 0.);
 
-    auto fromWorldToImage = [&](glm::vec3& p, bool ceil) {
-        p -= fromGrid->bbMin;
-        for(int i = 0; i < 3; ++i) {
-            if(ceil)
-                p[i] = std::ceil((p[i]/imageVoxelSize[i]));
-            else
-                p[i] = std::floor((p[i]/imageVoxelSize[i]));
-        }
-        p /= fromImageToCustomImage;
+    // Position of a point in the lattice of the voxel centers, the inverse of getWorldCoordinates
+    auto fromWorldToLattice = [&](glm::vec3& p) {
+        p = ((p - fromGrid->bbMin) / imageVoxelSize - glm::vec3(.5, .5, .5)) / fromImageToCustomImage;
     };
 
     auto getWorldCoordinates = [&](glm::vec3& p) {
@@ -1894,8 +1942,18 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
     std::cout << "ImageSize: " << imageSize << std::endl;
     std::cout << "Original size: " << sceneImageSize << std::endl;
 
+    // The NIfTI and NRRD images are written with RawVolumeWriter, the other ones as TIFF
+    RawVolume::Format rawFormat;
+    std::unique_ptr<RawVolumeWriter> rawWriter;
     TinyTIFFWriterFile * tif = nullptr;
-    if(useCustomColor) {
+    if(RawVolume::getFormat(filename, rawFormat)) {
+        if(useCustomColor)
+            rawWriter.reset(new RawVolumeWriter(filename, imageSize, imageVoxelSize, Image::ImageDataType::Unsigned | Image::ImageDataType::Bit_8, 3));
+        else
+            rawWriter.reset(new RawVolumeWriter(filename, imageSize, imageVoxelSize, dataType));
+        if(!rawWriter->isOpen())
+            return;
+    } else if(useCustomColor) {
         tif = TinyTIFFWriter_open(filename.c_str(), 8, TinyTIFFWriter_UInt, 3, imageSize[0], imageSize[1], TinyTIFFWriter_RGB);
     } else {
         if(dataType & Image::ImageDataType::Unsigned)
@@ -1906,10 +1964,15 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
             tif = TinyTIFFWriter_open(filename.c_str(), bit, TinyTIFFWriter_Float, 1, imageSize[0], imageSize[1], TinyTIFFWriter_Greyscale);
         else
             std::cout << "WARNING: image data type no take in charge to export" << std::endl;
+        if(tif == nullptr)
+            return;
     }
-
-    if(tif == nullptr)
-        return;
+    auto writeSlice = [&](const void * values) {
+        if(rawWriter)
+            rawWriter->writeSlice(values);
+        else
+            TinyTIFFWriter_writeImage(tif, values);
+    };
 
     std::vector<std::vector<DataType>> img = std::vector<std::vector<DataType>>(sceneImageSize.z, std::vector<DataType>(sceneImageSize.x * sceneImageSize.y, 0.));
 
@@ -1939,87 +2002,84 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
         }
     }
 
-    int cacheMaxNb = std::floor(fromGrid->sampler.image->tiffImageReader->imgResolution.z / float(cacheSize));
-    std::map<int, std::vector<DataType>> cache;
-
-    if(smallFile)
-        for(int i = 0; i < fromGrid->sampler.image->tiffImageReader->imgResolution.z; ++i)
-            fromGrid->sampler.image->tiffImageReader->getImage<DataType>(i, cache[i], {glm::vec3(0., 0., 0.), fromGrid->sampler.image->tiffImageReader->imgResolution});
-
-    #pragma omp parallel for schedule(static) if(smallFile)
-    for(int tetIdx = 0; tetIdx < fromGrid->mesh.size(); ++tetIdx) {
-        //std::cout << "Tet: " << tetIdx << "/" << fromGrid->mesh.size() << std::endl;
-        const Tetrahedron& tet = fromGrid->mesh[tetIdx];
-        glm::vec3 bbMinTet = tet.getBBMin();
-        glm::vec3 bbMaxTet = tet.getBBMax();
-        fromWorldToImage(bbMinTet, false);
-        fromWorldToImage(bbMaxTet, true);
-        int X = bbMaxTet.x;
-        int Y = bbMaxTet.y;
-        int Z = bbMaxTet.z;
-        for(int k = bbMinTet.z; k < Z; ++k) {
-            for(int j = bbMinTet.y; j < Y; ++j) {
-                for(int i = bbMinTet.x; i < X; ++i) {
-                    glm::vec3 p(i, j, k);
-                    if(p.x < bbMinWrite.x ||
-                       p.y < bbMinWrite.y ||
-                       p.z < bbMinWrite.z ||
-                       p.x > bbMaxWrite.x ||
-                       p.y > bbMaxWrite.y ||
-                       p.z > bbMaxWrite.z)
-                        continue;
-                    getWorldCoordinates(p);
-                    if(tet.isInTetrahedron(p)) {
-                        if(fromGrid->getCoordInInitial(fromGrid->initialMesh, p, p, tetIdx)) {
-                            int insertIdx = i + j*sceneImageSize[0];
-
-                            //p *= fromGrid->sampler.resolutionRatio;
-                            //p += glm::vec3(.5, .5, .5);
-                            int imgIdxLoad = std::floor(p.z);
-                            int idxLoad = std::floor(p.x) + std::floor(p.y) * fromGrid->sampler.image->tiffImageReader->imgResolution.x;
-
-                            if(img[k][insertIdx] == 0) {
-
-                                bool isInBBox = true;
-                                for(int l = 0; l < 3; ++l) {
-                                    if(p[l] < 0. || p[l] >= fromGrid->sampler.image->tiffImageReader->imgResolution[l])
-                                        isInBBox = false;
-                                }
+    // The slices of the source image are read on demand, the least recently used ones are dropped to stay under the memory budget
+    const glm::vec3 readerResolution = reader->imgResolution;
+    SliceCache<std::vector<DataType>> cache;
+    std::mutex readMutex;
+    auto getSlice = [&](int sliceIdx) {
+        return cache.getOrLoad(sliceIdx, [&]() {
+            std::lock_guard<std::mutex> lock(readMutex);
+            std::vector<DataType> slice;
+            reader->getImage<DataType>(sliceIdx, slice);
+            return slice;
+        });
+    };
 
-                                if(isInBBox) {
-                                    bool imgAlreadyLoaded = cache.find(imgIdxLoad) != cache.end();
-                                    if(!imgAlreadyLoaded) {
-                                        if(cache.size() > cacheMaxNb) {
-                                            cache.erase(cache.begin());
-                                        }
-                                        fromGrid->sampler.image->tiffImageReader->getImage<DataType>(imgIdxLoad, cache[imgIdxLoad], {glm::vec3(0., 0., 0.), fromGrid->sampler.image->tiffImageReader->imgResolution});
-                                    }
-                                    if(useCustomColor) {
-                                        if(k >= 0 && k < img_color.size() && insertIdx*3 < img_color[0].size() && insertIdx >= 0) {
-                                            if(imgIdxLoad >= 0 && imgIdxLoad < cache.size() && idxLoad < cache[0].size() && idxLoad >= 0) {
-                                                uint16_t value = 0;
-                                                value = cache[imgIdxLoad][idxLoad];
-                                                if(data[value]) {
-                                                    glm::vec3 color = data_color[value];
-                                                    insertIdx *= 3;
-                                                    img_color[k][insertIdx] = static_cast<uint8_t>(color.r * 255.);
-                                                    img_color[k][insertIdx+1] = static_cast<uint8_t>(color.g * 255.);
-                                                    img_color[k][insertIdx+2] = static_cast<uint8_t>(color.b * 255.);
-                                                }
-                                            }
+    // Voxels to write, each one belongs to a single tetrahedron, see TetRasterizer
+    const glm::ivec3 latticeMin = glm::max(bbMinWrite, glm::ivec3(0, 0, 0));
+    const glm::ivec3 latticeMax = glm::min(bbMaxWrite + glm::ivec3(1, 1, 1), sceneImageSize);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int tetIdx = 0; tetIdx < fromGrid->getNbTetrahedra(); ++tetIdx) {
+        //std::cout << "Tet: " << tetIdx << "/" << fromGrid->getNbTetrahedra() << std::endl;
+        // Most of the consecutive voxels of a tetrahedron read the same slice
+        int lastSliceIdx = -1;
+        typename SliceCache<std::vector<DataType>>::Entry slice;
+        const Tetrahedron tet = fromGrid->getTetra(tetIdx);
+        glm::vec3 points[4];
+        for(int i = 0; i < 4; ++i) {
+            points[i] = tet.points[i];
+            fromWorldToLattice(points[i]);
+        }
+        TetRasterizer(points, tet.pointsIdx).rasterize(latticeMin, latticeMax, [&](int j, int k, int first, int last) {
+            for(int i = first; i <= last; ++i) {
+                glm::vec3 p(i, j, k);
+                getWorldCoordinates(p);
+                if(fromGrid->getCoordInInitial(fromGrid->initialMesh, p, p, tetIdx)) {
+                    int insertIdx = i + j*sceneImageSize[0];
+
+                    //p *= fromGrid->sampler.resolutionRatio;
+                    //p += glm::vec3(.5, .5, .5);
+                    int imgIdxLoad = std::floor(p.z);
+                    int idxLoad = std::floor(p.x) + std::floor(p.y) * readerResolution.x;
+
+                    if(img[k][insertIdx] == 0) {
+
+                        bool isInBBox = true;
+                        for(int l = 0; l < 3; ++l) {
+                            if(p[l] < 0. || p[l] >= readerResolution[l])
+                                isInBBox = false;
+                        }
+
+                        if(isInBBox) {
+                            if(imgIdxLoad != lastSliceIdx) {
+                                slice = getSlice(imgIdxLoad);
+                                lastSliceIdx = imgIdxLoad;
+                            }
+                            if(useCustomColor) {
+                                if(k >= 0 && k < img_color.size() && insertIdx*3 < img_color[0].size() && insertIdx >= 0) {
+                                    if(idxLoad < slice->size() && idxLoad >= 0) {
+                                        uint16_t value = 0;
+                                        value = (*slice)[idxLoad];
+                                        if(data[value]) {
+                                            glm::vec3 color = data_color[value];
+                                            insertIdx *= 3;
+                                            img_color[k][insertIdx] = static_cast<uint8_t>(color.r * 255.);
+                                            img_color[k][insertIdx+1] = static_cast<uint8_t>(color.g * 255.);
+                                            img_color[k][insertIdx+2] = static_cast<uint8_t>(color.b * 255.);
                                         }
-                                    } else {
-                                        if(k >= 0 && k < img.size() && insertIdx < img[0].size() && insertIdx >= 0)
-                                            if(imgIdxLoad >= 0 && imgIdxLoad < cache.size() && idxLoad < cache[0].size() && idxLoad >= 0)
-                                                img[k][insertIdx] = cache[imgIdxLoad][idxLoad];
                                     }
                                 }
+                            } else {
+                                if(k >= 0 && k < img.size() && insertIdx < img[0].size() && insertIdx >= 0)
+                                    if(idxLoad < slice->size() && idxLoad >= 0)
+                                        img[k][insertIdx] = (*slice)[idxLoad];
                             }
                         }
                     }
                 }
             }
-        }
+        });
     }
 
     //this->writeGreyscaleTIFFImage(filename, n, img);
@@ -2039,7 +2099,7 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
             }
         }
         for(int i = 0; i < finalImg.size(); ++i) {
-            TinyTIFFWriter_writeImage(tif, finalImg[i].data());
+            writeSlice(finalImg[i].data());
         }
     } else {
         std::vector<std::vector<DataType>> finalImg = std::vector<std::vector<DataType>>(imageSize.z, std::vector<DataType>(imageSize.x * imageSize.y, 0.));
@@ -2051,10 +2111,13 @@ void Scene::writeDeformedImageTemplated(const std::string& filename, const std::
             }
         }
         for(int i = 0; i < finalImg.size(); ++i) {
-            TinyTIFFWriter_writeImage(tif, finalImg[i].data());
+            writeSlice(finalImg[i].data());
         }
     }
-    TinyTIFFWriter_close(tif);
+    if(rawWriter)
+        rawWriter->close();
+    else
+        TinyTIFFWriter_close(tif);
     std::cout << "Destination: " << filename << std::endl;
     std::cout << "Save sucessfull" << std::endl;
 
@@ -2119,6 +2182,8 @@ void Scene::writeGreyscaleTIFFImage(const std::string& filename, const glm::vec3
 
 void Scene::clear() {
     this->updateTools(MeshManipulatorType::NONE);
+    for(Grid * grid : this->grids)
+        grid->sampler.cancelLoading();
     this->grids_name.clear();
     this->grids.clear();
     this->meshes.clear();
@@ -128,7 +128,14 @@ public:
     GLuint uploadTexture2D(const TextureUpload& tex);
     GLuint uploadTexture3D(const TextureUpload& tex);
     GLuint newAPI_uploadTexture3D(const GLuint handle, const TextureUpload& tex, std::size_t s, std::vector<std::uint16_t>& data);
+    //! @brief Upload the slice s, data has to follow tex.format and tex.type .
+    GLuint newAPI_uploadTexture3D(const GLuint handle, const TextureUpload& tex, std::size_t s, const void * data);
     GLuint newAPI_uploadTexture3D_allocateonly(const TextureUpload& tex);
+    //! @brief Upload the values of some slices of a grid to its already allocated texture.
+    void sendGridSlicesToGPU(int gridIdx, const std::vector<int>& slicesIdx);
+    TextureUpload getGridTextureUpload(int gridIdx) const;
+    //! @brief Upload the slices loaded in background since the last frame, see Sampler::updateLoading().
+    void updateLoadingGrids();
 
     void recompileShaders(bool verbose = true);
 
@@ -212,8 +219,8 @@ public:
     void writeDeformedImageGeneric(const std::string& filename, const std::string& gridName, const glm::vec3& bbMin, const glm::vec3& bbMax, Image::ImageDataType imgDataType, bool useColorMap, const glm::vec3& voxelSize);
     template<typename DataType>
 
-    //! @brief Write a deformed image into a TIFF image file.
-    //! This function uses the TinyTIFF library, and TIFF is the only format supported.
+    //! @brief Write a deformed image into a TIFF, NIfTI or NRRD image file, chosen from the extension of filename.
+    //! The TIFF images are written with the TinyTIFF library, the NIfTI (.nii, .nii.gz) and NRRD (.nrrd) ones with RawVolumeWriter.
     //! The TinyTIFF library has been choosen after several failed attempts to implement a writer using the tedious C library libtiff.
     void writeDeformedImageTemplated(const std::string& filename, const std::string& gridName, const glm::vec3& bbMin, const glm::vec3& bbMax, int bit, Image::ImageDataType dataType, bool useColorMap, const glm::vec3& imageVoxelSize);
 
@@ -338,7 +345,7 @@ public slots:
     // Rendering slots
     void setColorChannel(ColorChannel mode);
     void updateTetmeshAllGrids(bool updateAllInfos = false);
-    std::pair<uint16_t, uint16_t> sendGridValuesToGPU(int gridIdx);
+    void sendGridValuesToGPU(int gridIdx);
     void setLightPosition(const glm::vec3& lighPosition);
 
     // Scene management